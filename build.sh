@@ -0,0 +1,28 @@
+#!/bin/sh
+# linux version of build.bat, same steps and flags
+# the toolchain prefix can be overridden, e.g. PREFIX=mipsel-linux-gnu ./build.sh
+PREFIX="${PREFIX:-mipsel-none-elf}"
+
+cd "$(dirname "$0")" || exit 1
+mkdir -p build
+
+# 1) gather sources (every .c/.S/.s from here down, same as build.bat, whose *.S also matches
+#    .s since windows doesn't care about case)
+find . -path ./build -prune -o \( -name '*.c' -o -name '*.S' -o -name '*.s' \) -print | sed 's|^\./||' > build/sources.rsp
+
+# 2) build ELF (startup + your code + baremetal sources) using the baremetal linker script
+"$PREFIX-gcc" \
+  -Os -ffreestanding -fno-builtin -nostdlib \
+  -march=r3000 -mabi=32 -mno-abicalls -G0 \
+  -I"libc" -I"ps1" -I"vendor" \
+  @build/sources.rsp \
+  -Wl,-T,"ps1/ps1.ld" -Wl,--gc-sections \
+  -o build/game.elf \
+  -lgcc \
+  -ggdb \
+  "$@" || exit 1
+
+# 3) convert ELF -> PS-EXE
+python3 tools/convertExecutable.py build/game.elf build/game.psexe || exit 1
+
+echo "OK: build/game.psexe"
@@ -0,0 +1,177 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "archive.h"
+#include "cd.h"
+#include "iso.h"
+#include "lz4.h"
+
+static uint32_t _tocBuffer[CD_SECTOR_SIZE / 4];
+
+/* Table of contents */
+
+bool openArchive(Archive *archive, uint32_t lba) {
+	CDReadRequest request = {
+		.lba      = lba,
+		.count    = 1,
+		.dest     = _tocBuffer,
+		.callback = 0
+	};
+
+	if (!readCDSectors(&request) || !waitForCDRead(&request))
+		return false;
+
+	const ArchiveHeader *header = (const ArchiveHeader *) _tocBuffer;
+
+	if (
+		(header->magic != ARCHIVE_MAGIC) ||
+		(header->numEntries > ARCHIVE_MAX_ENTRIES)
+	)
+		return false;
+
+	archive->lba    = lba;
+	archive->header = *header;
+
+	memcpy(
+		archive->entries,
+		&header[1],
+		header->numEntries * sizeof(ArchiveEntry)
+	);
+	return true;
+}
+
+bool openArchiveFile(Archive *archive, const char *path) {
+	const ISOIndexEntry *file = findISOFile(path);
+
+	if (!file)
+		return false;
+
+	return openArchive(archive, file->lba);
+}
+
+const ArchiveEntry *findArchiveEntry(const Archive *archive, const char *name) {
+	uint32_t hash = hashISOPath(name);
+	int      low  = 0;
+	int      high = archive->header.numEntries - 1;
+
+	while (low <= high) {
+		int                mid   = (low + high) / 2;
+		const ArchiveEntry *entry = &archive->entries[mid];
+
+		if (entry->hash == hash)
+			return entry;
+		if (entry->hash < hash)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+
+	return 0;
+}
+
+/* Loading */
+
+bool startArchiveLoad(
+	ArchiveLoad *load, const Archive *archive, const ArchiveEntry *entry,
+	void *dest
+) {
+	int numSectors =
+		(entry->packedSize + CD_SECTOR_SIZE - 1) / CD_SECTOR_SIZE;
+
+	// Compressed entries are read into the end of the buffer, stored ones
+	// directly at the beginning (their margin only pads them to a whole
+	// number of sectors).
+	uint8_t *packed = (uint8_t *) dest;
+
+	if (entry->method == ARCHIVE_METHOD_LZ4) {
+		packed += getArchiveBufferSize(entry) - numSectors * CD_SECTOR_SIZE;
+
+		initLZ4Stream(&load->stream, dest, entry->size, entry->packedSize);
+	}
+
+	load->entry      = entry;
+	load->packed     = packed;
+	load->sectorsFed = 0;
+	load->status     = ARCHIVE_LOAD_BUSY;
+
+	load->request.lba         = archive->lba + entry->sector;
+	load->request.count       = numSectors;
+	load->request.dest        = packed;
+	load->request.callback    = 0;
+	load->request.sectorsDone = 0;
+	load->request.status      = CD_READ_DONE;
+
+	if (!numSectors)
+		return true;
+	if (!readCDSectors(&load->request)) {
+		load->status = ARCHIVE_LOAD_ERROR;
+		return false;
+	}
+
+	return true;
+}
+
+ArchiveLoadStatus updateArchiveLoad(ArchiveLoad *load) {
+	if (load->status != ARCHIVE_LOAD_BUSY)
+		return load->status;
+
+	// The status must be read first; if it says the request is done, all
+	// sectors are guaranteed to be counted in sectorsDone.
+	CDReadStatus       status = load->request.status;
+	int                done   = load->request.sectorsDone;
+	const ArchiveEntry *entry = load->entry;
+
+	if (status == CD_READ_ERROR) {
+		load->status = ARCHIVE_LOAD_ERROR;
+		return load->status;
+	}
+
+	if (entry->method == ARCHIVE_METHOD_LZ4) {
+		for (; load->sectorsFed < done; load->sectorsFed++) {
+			size_t offset = load->sectorsFed * CD_SECTOR_SIZE;
+			size_t length = entry->packedSize - offset;
+
+			if (length > CD_SECTOR_SIZE)
+				length = CD_SECTOR_SIZE;
+
+			if (feedLZ4Stream(
+				&load->stream, &load->packed[offset], length
+			) == LZ4_STREAM_ERROR) {
+				load->status = ARCHIVE_LOAD_ERROR;
+				return load->status;
+			}
+		}
+	} else {
+		load->sectorsFed = done;
+	}
+
+	if (status == CD_READ_DONE) {
+		if (
+			(entry->method == ARCHIVE_METHOD_LZ4) &&
+			(load->stream.status != LZ4_STREAM_DONE)
+		)
+			load->status = ARCHIVE_LOAD_ERROR;
+		else
+			load->status = ARCHIVE_LOAD_DONE;
+	}
+
+	return load->status;
+}
+
+bool loadArchiveEntry(
+	const Archive *archive, const ArchiveEntry *entry, void *dest
+) {
+	ArchiveLoad load;
+
+	if (!startArchiveLoad(&load, archive, entry, dest))
+		return false;
+
+	ArchiveLoadStatus status;
+
+	do {
+		status = updateArchiveLoad(&load);
+	} while (status == ARCHIVE_LOAD_BUSY);
+
+	return (status == ARCHIVE_LOAD_DONE);
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cd.h"
+#include "lz4.h"
+
+// Archives are generated by tools/packArchive.py. The first sector holds the
+// header and the table of contents (sorted by name hash); each entry's data
+// starts on a sector boundary and is either stored as-is or LZ4 compressed.
+#define ARCHIVE_MAGIC       0x314b4150 // "PAK1"
+#define ARCHIVE_MAX_ENTRIES 100
+
+typedef enum {
+	ARCHIVE_METHOD_STORE = 0,
+	ARCHIVE_METHOD_LZ4   = 1
+} ArchiveMethod;
+
+typedef struct {
+	uint32_t magic, numEntries, numSectors, _reserved;
+} ArchiveHeader;
+
+typedef struct {
+	uint32_t hash;       // hashISOPath() of the entry's name
+	uint32_t sector;     // Offset from the beginning of the archive
+	uint32_t packedSize;
+	uint32_t size;
+	uint16_t method;
+	uint16_t margin;     // Extra buffer space needed to load in place
+} ArchiveEntry;
+
+typedef struct {
+	uint32_t      lba;
+	ArchiveHeader header;
+	ArchiveEntry  entries[ARCHIVE_MAX_ENTRIES];
+} Archive;
+
+typedef enum {
+	ARCHIVE_LOAD_BUSY  = 0,
+	ARCHIVE_LOAD_DONE  = 1,
+	ARCHIVE_LOAD_ERROR = 2
+} ArchiveLoadStatus;
+
+typedef struct {
+	CDReadRequest      request;
+	LZ4Stream          stream;
+	const ArchiveEntry *entry;
+	const uint8_t      *packed;
+	int                sectorsFed;
+	ArchiveLoadStatus  status;
+} ArchiveLoad;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Returns the size of the buffer that must be passed to
+ * startArchiveLoad() or loadArchiveEntry() for the given entry. This is
+ * slightly larger than the entry's uncompressed size, as the compressed data
+ * is read into the end of the same buffer and decompressed in place.
+ */
+static inline size_t getArchiveBufferSize(const ArchiveEntry *entry) {
+	return entry->size + entry->margin;
+}
+
+/**
+ * @brief Reads the table of contents of the archive starting at the given LBA
+ * (blocking).
+ *
+ * @param archive
+ * @param lba
+ * @return false if the sector could not be read or is not an archive
+ */
+bool openArchive(Archive *archive, uint32_t lba);
+
+/**
+ * @brief Same as openArchive(), but looks up the archive's location in the
+ * ISO9660 file index (see iso.h).
+ *
+ * @param archive
+ * @param path
+ */
+bool openArchiveFile(Archive *archive, const char *path);
+
+/**
+ * @brief Looks up an entry by name (without going through the disc).
+ *
+ * @param archive
+ * @param name
+ * @return The entry, or a null pointer if not found
+ */
+const ArchiveEntry *findArchiveEntry(const Archive *archive, const char *name);
+
+/**
+ * @brief Starts loading an entry asynchronously into the given buffer, which
+ * must be 4-byte aligned and at least getArchiveBufferSize() bytes long. The
+ * uncompressed data ends up at the beginning of the buffer; the rest can be
+ * reused once loading is done. The ArchiveLoad structure and the buffer must
+ * remain valid until updateArchiveLoad() returns something other than
+ * ARCHIVE_LOAD_BUSY.
+ *
+ * @param load
+ * @param archive
+ * @param entry
+ * @param dest
+ * @return false if the CD-ROM driver's queue is full or XA audio is playing
+ */
+bool startArchiveLoad(
+	ArchiveLoad *load, const Archive *archive, const ArchiveEntry *entry,
+	void *dest
+);
+
+/**
+ * @brief Decompresses any sectors that have been read since the last call.
+ * Must be called periodically (e.g. once per frame) until it returns
+ * ARCHIVE_LOAD_DONE or ARCHIVE_LOAD_ERROR.
+ *
+ * @param load
+ */
+ArchiveLoadStatus updateArchiveLoad(ArchiveLoad *load);
+
+/**
+ * @brief Loads an entry, blocking until done. Sectors are still decompressed
+ * as soon as they arrive, overlapping decompression with the drive's reading.
+ *
+ * @param archive
+ * @param entry
+ * @param dest
+ * @return true if successful
+ */
+bool loadArchiveEntry(
+	const Archive *archive, const ArchiveEntry *entry, void *dest
+);
+
+#ifdef __cplusplus
+}
+#endif
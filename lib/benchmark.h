@@ -0,0 +1,333 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cd.h"
+#include "lz4.h"
+#include "mdec.h"
+#include "timer.h"
+
+#pragma once
+
+// Micro benchmarks, printed over serial. Build with -DRUN_BENCHMARKS to have
+// main() run them once at boot. Numbers are in timer ticks (~236ns each, see
+// timer.h) per call, averaged over enough calls to get a stable result.
+
+// Reference byte-at-a-time versions of the libc functions, these are what
+// libc/string.c used to do.
+static void * __attribute__((noinline)) BenchByteMemmove(void *dest, const void *src, size_t count)
+{
+	uint8_t *d = (uint8_t *) dest;
+	const uint8_t *s = (const uint8_t *) src;
+	if (d < s){for (; count; count--){*(d++) = *(s++);}}
+	else
+	{
+		d += count;
+		s += count;
+		for (; count; count--){*(--d) = *(--s);}
+	}
+	return dest;
+}
+
+static int __attribute__((noinline)) BenchByteMemcmp(const void *lhs, const void *rhs, size_t count)
+{
+	const uint8_t *l = (const uint8_t *) lhs, *r = (const uint8_t *) rhs;
+	for (; count; count--)
+	{
+		uint8_t a = *(l++), b = *(r++);
+		if (a != b){return ((int) a) - ((int) b);}
+	}
+	return 0;
+}
+
+static void * __attribute__((noinline)) BenchByteMemchr(const void *ptr, int ch, size_t count)
+{
+	const uint8_t *p = (const uint8_t *) ptr;
+	for (; count; count--, p++){if (*p == ch){return (void *) p;}}
+	return 0;
+}
+
+static size_t __attribute__((noinline)) BenchByteStrlen(const char *str)
+{
+	size_t length = 0;
+	for (; *str; str++){length++;}
+	return length;
+}
+
+static char * __attribute__((noinline)) BenchByteStrcpy(char *dest, const char *src)
+{
+	char *d = dest;
+	while (*src){*(d++) = *(src++);}
+	*d = 0;
+	return dest;
+}
+
+#define BENCH_BUFFER_SIZE 4104 //largest size + room for misalignment
+#define BENCH_TICK_BUDGET 40000 //keep each timed batch well under the 16 bit timer wrap
+
+static uint8_t benchSrc[BENCH_BUFFER_SIZE] __attribute__((aligned(4)));
+static uint8_t benchDest[BENCH_BUFFER_SIZE] __attribute__((aligned(4)));
+static const int benchSizes[] = { 4, 16, 64, 256, 1024, 4096 };
+static const int benchAlignments[][2] = { {0, 0}, {1, 1}, {0, 1}, {3, 2} }; //dest, src offsets
+//memmove also gets run within a single buffer, dest < src (forward copy) and dest > src (backward)
+static const int benchOverlaps[][2] = { {0, 1}, {0, 4}, {1, 0}, {4, 0} }; //dest, src offsets into benchDest
+
+typedef enum {
+	BENCH_MEMMOVE = 0,
+	BENCH_MEMCMP,
+	BENCH_MEMCHR,
+	BENCH_STRLEN,
+	BENCH_STRCPY,
+	BENCH_COUNT
+} BenchFunction;
+
+static const char *const benchNames[] = { "memmove", "memcmp", "memchr", "strlen", "strcpy" };
+
+static void BenchCall(BenchFunction func, bool reference, uint8_t *dest, uint8_t *src, int size)
+{
+	switch (func)
+	{
+		case BENCH_MEMMOVE:
+			if (reference){BenchByteMemmove(dest, src, size);}
+			else{memmove(dest, src, size);}
+			break;
+		case BENCH_MEMCMP:
+			if (reference){BenchByteMemcmp(dest, src, size);}
+			else{memcmp(dest, src, size);}
+			break;
+		case BENCH_MEMCHR:
+			if (reference){BenchByteMemchr(src, 0xff, size);}
+			else{memchr(src, 0xff, size);}
+			break;
+		case BENCH_STRLEN:
+			if (reference){BenchByteStrlen((const char *) src);}
+			else{strlen((const char *) src);}
+			break;
+		case BENCH_STRCPY:
+			if (reference){BenchByteStrcpy((char *) dest, (const char *) src);}
+			else{strcpy((char *) dest, (const char *) src);}
+			break;
+		default:
+			break;
+	}
+}
+
+//average ticks per call, times 16 so small sizes still show a difference
+static uint32_t BenchMeasure(BenchFunction func, bool reference, uint8_t *dest, uint8_t *src, int size)
+{
+	//figure out how many calls fit in the tick budget from a single call
+	uint16_t start = ReadTimer();
+	BenchCall(func, reference, dest, src, size);
+	uint32_t single = TimerElapsed(start);
+	int reps = single ? (BENCH_TICK_BUDGET / single) : 256;
+	if (reps < 1){reps = 1;}
+	if (reps > 256){reps = 256;}
+
+	start = ReadTimer();
+	for (int i = 0; i < reps; i++){BenchCall(func, reference, dest, src, size);}
+	uint32_t total = TimerElapsed(start);
+	return (total * 16) / reps;
+}
+
+static void BenchRow(BenchFunction func, int size, int destOffset, int srcOffset, bool overlap)
+{
+	uint8_t *dest = &benchDest[destOffset];
+	uint8_t *src = overlap ? &benchDest[srcOffset] : &benchSrc[srcOffset];
+
+	//non zero, no 0xff (so memchr scans everything), the same bytes from dest and src on (so
+	//memcmp goes all the way too), terminated at size for the string functions
+	for (int i = 0; i < size; i++){dest[i] = src[i] = 'a' + (i % 26);}
+	src[size] = 0;
+	dest[size] = 0;
+
+	uint32_t byteTicks = BenchMeasure(func, true, dest, src, size);
+	uint32_t wordTicks = BenchMeasure(func, false, dest, src, size);
+	uint32_t speedup = wordTicks ? (byteTicks * 100) / wordTicks : 0;
+	printf(
+		"  %-7s %4d dst+%d src+%d%s: byte %5d.%02d word %5d.%02d (%d.%02dx)\n",
+		benchNames[func], size, destOffset, srcOffset, overlap ? " overlap" : "",
+		byteTicks / 16, ((byteTicks % 16) * 100) / 16,
+		wordTicks / 16, ((wordTicks % 16) * 100) / 16,
+		speedup / 100, speedup % 100
+	);
+}
+
+static void RunStringBenchmarks(void)
+{
+	InitTimer();
+	printf("string benchmark (ticks per call, byte loop vs word at a time)\n");
+
+	for (int f = 0; f < BENCH_COUNT; f++)
+	{
+		for (int s = 0; s < (int) (sizeof(benchSizes) / sizeof(benchSizes[0])); s++)
+		{
+			for (int a = 0; a < (int) (sizeof(benchAlignments) / sizeof(benchAlignments[0])); a++)
+			{
+				BenchRow(f, benchSizes[s], benchAlignments[a][0], benchAlignments[a][1], false);
+			}
+			if (f != BENCH_MEMMOVE){continue;}
+			for (int a = 0; a < (int) (sizeof(benchOverlaps) / sizeof(benchOverlaps[0])); a++)
+			{
+				BenchRow(f, benchSizes[s], benchOverlaps[a][0], benchOverlaps[a][1], true);
+			}
+		}
+	}
+}
+
+// Decompression benchmark. There's no lz4 compressor on the console, so the
+// input is a synthetic block built on the fly: short random literal runs and
+// matches at random offsets, which compresses about 2:1 (roughly what
+// packArchive.py gets out of our textures and meshes).
+#define BENCH_LZ4_SIZE 32768
+#define BENCH_LZ4_REPS 8
+
+static uint8_t *BenchPutLength(uint8_t *out, int length)
+{
+	for (; length >= 255; length -= 255){*(out++) = 255;}
+	*(out++) = length;
+	return out;
+}
+
+static size_t BenchMakeLZ4(uint8_t *dest, int size)
+{
+	uint8_t *out = dest;
+	uint32_t seed = 12345;
+	int produced = 0;
+
+	//leave room for the last sequence, which has to be at least 5 literals
+	while (produced + 64 < size)
+	{
+		seed = seed * 1103515245 + 12345;
+		int literals = 1 + ((seed >> 8) % 20);
+		int matchLength = 4 + ((seed >> 16) % 24);
+		int window = (produced + literals < 4096) ? (produced + literals) : 4096;
+		int offset = 1 + ((seed >> 4) % window);
+
+		*(out++) = ((literals < 15 ? literals : 15) << 4) | (matchLength - 4 < 15 ? matchLength - 4 : 15);
+		if (literals >= 15){out = BenchPutLength(out, literals - 15);}
+		for (int i = 0; i < literals; i++){seed = seed * 1103515245 + 12345; *(out++) = seed >> 24;}
+		*(out++) = offset & 0xff;
+		*(out++) = offset >> 8;
+		if (matchLength - 4 >= 15){out = BenchPutLength(out, matchLength - 19);}
+		produced += literals + matchLength;
+	}
+
+	int literals = size - produced;
+	*(out++) = (literals < 15 ? literals : 15) << 4;
+	if (literals >= 15){out = BenchPutLength(out, literals - 15);}
+	for (int i = 0; i < literals; i++){*(out++) = i;}
+	return out - dest;
+}
+
+static void RunDecompressBenchmarks(void)
+{
+	static const char *const names[] = { "memcpy", "lz4 block", "lz4 stream" };
+
+	InitTimer();
+	uint8_t *packed = (uint8_t *) malloc(BENCH_LZ4_SIZE);
+	uint8_t *output = (uint8_t *) malloc(BENCH_LZ4_SIZE);
+	if (!packed || !output){puts("decompression benchmark: out of memory"); free(packed); free(output); return;}
+
+	size_t packedSize = BenchMakeLZ4(packed, BENCH_LZ4_SIZE);
+	printf(
+		"decompression benchmark (%d bytes from %d, %d runs, output MB/s)\n",
+		BENCH_LZ4_SIZE, (int) packedSize, BENCH_LZ4_REPS
+	);
+
+	for (int mode = 0; mode < 3; mode++)
+	{
+		bool ok = true;
+		uint32_t start = ReadTimebase();
+		for (int i = 0; i < BENCH_LZ4_REPS; i++)
+		{
+			if (mode == 0){memcpy(output, packed, BENCH_LZ4_SIZE);}
+			else if (mode == 1){ok &= (decompressLZ4(output, BENCH_LZ4_SIZE, packed, packedSize) == BENCH_LZ4_SIZE);}
+			else
+			{
+				//fed a sector at a time, same as archive.c does while loading
+				LZ4Stream stream;
+				initLZ4Stream(&stream, output, BENCH_LZ4_SIZE, packedSize);
+				for (size_t offset = 0; offset < packedSize; offset += CD_SECTOR_SIZE)
+				{
+					size_t length = packedSize - offset;
+					if (length > CD_SECTOR_SIZE){length = CD_SECTOR_SIZE;}
+					feedLZ4Stream(&stream, &packed[offset], length);
+				}
+				ok &= (stream.status == LZ4_STREAM_DONE);
+			}
+		}
+		uint32_t ticks = ReadTimebase() - start;
+
+		//everything is measured by bytes written, so memcpy is the ceiling
+		uint32_t bytes = BENCH_LZ4_SIZE * BENCH_LZ4_REPS;
+		uint32_t kbPerSecond = ticks ? ((bytes / 1024) * TIMER_TICKS_PER_SECOND) / ticks : 0;
+		printf(
+			"  %-10s %d.%02d MB/s (%d ticks)%s\n",
+			names[mode], kbPerSecond / 1024, ((kbPerSecond % 1024) * 100) / 1024,
+			(int) ticks, ok ? "" : " FAILED"
+		);
+	}
+
+	free(packed);
+	free(output);
+}
+
+#define BENCH_MDEC_WIDTH  320
+#define BENCH_MDEC_HEIGHT 240
+
+/// @brief build an image with only DC coefficients (one flat color per 8x8 block), a
+/// colored gradient that's easy to recognize in the vram viewer
+static MDECImage *BenchMakeMDEC(void)
+{
+	int numBlocks = (BENCH_MDEC_WIDTH / 16) * (BENCH_MDEC_HEIGHT / 16) * 6;
+	//dc + end of block per block, rounded up to the 32 word dma block size
+	uint32_t length = (numBlocks + 31) & ~31;
+	MDECImage *image = (MDECImage *) malloc(sizeof(MDECImage) + length * 4);
+	if (!image){return 0;}
+	image->magic = MDEC_IMAGE_MAGIC;
+	image->width = BENCH_MDEC_WIDTH;
+	image->height = BENCH_MDEC_HEIGHT;
+	image->length = length;
+
+	uint16_t *out = (uint16_t *) image->data;
+	for (int x = 0; x < BENCH_MDEC_WIDTH; x += 16)
+	{
+		for (int y = 0; y < BENCH_MDEC_HEIGHT; y += 16)
+		{
+			//cr, cb, then the 4 luma blocks. dc levels are 4x the sample value (see encodeMDEC.py)
+			int dc[6] = { (x - 160) * 3 / 2, (y - 120) * 2, 0, 0, 0, 0 };
+			for (int i = 0; i < 4; i++){dc[2 + i] = ((x + (i & 1) * 8 + y + (i >> 1) * 8) * 1022) / 544 - 511;}
+			for (int i = 0; i < 6; i++)
+			{
+				*(out++) = (1 << 10) | (dc[i] & 0x3ff);
+				*(out++) = 0xfe00;
+			}
+		}
+	}
+	while (out < (uint16_t *) &image->data[length]){*(out++) = 0xfe00;}
+	return image;
+}
+
+/// @brief decode a full screen image with the mdec, into the second framebuffer (which the
+/// first frames then overwrite, pause the emulator right after boot to look at it)
+static void RunMDECBenchmark(void)
+{
+	InitTimer();
+	MDECImage *image = BenchMakeMDEC();
+	if (!image){puts("mdec benchmark: out of memory"); return;}
+
+	uint32_t start = ReadTimebase();
+	bool ok = decodeMDECImage(image, BENCH_MDEC_WIDTH, 0);
+	uint32_t ticks = ReadTimebase() - start;
+
+	uint32_t bytes = BENCH_MDEC_WIDTH * BENCH_MDEC_HEIGHT * 2;
+	uint32_t kbPerSecond = ticks ? ((bytes / 1024) * TIMER_TICKS_PER_SECOND) / ticks : 0;
+	printf(
+		"mdec benchmark (%dx%d, %d bitstream bytes): %d.%02d MB/s (%d ticks)%s\n",
+		BENCH_MDEC_WIDTH, BENCH_MDEC_HEIGHT, (int) image->length * 4,
+		kbPerSecond / 1024, ((kbPerSecond % 1024) * 100) / 1024,
+		(int) ticks, ok ? "" : " FAILED"
+	);
+	free(image);
+}
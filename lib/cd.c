@@ -0,0 +1,625 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "cd.h"
+#include "../ps1/cdrom.h"
+#include "../ps1/registers.h"
+#include "../ps1/system.h"
+
+// The whole driver is a state machine advanced by the CD-ROM IRQ (command
+// acknowledged, command complete, sector ready, error) and by the DMA channel 3
+// completion IRQ (sector transferred into the ring). Commands are only ever
+// issued from those handlers or with interrupts disabled, one at a time; if
+// something needs to happen while a command is still waiting for its
+// acknowledge, it is flagged and picked up once the acknowledge arrives.
+//
+// XA-ADPCM playback takes over the drive while it is active: read-ahead stops
+// (whatever is already in the ring is kept), the drive is switched to
+// real-time reads with the XA filter on and decodes the selected channel
+// straight to the SPU. Only the (rare) data sectors interleaved in the stream
+// raise IRQs, and only their subheader is looked at to find the end of the
+// stream. Data can't be read in the meantime; readCDSectors() fails until
+// stopCDXA() is called.
+
+typedef enum {
+	CD_STATE_IDLE,       // Drive paused, nothing in flight
+	CD_STATE_SETLOC,     // Waiting for SETLOC's INT3
+	CD_STATE_READ_ACK,   // Waiting for READ_N's INT3
+	CD_STATE_READING,    // Receiving sectors (INT1)
+	CD_STATE_PAUSING,    // Waiting for PAUSE's INT3 and INT2
+	CD_STATE_XA_COMMAND, // Waiting for an XA setup command's INT3
+	CD_STATE_XA_PAUSING, // Waiting for PAUSE's INT2 before leaving XA mode
+	CD_STATE_XA_PLAYING  // Streaming XA audio, nothing in flight
+} CDState;
+
+static volatile CDState _state = CD_STATE_IDLE;
+
+// Read-ahead ring. _ringLBA is the LBA of the sector at the tail, the others
+// follow sequentially.
+static uint32_t _ring[CD_RING_SECTORS][CD_SECTOR_SIZE / 4];
+static int      _ringHead = 0, _ringTail = 0, _ringCount = 0;
+static uint32_t _ringLBA  = 0;
+
+static uint32_t _readLBA     = 0;     // LBA of the next sector the drive will send
+static bool     _dmaBusy     = false;
+static bool     _dmaDiscard  = false; // Ring was flushed while a transfer was in flight
+static bool     _restart     = false; // Reposition once the current command is done
+static bool     _aheadFailed = false; // Read-ahead gave up, only read for requests
+static int      _retries     = 0;     // Errors in a row, requests and read-ahead alike
+
+static CDReadRequest *_queue[CD_QUEUE_SIZE];
+static int           _queueHead = 0, _queueTail = 0;
+static CDReadRequest *_current  = 0;
+
+// XA playback. _xaWanted is what the user asked for, the other flags track
+// what the drive has been told so far; _updateXA() closes the gap one command
+// at a time.
+static bool     _xaWanted  = false;
+static bool     _xaLoop    = false;
+static bool     _xaModeSet = false; // Drive is in XA mode
+static bool     _xaFilter  = false; // SETFILTER needs to be (re)issued
+static bool     _xaSeek    = false; // SETLOC needs to be issued
+static bool     _xaReading = false; // READ_S has been issued
+static uint32_t _xaLBA     = 0;
+static uint8_t  _xaFile    = 0, _xaChannel = 0;
+
+#define XA_MODE   ( \
+	CDROM_MODE_SPEED_2X | CDROM_MODE_SIZE_2340 | CDROM_MODE_XA_ADPCM | \
+	CDROM_MODE_XA_FILTER \
+)
+#define DATA_MODE (CDROM_MODE_SPEED_2X | CDROM_MODE_SIZE_2048)
+
+/* Low-level command interface */
+
+static void _issueCommand(CDROMCommand cmd, const uint8_t *param, int length) {
+	while (CDROM_HSTS & CDROM_HSTS_BUSYSTS)
+		__asm__ volatile("");
+
+	CDROM_ADDRESS = 1;
+	CDROM_HCLRCTL = CDROM_HCLRCTL_CLRPRM;
+
+	CDROM_ADDRESS = 0;
+	for (; length > 0; length--)
+		CDROM_PARAMETER = *(param++);
+
+	CDROM_COMMAND = cmd;
+}
+
+static int _acknowledgeIRQ(uint8_t *response, int maxLength) {
+	CDROM_ADDRESS = 1;
+	int type      = CDROM_HINTSTS & CDROM_HINT_INT_BITMASK;
+	int length    = 0;
+
+	while (CDROM_HSTS & CDROM_HSTS_RSLRRDY) {
+		uint8_t value = CDROM_RESULT;
+
+		if (length < maxLength)
+			response[length++] = value;
+	}
+
+	CDROM_HCLRCTL = CDROM_HCLRCTL_CLRINT_BITMASK;
+	return type;
+}
+
+// Used during initialization only, before the IRQ handler is registered.
+static int _commandSync(
+	CDROMCommand cmd, const uint8_t *param, int length, uint8_t *response
+) {
+	_issueCommand(cmd, param, length);
+
+	for (int timeout = 1000000; timeout; timeout--) {
+		CDROM_ADDRESS = 1;
+
+		if (CDROM_HINTSTS & CDROM_HINT_INT_BITMASK)
+			return _acknowledgeIRQ(response, 16);
+	}
+
+	return CDROM_IRQ_NONE;
+}
+
+static void _setLoc(uint32_t lba) {
+	CDROMMSF msf;
+
+	cdrom_convertLBAToMSF(&msf, lba);
+	_readLBA = lba;
+	_state   = CD_STATE_SETLOC;
+	_issueCommand(CDROM_CMD_SETLOC, (const uint8_t *) &msf, sizeof(msf));
+}
+
+static void _pause(void) {
+	_state = CD_STATE_PAUSING;
+	_issueCommand(CDROM_CMD_PAUSE, 0, 0);
+}
+
+static void _updateXA(void);
+
+/* Ring and request management */
+
+static void _flushRing(void) {
+	if (_dmaBusy)
+		_dmaDiscard = true;
+
+	_ringHead  = 0;
+	_ringTail  = 0;
+	_ringCount = 0;
+}
+
+// LBA the driver should be reading next: right after whatever is in the ring,
+// or wherever the current request wants to go.
+static uint32_t _nextWantedLBA(void) {
+	return _ringLBA + _ringCount;
+}
+
+static void _finishRequest(CDReadStatus status) {
+	CDReadRequest *request = _current;
+
+	_current        = 0;
+	_retries        = 0;
+	request->status = status;
+
+	if (request->callback)
+		request->callback(request->arg);
+}
+
+// Moves sectors from the ring into the current request's buffer, starting the
+// next queued request whenever one completes. Returns true if the drive needs
+// to be repositioned because the ring does not contain what the request wants.
+static bool _serveRequests(void) {
+	for (;;) {
+		if (!_current) {
+			if (_queueTail == _queueHead)
+				return false;
+
+			_current   = _queue[_queueTail];
+			_queueTail = (_queueTail + 1) % CD_QUEUE_SIZE;
+		}
+
+		CDReadRequest *request = _current;
+		uint32_t      wanted   = request->lba + request->sectorsDone;
+
+		// Throw away read-ahead sectors from before the requested range. If the
+		// request starts after the ring's contents (or before them), the whole
+		// ring is useless.
+		if (_ringCount && (wanted >= _ringLBA) && (wanted < (_ringLBA + _ringCount))) {
+			int skip    = wanted - _ringLBA;
+			_ringTail   = (_ringTail + skip) % CD_RING_SECTORS;
+			_ringCount -= skip;
+			_ringLBA    = wanted;
+		} else if (wanted != _nextWantedLBA() || _ringCount) {
+			_flushRing();
+			_ringLBA = wanted;
+			return true;
+		}
+
+		while (_ringCount && (request->sectorsDone < request->count)) {
+			uint8_t *dest = (uint8_t *) request->dest
+				+ request->sectorsDone * CD_SECTOR_SIZE;
+
+			memcpy(dest, _ring[_ringTail], CD_SECTOR_SIZE);
+			_ringTail = (_ringTail + 1) % CD_RING_SECTORS;
+			_ringCount--;
+			_ringLBA++;
+			request->sectorsDone++;
+		}
+
+		if (request->sectorsDone < request->count)
+			return false;
+
+		_finishRequest(CD_READ_DONE);
+	}
+}
+
+// Decides what the drive should be doing after something changed (a sector
+// arrived, a request was queued, a command finished).
+static void _update(void) {
+	bool reposition = _serveRequests();
+
+	if (reposition)
+		_restart = true;
+
+	switch (_state) {
+		case CD_STATE_IDLE:
+			if (_xaWanted) {
+				_updateXA();
+			} else if (
+				_restart || _current ||
+				(!_aheadFailed && (_ringCount < CD_RING_SECTORS))
+			) {
+				// Resume reading (or reading ahead) from where the ring ends.
+				_restart = false;
+				_setLoc(_nextWantedLBA());
+			}
+			break;
+
+		case CD_STATE_READING:
+			if (_xaWanted) {
+				_pause();
+			} else if (_restart) {
+				// A new READ_N can be issued while reading, the drive will
+				// simply seek to the new location.
+				_restart = false;
+				_setLoc(_nextWantedLBA());
+			} else if (!_current && (_ringCount >= CD_RING_SECTORS)) {
+				_pause();
+			}
+			break;
+
+		default:
+			// Waiting for a command to be acknowledged, _restart will be
+			// handled once that happens.
+			break;
+	}
+}
+
+/* XA playback */
+
+// Issues whatever command XA playback needs next. Called whenever the drive
+// is not busy with another XA command.
+static void _updateXA(void) {
+	uint8_t param[2];
+
+	if (!_xaWanted) {
+		// Stop reading, then go back to data mode and let _update() resume
+		// serving requests.
+		if (_xaReading) {
+			_xaReading = false;
+			_state     = CD_STATE_XA_PAUSING;
+			_issueCommand(CDROM_CMD_PAUSE, 0, 0);
+		} else if (_xaModeSet) {
+			_xaModeSet = false;
+			param[0]   = DATA_MODE;
+			_state     = CD_STATE_XA_COMMAND;
+			_issueCommand(CDROM_CMD_SETMODE, param, 1);
+		} else {
+			_state = CD_STATE_IDLE;
+			_update();
+		}
+		return;
+	}
+
+	_state = CD_STATE_XA_COMMAND;
+
+	if (!_xaModeSet) {
+		_xaModeSet = true;
+		param[0]   = XA_MODE;
+		_issueCommand(CDROM_CMD_SETMODE, param, 1);
+	} else if (_xaFilter) {
+		_xaFilter = false;
+		param[0]  = _xaFile;
+		param[1]  = _xaChannel;
+		_issueCommand(CDROM_CMD_SETFILTER, param, 2);
+	} else if (_xaSeek) {
+		CDROMMSF msf;
+
+		_xaSeek    = false;
+		_xaReading = false;
+		cdrom_convertLBAToMSF(&msf, _xaLBA);
+		_issueCommand(CDROM_CMD_SETLOC, (const uint8_t *) &msf, sizeof(msf));
+	} else if (!_xaReading) {
+		_xaReading = true;
+		_issueCommand(CDROM_CMD_READ_S, 0, 0);
+	} else {
+		_state = CD_STATE_XA_PLAYING;
+	}
+}
+
+static void _receiveXASector(void) {
+	uint8_t header[12];
+
+	// Only the sector's header and subheader are needed; the rest of the data
+	// is discarded by clearing the request bit afterwards.
+	CDROM_ADDRESS = 0;
+	CDROM_HCHPCTL = 0;
+	CDROM_HCHPCTL = CDROM_HCHPCTL_BFRD;
+
+	while (!(CDROM_HSTS & CDROM_HSTS_DRQSTS))
+		__asm__ volatile("");
+
+	for (int i = 0; i < 12; i++)
+		header[i] = CDROM_RDDATA;
+
+	CDROM_HCHPCTL = 0;
+
+	const CDROMXAHeader *subheader = (const CDROMXAHeader *) &header[4];
+
+	if (
+		(subheader->file != _xaFile) ||
+		(subheader->channel != _xaChannel) ||
+		!(subheader->submode & CDROM_XA_SM_END_OF_FILE)
+	)
+		return;
+
+	if (_xaLoop)
+		_xaSeek = true;
+	else
+		_xaWanted = false;
+
+	if (_state == CD_STATE_XA_PLAYING)
+		_updateXA();
+}
+
+/* Interrupt handlers */
+
+static void _dmaHandler(void *arg) {
+	_dmaBusy = false;
+
+	if (_dmaDiscard) {
+		_dmaDiscard = false;
+	} else {
+		_ringHead = (_ringHead + 1) % CD_RING_SECTORS;
+		_ringCount++;
+		_retries = 0;
+	}
+
+	_update();
+}
+
+static void _receiveSector(void) {
+	// Drop sectors that belong to a location we are moving away from, as well
+	// as any arriving after the ring has filled up (the drive gets paused by
+	// _update() in that case and resumes from the right place later).
+	if (_restart || _dmaBusy || (_ringCount >= CD_RING_SECTORS)) {
+		_restart = true;
+		return;
+	}
+
+	_readLBA++;
+	_dmaBusy = true;
+
+	// Request the sector's data from the drive's buffer and have DMA pull it
+	// into the ring slot at the head; _dmaHandler() takes it from there.
+	CDROM_ADDRESS = 0;
+	CDROM_HCHPCTL = 0;
+	CDROM_HCHPCTL = CDROM_HCHPCTL_BFRD;
+
+	while (!(CDROM_HSTS & CDROM_HSTS_DRQSTS))
+		__asm__ volatile("");
+
+	DMA_MADR(DMA_CDROM) = (uint32_t) _ring[_ringHead];
+	DMA_BCR (DMA_CDROM) = CD_SECTOR_SIZE / 4;
+	DMA_CHCR(DMA_CDROM) = 0
+		| DMA_CHCR_READ
+		| DMA_CHCR_MODE_BURST
+		| DMA_CHCR_ENABLE
+		| DMA_CHCR_TRIGGER;
+}
+
+static void _handleCDROMIRQ(int type) {
+	switch (type) {
+		case CDROM_IRQ_DATA_READY:
+			if (_state == CD_STATE_READING)
+				_receiveSector();
+			else if (_xaReading)
+				_receiveXASector();
+			break;
+
+		case CDROM_IRQ_ACKNOWLEDGE:
+			if (_state == CD_STATE_XA_COMMAND) {
+				_updateXA();
+			} else if (_state == CD_STATE_SETLOC) {
+				if (_restart) {
+					_restart = false;
+					_setLoc(_nextWantedLBA());
+				} else {
+					_state = CD_STATE_READ_ACK;
+					_issueCommand(CDROM_CMD_READ_N, 0, 0);
+				}
+			} else if (_state == CD_STATE_READ_ACK) {
+				_state = CD_STATE_READING;
+				_update();
+			}
+			break;
+
+		case CDROM_IRQ_COMPLETE:
+			if (_state == CD_STATE_XA_PAUSING) {
+				_updateXA();
+			} else if (_state == CD_STATE_PAUSING) {
+				_state = CD_STATE_IDLE;
+
+				// Only start reading again if something actually needs it,
+				// otherwise the drive would immediately resume reading ahead.
+				if (_restart || _current || _xaWanted || (_queueTail != _queueHead))
+					_update();
+			}
+			break;
+
+		case CDROM_IRQ_DATA_END:
+		case CDROM_IRQ_ERROR:
+			// If XA playback was being set up or running, start it over from
+			// the beginning of the stream (or finish stopping it).
+			if (_xaModeSet || _xaWanted) {
+				_xaReading = false;
+				_xaFilter  = _xaWanted;
+				_xaSeek    = _xaWanted;
+				_updateXA();
+				break;
+			}
+
+			// Retry from the sector that failed, unless it failed too many
+			// times in a row or is past the end of the disc. Read-ahead counts
+			// too, as it would otherwise seek back to the same sector forever
+			// (e.g. with no disc, or when reading ahead off the end of it).
+			_state = CD_STATE_IDLE;
+
+			if ((type != CDROM_IRQ_DATA_END) && (++_retries <= CD_MAX_RETRIES)) {
+				_restart = true;
+				_update();
+				break;
+			}
+
+			_retries = 0;
+
+			if (_current)
+				_finishRequest(CD_READ_ERROR);
+
+			_flushRing();
+			_ringLBA     = _readLBA;
+			_aheadFailed = true;
+
+			// Carry on with the next request if there is one, otherwise stop
+			// until something new is requested.
+			if (_queueTail != _queueHead) {
+				_restart = true;
+				_update();
+			} else {
+				_restart = false;
+				_pause();
+			}
+			break;
+	}
+}
+
+static void _cdromIRQHandler(void *arg) {
+	uint8_t response[16];
+
+	// The drive may raise its next interrupt right after the previous one is
+	// acknowledged, which would not produce a new edge on IRQ_STAT if it
+	// happens before the dispatcher clears it. Keep going until nothing is
+	// pending to avoid missing it.
+	for (;;) {
+		CDROM_ADDRESS = 1;
+
+		if (!(CDROM_HINTSTS & CDROM_HINT_INT_BITMASK))
+			break;
+
+		_handleCDROMIRQ(_acknowledgeIRQ(response, sizeof(response)));
+	}
+}
+
+/* Public API */
+
+bool initCD(void) {
+	uint8_t response[16];
+
+	// Unmask all drive interrupts and make sure none are pending.
+	CDROM_ADDRESS   = 1;
+	CDROM_HINTMSK_W = CDROM_HINT_INT_BITMASK;
+	CDROM_HCLRCTL   = CDROM_HCLRCTL_CLRINT_BITMASK | CDROM_HCLRCTL_CLRPRM;
+
+	// Unmute CD audio output (needed for XA/CD-DA playback later on).
+	CDROM_ADDRESS = 2;
+	CDROM_ATV0    = 0x80;
+	CDROM_ATV1    = 0x00;
+	CDROM_ADDRESS = 3;
+	CDROM_ATV2    = 0x80;
+	CDROM_ATV3    = 0x00;
+	CDROM_ADPCTL  = CDROM_ADPCTL_CHNGATV;
+
+	uint8_t mode = DATA_MODE;
+
+	if (_commandSync(CDROM_CMD_SETMODE, &mode, 1, response) !=
+		CDROM_IRQ_ACKNOWLEDGE)
+		return false;
+
+	DMA_DPCR |= DMA_DPCR_CH_ENABLE(DMA_CDROM);
+
+	_state = CD_STATE_IDLE;
+	_flushRing();
+	_ringLBA = 0;
+
+	setIRQHandler(IRQ_CDROM, &_cdromIRQHandler, 0);
+	setDMAHandler(DMA_CDROM, &_dmaHandler, 0);
+	return true;
+}
+
+bool readCDSectors(CDReadRequest *request) {
+	int state = enterCriticalSection();
+	int next  = (_queueHead + 1) % CD_QUEUE_SIZE;
+
+	// While XA audio is playing the drive never gets around to data reads,
+	// so fail right away rather than leaving the caller waiting on a request
+	// that would only be served once the music is stopped.
+	if ((next == _queueTail) || _xaWanted) {
+		exitCriticalSection(state);
+		return false;
+	}
+
+	request->sectorsDone = 0;
+	request->status      = CD_READ_PENDING;
+	_aheadFailed         = false;
+
+	_queue[_queueHead] = request;
+	_queueHead         = next;
+
+	_update();
+	exitCriticalSection(state);
+	return true;
+}
+
+bool isCDIdle(void) {
+	return !_current && (_queueTail == _queueHead);
+}
+
+bool waitForCDRead(CDReadRequest *request) {
+	while (request->status == CD_READ_PENDING)
+		__asm__ volatile("");
+
+	return request->status == CD_READ_DONE;
+}
+
+void flushCDReadAhead(void) {
+	int state = enterCriticalSection();
+
+	_flushRing();
+	_ringLBA     = _readLBA;
+	_aheadFailed = false;
+
+	if (_state == CD_STATE_READING)
+		_pause();
+
+	exitCriticalSection(state);
+}
+
+bool playCDXA(uint32_t lba, int file, int channel, bool loop) {
+	int state = enterCriticalSection();
+
+	if (!isCDIdle()) {
+		exitCriticalSection(state);
+		return false;
+	}
+
+	bool restart = !_xaWanted || (lba != _xaLBA) || (file != _xaFile);
+
+	_xaLBA     = lba;
+	_xaFile    = file;
+	_xaChannel = channel;
+	_xaLoop    = loop;
+	_xaFilter  = true;
+	_xaSeek   |= restart;
+	_xaWanted  = true;
+
+	if ((_state == CD_STATE_IDLE) || (_state == CD_STATE_XA_PLAYING))
+		_updateXA();
+	else if (_state == CD_STATE_READING)
+		_update();
+
+	exitCriticalSection(state);
+	return true;
+}
+
+void setCDXAChannel(int channel) {
+	int state = enterCriticalSection();
+
+	_xaChannel = channel;
+	_xaFilter  = true;
+
+	if (_state == CD_STATE_XA_PLAYING)
+		_updateXA();
+
+	exitCriticalSection(state);
+}
+
+void stopCDXA(void) {
+	int state = enterCriticalSection();
+
+	_xaWanted = false;
+
+	if (_state == CD_STATE_XA_PLAYING)
+		_updateXA();
+
+	exitCriticalSection(state);
+}
+
+bool isCDXAPlaying(void) {
+	return _xaWanted;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../ps1/system.h"
+
+// The drive reads ahead into a ring of CD_RING_SECTORS sectors whenever it is
+// not serving a request, pausing once the ring is full. Sequential reads that
+// hit sectors already in the ring complete without waiting for the disc.
+#define CD_SECTOR_SIZE   2048
+#define CD_RING_SECTORS     8
+#define CD_QUEUE_SIZE       4
+#define CD_MAX_RETRIES      3
+
+typedef enum {
+	CD_READ_PENDING = 0,
+	CD_READ_DONE    = 1,
+	CD_READ_ERROR   = 2
+} CDReadStatus;
+
+typedef struct {
+	uint32_t    lba;
+	int         count;
+	void        *dest;     // Must be 4-byte aligned, count * CD_SECTOR_SIZE bytes
+	ArgFunction callback;  // Optional, invoked from the IRQ handler when done
+	void        *arg;
+
+	volatile int          sectorsDone;
+	volatile CDReadStatus status;
+} CDReadRequest;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initializes the CD-ROM drive (double speed, 2048-byte sectors) and
+ * registers the driver's CD-ROM and DMA interrupt handlers. Requires
+ * installExceptionHandler() to have been called beforehand.
+ *
+ * @return false if the drive did not respond
+ */
+bool initCD(void);
+
+/**
+ * @brief Queues an asynchronous read of request->count sectors starting at
+ * request->lba. The request (and its destination buffer) must remain valid
+ * until its status changes from CD_READ_PENDING. sectorsDone is updated as
+ * each sector is copied into the destination, so data can be consumed (e.g.
+ * decompressed) while the rest is still being read.
+ *
+ * @param request
+ * @return false if the queue is full or XA audio is playing
+ */
+bool readCDSectors(CDReadRequest *request);
+
+/**
+ * @brief Returns true if no read requests are queued or in progress. The
+ * drive may still be reading ahead in the background.
+ */
+bool isCDIdle(void);
+
+/**
+ * @brief Blocks until the given request has completed or failed.
+ *
+ * @param request
+ * @return true if the request was successful
+ */
+bool waitForCDRead(CDReadRequest *request);
+
+/**
+ * @brief Discards all read-ahead data and pauses the drive, e.g. before
+ * streaming XA audio or after the disc has been swapped.
+ */
+void flushCDReadAhead(void);
+
+/**
+ * @brief Starts streaming an interleaved XA-ADPCM file (as generated by
+ * tools/buildXA.py) and returns immediately. The drive decodes the selected
+ * channel and feeds it to the SPU's CD audio input, which must be enabled with
+ * setSPUCDVolume(). If the same file is already playing, only the channel and
+ * loop flag are changed. Data can't be read while XA playback is active;
+ * readCDSectors() fails until stopCDXA() is called.
+ *
+ * @param lba First sector of the file
+ * @param file File number stored in the file's subheaders
+ * @param channel
+ * @param loop Seek back to the beginning once the channel's end marker is
+ * reached, rather than stopping
+ * @return false if there are data reads in progress
+ */
+bool playCDXA(uint32_t lba, int file, int channel, bool loop);
+
+/**
+ * @brief Switches to another channel of the XA file currently playing without
+ * interrupting the stream, e.g. to change music depending on the situation.
+ */
+void setCDXAChannel(int channel);
+void stopCDXA(void);
+bool isCDXAPlaying(void);
+
+#ifdef __cplusplus
+}
+#endif
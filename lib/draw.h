@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include "gpu.h"
+#include "texcache.h"
 #include "trig.h"
 #include "../ps1/cop0.h"
 #include "../ps1/gpucmd.h"
@@ -81,6 +82,7 @@ typedef struct {
 	const GTEVector16 *vertices;
 	bool isTextured;
 	const TextureInfo *textinfo;
+	uint16_t textureId; //texcache.h id, overrides textinfo when set
 	const TextCoord *textCoords;
 } DrawObj;
 
@@ -477,6 +479,14 @@ static void DrawObject(
 	//set the matrix, initial
 	//SetGtePosAndRot( obj->x, obj->y, obj->z, obj->yaw, obj->pitch, obj->roll);
 	SetGteViewAndModel(camera, obj);
+	//cached textures get looked up (and uploaded if they got evicted) once per object
+	bool textured = obj->isTextured;
+	const TextureInfo *textinfo = obj->textinfo;
+	if (textured && obj->textureId != TEXCACHE_NONE)
+	{
+		textinfo = TexCacheUse(obj->textureId);
+		if (!textinfo){textured = false;} //no room, flat shade it rather than draw garbage
+	}
 	// Draw the obj one face at a time.
 	for (int i = 0; i < obj->numFaces; i++) 
 	{
@@ -486,7 +496,7 @@ static void DrawObject(
 			&(obj->vertices)[face->vertices[1]],
 			&(obj->vertices)[face->vertices[2]], 
 			chain, face, 
-			obj->isTextured, obj->textinfo, obj->textCoords
+			textured, textinfo, obj->textCoords
 		);
 		if(ENABLE_Z_CLIP && res==ADD_TRI_CLIP) //handle clipping of near plane
 		{
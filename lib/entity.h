@@ -0,0 +1,241 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "draw.h"
+#include "pool.h"
+#include "trig.h"
+
+#pragma once
+
+// Entity arena, everything placed in the level that gets drawn with DrawObject.
+// - stored as parallel arrays (struct of arrays) instead of an array of DrawObjs, so a loop
+//   that only moves things only pulls x/y/z through the cache, not meshes and textures
+// - kept dense like pool.h (entities 0..count-1 are alive, releasing moves the last one into
+//   the hole) and handed out as PoolHandles, index arrays with EntityIndex(handle) each frame
+//   rather than holding on to an index
+// - EntityBuildDrawList culls against the camera and sorts what's left by material (texture
+//   page/clut, or texcache id) so objects sharing a texture get drawn back to back
+// usage:
+//   PoolHandle h = EntitySpawn(&mesh, x, y, z);
+//   int i = EntityIndex(h); entities.x[i] += 4;
+//   EntityBuildDrawList(&camera); EntityDrawList(chain, &camera);
+#define ENTITY_CAPACITY      128 //has to fit in a uint16_t, like pool.h
+#define ENTITY_DRAW_DISTANCE 4096
+
+typedef enum {
+	ENTITY_VISIBLE  = 1 << 0, //cleared = skipped by the draw list, still updated
+	ENTITY_NO_CULL  = 1 << 1, //always drawn if visible (huge things, skyboxes)
+	ENTITY_TEXTURED = 1 << 2
+} EntityFlag;
+
+// model data, shared by every entity using the same model
+typedef struct {
+	uint16_t          numFaces;
+	const Face        *faces;
+	uint16_t          numVerts;
+	const GTEVector16 *vertices;
+	const TextCoord   *textCoords;
+	int32_t           radius; //bounding sphere around the model's origin
+} EntityMesh;
+
+typedef struct {
+	// transforms
+	int16_t x[ENTITY_CAPACITY], y[ENTITY_CAPACITY], z[ENTITY_CAPACITY];
+	int16_t yaw[ENTITY_CAPACITY], pitch[ENTITY_CAPACITY], roll[ENTITY_CAPACITY];
+	// rendering
+	const EntityMesh  *mesh[ENTITY_CAPACITY];
+	const TextureInfo *textinfo[ENTITY_CAPACITY];
+	uint16_t          textureId[ENTITY_CAPACITY]; //texcache.h id, overrides textinfo when set
+	int32_t           radius[ENTITY_CAPACITY];    //copied from the mesh on spawn
+	uint8_t           flags[ENTITY_CAPACITY];
+	// handles, same scheme as pool.h
+	uint16_t denseToSlot[ENTITY_CAPACITY], slotToDense[ENTITY_CAPACITY];
+	uint16_t generation[ENTITY_CAPACITY], freeSlots[ENTITY_CAPACITY];
+	uint16_t count, numFree;
+	// draw list, rebuilt every frame by EntityBuildDrawList
+	uint32_t drawKeys[ENTITY_CAPACITY];
+	uint16_t drawList[ENTITY_CAPACITY];
+	uint16_t drawCount, culled;
+} EntityArena;
+
+static EntityArena entities;
+
+/// @brief work out a mesh's bounds once, when it's set up
+static void EntityMeshInit(
+	EntityMesh *mesh,
+	uint16_t numFaces, const Face *faces,
+	uint16_t numVerts, const GTEVector16 *vertices,
+	const TextCoord *textCoords
+)
+{
+	mesh->numFaces = numFaces;
+	mesh->faces = faces;
+	mesh->numVerts = numVerts;
+	mesh->vertices = vertices;
+	mesh->textCoords = textCoords;
+	//|x|+|y|+|z| is never less than the real distance, so it's a safe (if loose) radius with no sqrt
+	mesh->radius = 0;
+	for (int i = 0; i < numVerts; i++)
+	{
+		const GTEVector16 *v = &vertices[i];
+		int32_t r = (v->x < 0 ? -v->x : v->x) + (v->y < 0 ? -v->y : v->y) + (v->z < 0 ? -v->z : v->z);
+		if (r > mesh->radius){mesh->radius = r;}
+	}
+}
+
+static void EntityArenaInit(void)
+{
+	entities.count = 0;
+	entities.numFree = ENTITY_CAPACITY;
+	entities.drawCount = 0;
+	for (int i = 0; i < ENTITY_CAPACITY; i++)
+	{
+		entities.freeSlots[i] = (uint16_t) (ENTITY_CAPACITY - 1 - i); //hand out slot 0 first
+		entities.generation[i] = 1;
+	}
+}
+
+/// @return the entity's current index into the arrays, -1 if it's been released
+static int EntityIndex(PoolHandle handle)
+{
+	uint16_t slot = POOL_HANDLE_SLOT(handle);
+	if (slot >= ENTITY_CAPACITY || entities.generation[slot] != POOL_HANDLE_GENERATION(handle)){return -1;}
+	uint16_t dense = entities.slotToDense[slot];
+	if (dense >= entities.count || entities.denseToSlot[dense] != slot){return -1;}
+	return dense;
+}
+
+/// @brief add a visible, untextured entity
+/// @return its handle, POOL_INVALID_HANDLE if the arena is full
+static PoolHandle EntitySpawn(const EntityMesh *mesh, int16_t x, int16_t y, int16_t z)
+{
+	if (!entities.numFree){puts("entity: arena full"); return POOL_INVALID_HANDLE;}
+	uint16_t slot = entities.freeSlots[--entities.numFree];
+	uint16_t i = entities.count++;
+	entities.denseToSlot[i] = slot;
+	entities.slotToDense[slot] = i;
+
+	entities.x[i] = x;
+	entities.y[i] = y;
+	entities.z[i] = z;
+	entities.yaw[i] = 0;
+	entities.pitch[i] = 0;
+	entities.roll[i] = 0;
+	entities.mesh[i] = mesh;
+	entities.textinfo[i] = NULL;
+	entities.textureId[i] = TEXCACHE_NONE;
+	entities.radius[i] = mesh->radius;
+	entities.flags[i] = ENTITY_VISIBLE;
+	return POOL_HANDLE(slot, entities.generation[slot]);
+}
+
+/// @brief texture an entity, either resident (textinfo) or cached (textureId, see texcache.h)
+static void EntitySetTexture(PoolHandle handle, const TextureInfo *textinfo, uint16_t textureId)
+{
+	int i = EntityIndex(handle);
+	if (i < 0){return;}
+	entities.textinfo[i] = textinfo;
+	entities.textureId[i] = textureId;
+	entities.flags[i] |= ENTITY_TEXTURED;
+}
+
+/// @brief remove an entity, the last one moves into its place (so indices change, handles don't)
+static void EntityRelease(PoolHandle handle)
+{
+	int i = EntityIndex(handle);
+	if (i < 0){return;}
+	uint16_t slot = entities.denseToSlot[i];
+	uint16_t last = --entities.count;
+	if (i != last)
+	{
+		entities.x[i] = entities.x[last];
+		entities.y[i] = entities.y[last];
+		entities.z[i] = entities.z[last];
+		entities.yaw[i] = entities.yaw[last];
+		entities.pitch[i] = entities.pitch[last];
+		entities.roll[i] = entities.roll[last];
+		entities.mesh[i] = entities.mesh[last];
+		entities.textinfo[i] = entities.textinfo[last];
+		entities.textureId[i] = entities.textureId[last];
+		entities.radius[i] = entities.radius[last];
+		entities.flags[i] = entities.flags[last];
+		entities.denseToSlot[i] = entities.denseToSlot[last];
+		entities.slotToDense[entities.denseToSlot[i]] = i;
+	}
+	//bump the generation so old handles stop resolving, skipping 0 so a handle is never 0
+	if (++entities.generation[slot] == 0){entities.generation[slot] = 1;}
+	entities.freeSlots[entities.numFree++] = slot;
+}
+
+/// @brief sort key, entities with the same texture end up next to each other (untextured first)
+static uint32_t EntityMaterialKey(int i)
+{
+	if (!(entities.flags[i] & ENTITY_TEXTURED)){return 0;}
+	if (entities.textureId[i] != TEXCACHE_NONE){return 0x80000000 | entities.textureId[i];}
+	const TextureInfo *info = entities.textinfo[i];
+	return info ? (((uint32_t) info->page << 16) | info->clut) & 0x7fffffff : 0;
+}
+
+/// @brief collect visible entities in front of the camera and sort them by material
+static void EntityBuildDrawList(const Camera *camera)
+{
+	//camera forward on the ground plane (same angle convention as the atan2 in main.c)
+	int32_t forwardX = isin(camera->yaw), forwardZ = icos(camera->yaw);
+	entities.drawCount = 0;
+	entities.culled = 0;
+	for (int i = 0; i < entities.count; i++)
+	{
+		uint8_t flags = entities.flags[i];
+		if (!(flags & ENTITY_VISIBLE)){continue;}
+		if (!(flags & ENTITY_NO_CULL))
+		{
+			int32_t dx = entities.x[i] - camera->x, dz = entities.z[i] - camera->z;
+			int32_t along = (dx * forwardX + dz * forwardZ) >> 12;
+			int32_t side  = (dx * forwardZ - dz * forwardX) >> 12;
+			int32_t r = entities.radius[i];
+			if (side < 0){side = -side;}
+			//behind the camera, too far, or outside the left/right edges of the screen. the gte
+			//projects with h = 120 and 160 pixels either side, so the edge planes have a 4:3
+			//slope and (3 * side - 4 * along) / 5 is the distance past them. pitch is ignored,
+			//nothing gets culled vertically
+			if (along < -r || along - r > ENTITY_DRAW_DISTANCE || 3 * side - 4 * along > 5 * r)
+			{
+				entities.culled++;
+				continue;
+			}
+		}
+
+		//insertion sort as we go, the list is short and mostly in order from frame to frame
+		uint32_t key = EntityMaterialKey(i);
+		int j = entities.drawCount++;
+		while (j > 0 && entities.drawKeys[j - 1] > key)
+		{
+			entities.drawKeys[j] = entities.drawKeys[j - 1];
+			entities.drawList[j] = entities.drawList[j - 1];
+			j--;
+		}
+		entities.drawKeys[j] = key;
+		entities.drawList[j] = i;
+	}
+}
+
+/// @brief draw everything EntityBuildDrawList picked, in order
+static void EntityDrawList(DMAChain *chain, const Camera *camera)
+{
+	for (int n = 0; n < entities.drawCount; n++)
+	{
+		int i = entities.drawList[n];
+		const EntityMesh *mesh = entities.mesh[i];
+		DrawObj obj = CreateDrawObj(
+			entities.x[i], entities.y[i], entities.z[i],
+			entities.yaw[i], entities.pitch[i], entities.roll[i],
+			mesh->numFaces, mesh->faces,
+			mesh->numVerts, mesh->vertices
+		);
+		obj.isTextured = entities.flags[i] & ENTITY_TEXTURED;
+		obj.textinfo = entities.textinfo[i];
+		obj.textureId = entities.textureId[i];
+		obj.textCoords = mesh->textCoords;
+		DrawObject(chain, &obj, camera);
+	}
+}
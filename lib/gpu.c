@@ -20,6 +20,170 @@
 #include "gpu.h"
 #include "../ps1/gpucmd.h"
 #include "../ps1/registers.h"
+#include "../ps1/system.h"
+
+/* Transfer queue */
+
+// All transfers on the GPU DMA channel (VRAM uploads and display lists) go
+// through a queue, advanced by the channel's completion IRQ. This lets VRAM
+// uploads run in the background while the CPU keeps working, and keeps them
+// from ever overlapping with a display list or with each other. Each queued
+// job gets a fence number, assigned in increasing order; a fence is "done"
+// once its job (and every job queued before it) has been transferred.
+
+typedef enum {
+	GPU_JOB_VRAM_WRITE = 0,
+	GPU_JOB_LIST       = 1
+} GPUJobType;
+
+typedef struct {
+	const void *data;
+	uint32_t   fence;
+	uint8_t    type;
+	int16_t    x, y, width, height;
+} GPUJob;
+
+static GPUJob _queue[GPU_QUEUE_SIZE];
+static volatile int _queueHead = 0, _queueTail = 0;
+
+static volatile bool     _busy       = false;
+static volatile uint32_t _lastFence  = 0; // Fence of the last job queued
+static volatile uint32_t _doneFence  = 0; // Fence of the last job completed
+static uint32_t          _jobFence   = 0; // Fence of the job in progress
+static const uint32_t    *_tailData  = 0;
+static size_t            _tailLength = 0;
+static bool              _needFlush  = false;
+
+static void _startTransfer(const void *data, size_t chunkSize, size_t numChunks) {
+	DMA_MADR(DMA_GPU) = (uint32_t) data;
+	DMA_BCR (DMA_GPU) = chunkSize | (numChunks << 16);
+	DMA_CHCR(DMA_GPU) = 0
+		| DMA_CHCR_WRITE
+		| DMA_CHCR_MODE_SLICE
+		| DMA_CHCR_ENABLE;
+}
+
+// Must be called with interrupts disabled, with the channel idle.
+static void _startNextJob(void) {
+	// A VRAM write whose length is not a multiple of the chunk size is split
+	// into two transfers; the GPU does not care, as it simply keeps consuming
+	// words until it has received as many as the write command asked for.
+	if (_tailLength) {
+		_startTransfer(_tailData, _tailLength, 1);
+		_tailLength = 0;
+		return;
+	}
+	if (_busy)
+		_doneFence = _jobFence;
+
+	if (_queueTail == _queueHead) {
+		_busy = false;
+		return;
+	}
+
+	GPUJob *job = &_queue[_queueTail];
+	_queueTail  = (_queueTail + 1) % GPU_QUEUE_SIZE;
+	_jobFence   = job->fence;
+	_busy       = true;
+
+	// The GPU's texture cache is not updated by VRAM writes, so it must be
+	// flushed before anything gets drawn after an upload.
+	waitForGP0Ready();
+
+	if (_needFlush) {
+		GPU_GP0    = gp0_flushCache();
+		_needFlush = false;
+	}
+
+	if (job->type == GPU_JOB_LIST) {
+		DMA_MADR(DMA_GPU) = (uint32_t) job->data;
+		DMA_CHCR(DMA_GPU) = 0
+			| DMA_CHCR_WRITE
+			| DMA_CHCR_MODE_LIST
+			| DMA_CHCR_ENABLE;
+		return;
+	}
+
+	size_t length    = (job->width * job->height + 1) / 2;
+	size_t numChunks = length / DMA_MAX_CHUNK_SIZE;
+
+	_tailData   = (const uint32_t *) job->data + numChunks * DMA_MAX_CHUNK_SIZE;
+	_tailLength = length % DMA_MAX_CHUNK_SIZE;
+	_needFlush  = true;
+
+	GPU_GP0 = gp0_vramWrite();
+	GPU_GP0 = gp0_xy(job->x, job->y);
+	GPU_GP0 = gp0_xy(job->width, job->height);
+
+	if (numChunks) {
+		_startTransfer(job->data, DMA_MAX_CHUNK_SIZE, numChunks);
+	} else {
+		_startTransfer(_tailData, _tailLength, 1);
+		_tailLength = 0;
+	}
+}
+
+static void _gpuDMAHandler(void *arg) {
+	// The queue may have already been advanced by _pollQueue().
+	if (!(DMA_CHCR(DMA_GPU) & DMA_CHCR_ENABLE))
+		_startNextJob();
+}
+
+// Advances the queue without relying on the IRQ, in case the caller is
+// waiting with interrupts disabled.
+static void _pollQueue(void) {
+	int state = enterCriticalSection();
+
+	if (_busy && !(DMA_CHCR(DMA_GPU) & DMA_CHCR_ENABLE))
+		_startNextJob();
+
+	exitCriticalSection(state);
+}
+
+static uint32_t _queueJob(
+	GPUJobType type,
+	const void *data,
+	int        x,
+	int        y,
+	int        width,
+	int        height
+) {
+	assert(!((uint32_t) data % 4));
+
+	// Wait for a free slot if the queue is full.
+	while (((_queueHead + 1) % GPU_QUEUE_SIZE) == _queueTail)
+		_pollQueue();
+
+	int    state = enterCriticalSection();
+	GPUJob *job  = &_queue[_queueHead];
+
+	job->data   = data;
+	job->fence  = ++_lastFence;
+	job->type   = type;
+	job->x      = x;
+	job->y      = y;
+	job->width  = width;
+	job->height = height;
+	_queueHead  = (_queueHead + 1) % GPU_QUEUE_SIZE;
+
+	if (!_busy)
+		_startNextJob();
+
+	uint32_t fence = job->fence;
+	exitCriticalSection(state);
+	return fence;
+}
+
+bool isGPUFenceDone(uint32_t fence) {
+	return ((int32_t) (_doneFence - fence)) >= 0;
+}
+
+void waitForGPUFence(uint32_t fence) {
+	while (!isGPUFenceDone(fence))
+		_pollQueue();
+}
+
+/* Basic API */
 
 void setupGPU(GP1VideoMode mode, int width, int height) {
 	int x = 0x760;
@@ -41,6 +205,8 @@ void setupGPU(GP1VideoMode mode, int width, int height) {
 		false,
 		GP1_COLOR_16BPP
 	);
+
+	setDMAHandler(DMA_GPU, &_gpuDMAHandler, 0);
 }
 
 void waitForGP0Ready(void) {
@@ -49,8 +215,8 @@ void waitForGP0Ready(void) {
 }
 
 void waitForDMADone(void) {
-	while (DMA_CHCR(DMA_GPU) & DMA_CHCR_ENABLE)
-		__asm__ volatile("");
+	while (_busy)
+		_pollQueue();
 }
 
 void waitForVSync(void) {
@@ -61,14 +227,21 @@ void waitForVSync(void) {
 }
 
 void sendLinkedList(const void *data) {
+	// The chain being sent must not be rebuilt until the GPU is done with it,
+	// and main.c relies on the previous frame's list having been fully sent
+	// once this returns (see dmaChains[] in main.c).
 	waitForDMADone();
-	assert(!((uint32_t) data % 4));
+	_queueJob(GPU_JOB_LIST, data, 0, 0, 0, 0);
+}
 
-	DMA_MADR(DMA_GPU) = (uint32_t) data;
-	DMA_CHCR(DMA_GPU) = 0
-		| DMA_CHCR_WRITE
-		| DMA_CHCR_MODE_LIST
-		| DMA_CHCR_ENABLE;
+uint32_t queueVRAMData(
+	const void *data,
+	int        x,
+	int        y,
+	int        width,
+	int        height
+) {
+	return _queueJob(GPU_JOB_VRAM_WRITE, data, x, y, width, height);
 }
 
 void sendVRAMData(
@@ -78,33 +251,7 @@ void sendVRAMData(
 	int        width,
 	int        height
 ) {
-	waitForDMADone();
-	assert(!((uint32_t) data % 4));
-
-	size_t length = (width * height + 1) / 2;
-	size_t chunkSize, numChunks;
-
-	if (length < DMA_MAX_CHUNK_SIZE) {
-		chunkSize = length;
-		numChunks = 1;
-	} else {
-		chunkSize = DMA_MAX_CHUNK_SIZE;
-		numChunks = length / DMA_MAX_CHUNK_SIZE;
-
-		assert(!(length % DMA_MAX_CHUNK_SIZE));
-	}
-
-	waitForGP0Ready();
-	GPU_GP0 = gp0_vramWrite();
-	GPU_GP0 = gp0_xy(x, y);
-	GPU_GP0 = gp0_xy(width, height);
-
-	DMA_MADR(DMA_GPU) = (uint32_t) data;
-	DMA_BCR (DMA_GPU) = chunkSize | (numChunks << 16);
-	DMA_CHCR(DMA_GPU) = 0
-		| DMA_CHCR_WRITE
-		| DMA_CHCR_MODE_SLICE
-		| DMA_CHCR_ENABLE;
+	_queueJob(GPU_JOB_VRAM_WRITE, data, x, y, width, height);
 }
 
 void clearOrderingTable(uint32_t *table, int numEntries) {
@@ -142,7 +289,7 @@ uint32_t *allocatePacket(DMAChain *chain, int zIndex, int numCommands, bool fina
     return &ptr[1];
 }
 
-void uploadTexture(
+uint32_t queueTexture(
 	TextureInfo *info,
 	const void  *data,
 	int         x,
@@ -152,10 +299,6 @@ void uploadTexture(
 ) {
 	assert((width <= 256) && (height <= 256));
 
-	sendVRAMData(data, x, y, width, height);
-	waitForDMADone();
-	GPU_GP0 = gp0_flushCache();
-
 	info->page   = gp0_page(
 		x /  64,
 		y / 256,
@@ -167,9 +310,11 @@ void uploadTexture(
 	info->v      = (uint8_t)  (y % 256);
 	info->width  = (uint16_t) width;
 	info->height = (uint16_t) height;
+
+	return queueVRAMData(data, x, y, width, height);
 }
 
-void uploadIndexedTexture(
+uint32_t queueIndexedTexture(
 	TextureInfo   *info,
 	const void    *image,
 	const void    *palette,
@@ -188,12 +333,6 @@ void uploadIndexedTexture(
 
 	assert(!(paletteX % 16) && ((paletteX + numColors) <= 1024));
 
-	sendVRAMData(image, imageX, imageY, width / widthDivider, height);
-	waitForDMADone();
-	sendVRAMData(palette, paletteX, paletteY, numColors, 1);
-	waitForDMADone();
-	GPU_GP0 = gp0_flushCache();
-
 	info->page   = gp0_page(
 		imageX /  64,
 		imageY / 256,
@@ -205,4 +344,44 @@ void uploadIndexedTexture(
 	info->v      = (uint8_t)   (imageY % 256);
 	info->width  = (uint16_t) width;
 	info->height = (uint16_t) height;
+
+	queueVRAMData(image, imageX, imageY, width / widthDivider, height);
+	return queueVRAMData(palette, paletteX, paletteY, numColors, 1);
+}
+
+void uploadTexture(
+	TextureInfo *info,
+	const void  *data,
+	int         x,
+	int         y,
+	int         width,
+	int         height
+) {
+	waitForGPUFence(queueTexture(info, data, x, y, width, height));
+}
+
+void uploadIndexedTexture(
+	TextureInfo   *info,
+	const void    *image,
+	const void    *palette,
+	int           imageX,
+	int           imageY,
+	int           paletteX,
+	int           paletteY,
+	int           width,
+	int           height,
+	GP0ColorDepth colorDepth
+) {
+	waitForGPUFence(queueIndexedTexture(
+		info,
+		image,
+		palette,
+		imageX,
+		imageY,
+		paletteX,
+		paletteY,
+		width,
+		height,
+		colorDepth
+	));
 }
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include "../ps1/gpucmd.h"
 
@@ -24,6 +25,7 @@
 // setupGTE() for more details. Higher values will take up more memory but are
 // required to render more complex scenes with wide depth ranges correctly.
 #define DMA_MAX_CHUNK_SIZE    16
+#define GPU_QUEUE_SIZE        32
 #define CHAIN_BUFFER_SIZE   16384 //large,should be about 3276 tris
 //#define ORDERING_TABLE_SIZE  240
 //#define ORDERING_TABLE_SIZE  480
@@ -46,12 +48,42 @@ typedef struct {
 extern "C" {
 #endif
 
+/**
+ * @brief Resets the GPU and registers the DMA completion handler that drives
+ * the transfer queue. Requires installExceptionHandler() to have been called
+ * beforehand.
+ */
 void setupGPU(GP1VideoMode mode, int width, int height);
 void waitForGP0Ready(void);
+
+/**
+ * @brief Waits until every queued transfer (VRAM uploads and display lists)
+ * has been sent to the GPU.
+ */
 void waitForDMADone(void);
 void waitForVSync(void);
 
+/**
+ * @brief Waits for all queued transfers to finish (so the previously sent
+ * list is no longer in use), then queues the given display list.
+ */
 void sendLinkedList(const void *data);
+
+/**
+ * @brief Queues an upload of width x height 16bpp pixels to VRAM and returns
+ * immediately. Any size is accepted; transfers that are not a multiple of
+ * DMA_MAX_CHUNK_SIZE words are finished off with a second, smaller transfer.
+ * The data must stay valid until the returned fence is done.
+ *
+ * @return A fence to pass to isGPUFenceDone() or waitForGPUFence()
+ */
+uint32_t queueVRAMData(
+	const void *data,
+	int        x,
+	int        y,
+	int        width,
+	int        height
+);
 void sendVRAMData(
 	const void *data,
 	int        x,
@@ -59,9 +91,44 @@ void sendVRAMData(
 	int        width,
 	int        height
 );
+
+/**
+ * @brief Returns true once the transfer the fence was returned for, as well as
+ * all transfers queued before it, have been completed. Drawing commands sent
+ * afterwards will see the uploaded data.
+ */
+bool isGPUFenceDone(uint32_t fence);
+void waitForGPUFence(uint32_t fence);
 void clearOrderingTable(uint32_t *table, int numEntries);
 uint32_t *allocatePacket(DMAChain *chain, int zIndex, int numCommands, bool final);
 
+/**
+ * @brief Same as uploadTexture() and uploadIndexedTexture() respectively, but
+ * only queue the upload(s) instead of waiting for them. The TextureInfo is
+ * filled in right away; the returned fence tells when the image and palette
+ * data can be freed or reused.
+ */
+uint32_t queueTexture(
+	TextureInfo *info,
+	const void  *data,
+	int         x,
+	int         y,
+	int         width,
+	int         height
+);
+uint32_t queueIndexedTexture(
+	TextureInfo   *info,
+	const void    *image,
+	const void    *palette,
+	int           imageX,
+	int           imageY,
+	int           paletteX,
+	int           paletteY,
+	int           width,
+	int           height,
+	GP0ColorDepth colorDepth
+);
+
 void uploadTexture(
 	TextureInfo *info,
 	const void  *data,
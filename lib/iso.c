@@ -0,0 +1,297 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "cd.h"
+#include "iso.h"
+
+#define FNV_OFFSET 0x811c9dc5
+#define FNV_PRIME  0x01000193
+
+#define PVD_LBA              16
+#define PVD_PATH_TABLE_SIZE 132
+#define PVD_PATH_TABLE_LBA  140 // Little endian ("type L") path table
+
+#define MAX_DIRECTORIES 64
+#define MAX_PATH_LENGTH 128
+
+// Directory record field offsets
+#define DR_LENGTH       0
+#define DR_LBA          2
+#define DR_SIZE        10
+#define DR_FLAGS       25
+#define DR_NAME_LENGTH 32
+#define DR_NAME        33
+
+#define DR_FLAG_DIRECTORY (1 << 1)
+
+typedef struct {
+	uint32_t lba;
+	uint16_t parent;     // 1-based index into the path table
+	uint16_t pathLength; // Length of the full path, including trailing slash
+	char     path[MAX_PATH_LENGTH];
+} Directory;
+
+static ISOIndexEntry _entries[ISO_INDEX_CAPACITY];
+static const ISOIndexEntry *_index = 0;
+
+static uint32_t _sector[CD_SECTOR_SIZE / 4];
+
+/* Hashing */
+
+static uint32_t _hashBytes(uint32_t hash, const char *str, int length) {
+	for (; length > 0; length--, str++) {
+		char ch = *str;
+
+		// Versions (";1") are not part of the key.
+		if (ch == ';')
+			break;
+		if ((ch >= 'a') && (ch <= 'z'))
+			ch -= 'a' - 'A';
+		if (ch == '\\')
+			ch = '/';
+
+		hash = (hash ^ (uint8_t) ch) * FNV_PRIME;
+	}
+
+	return hash;
+}
+
+uint32_t hashISOPath(const char *path) {
+	int length = 0;
+
+	while ((*path == '/') || (*path == '\\'))
+		path++;
+	while (path[length])
+		length++;
+
+	uint32_t hash = _hashBytes(FNV_OFFSET, path, length);
+
+	// 0 marks unused slots.
+	return hash ? hash : 1;
+}
+
+/* Index management */
+
+static bool _insert(uint32_t hash, uint32_t lba, uint32_t size) {
+	for (int i = 0; i < ISO_INDEX_CAPACITY; i++) {
+		ISOIndexEntry *entry =
+			&_entries[(hash + i) & (ISO_INDEX_CAPACITY - 1)];
+
+		// Same as tools/buildIsoIndex.py, a collision fails the whole index
+		// rather than leaving one of the two files impossible to find.
+		if (entry->hash == hash) {
+			printf("iso: hash collision (%08x), rename one of the files\n", hash);
+			return false;
+		}
+		if (!entry->hash) {
+			entry->hash = hash;
+			entry->lba  = lba;
+			entry->size = size;
+			return true;
+		}
+	}
+
+	printf("iso: more than %d files, index full\n", ISO_INDEX_CAPACITY);
+	return false;
+}
+
+const ISOIndexEntry *findISOFileByHash(uint32_t hash) {
+	if (!_index)
+		return 0;
+
+	for (int i = 0; i < ISO_INDEX_CAPACITY; i++) {
+		const ISOIndexEntry *entry =
+			&_index[(hash + i) & (ISO_INDEX_CAPACITY - 1)];
+
+		if (entry->hash == hash)
+			return entry;
+		if (!entry->hash)
+			return 0;
+	}
+
+	return 0;
+}
+
+const ISOIndexEntry *findISOFile(const char *path) {
+	return findISOFileByHash(hashISOPath(path));
+}
+
+bool useISOIndex(const void *data) {
+	const ISOIndexHeader *header = (const ISOIndexHeader *) data;
+
+	if (
+		(header->magic != ISO_INDEX_MAGIC) ||
+		(header->capacity != ISO_INDEX_CAPACITY)
+	)
+		return false;
+
+	_index = header->entries;
+	return true;
+}
+
+/* Disc parsing */
+
+static bool _readSector(uint32_t lba) {
+	CDReadRequest request = {
+		.lba      = lba,
+		.count    = 1,
+		.dest     = _sector,
+		.callback = 0
+	};
+
+	if (!readCDSectors(&request))
+		return false;
+
+	return waitForCDRead(&request);
+}
+
+static uint16_t _read16(const uint8_t *ptr) {
+	return ptr[0] | (ptr[1] << 8);
+}
+
+static uint32_t _read32(const uint8_t *ptr) {
+	return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | (ptr[3] << 24);
+}
+
+static bool _indexDirectory(const Directory *dir) {
+	// The directory's size is only stored in its own "." record, so the first
+	// sector has to be read before knowing how many more follow.
+	if (!_readSector(dir->lba))
+		return false;
+
+	const uint8_t *data = (const uint8_t *) _sector;
+	uint32_t numSectors =
+		(_read32(&data[DR_SIZE]) + CD_SECTOR_SIZE - 1) / CD_SECTOR_SIZE;
+
+	// The path hash is computed incrementally; the directory's part is shared
+	// by all of its files.
+	uint32_t dirHash = _hashBytes(FNV_OFFSET, dir->path, dir->pathLength);
+
+	for (uint32_t i = 0; i < numSectors; i++) {
+		if (i && !_readSector(dir->lba + i))
+			return false;
+
+		// Records never cross sector boundaries; a zero length byte means
+		// the rest of the sector is padding.
+		for (int offset = 0; offset < CD_SECTOR_SIZE;) {
+			const uint8_t *record = &data[offset];
+			int           length  = record[DR_LENGTH];
+
+			if (!length)
+				break;
+
+			offset += length;
+
+			// Skip "." and ".." (single byte names 0x00 and 0x01) as well as
+			// subdirectories, which come from the path table instead.
+			if (
+				(record[DR_FLAGS] & DR_FLAG_DIRECTORY) ||
+				(record[DR_NAME_LENGTH] == 1 && record[DR_NAME] <= 1)
+			)
+				continue;
+
+			uint32_t hash = _hashBytes(
+				dirHash,
+				(const char *) &record[DR_NAME],
+				record[DR_NAME_LENGTH]
+			);
+
+			if (!_insert(
+				hash ? hash : 1,
+				_read32(&record[DR_LBA]),
+				_read32(&record[DR_SIZE])
+			))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool buildISOIndex(void) {
+	static Directory dirs[MAX_DIRECTORIES];
+
+	_index = 0;
+
+	for (int i = 0; i < ISO_INDEX_CAPACITY; i++)
+		_entries[i].hash = 0;
+
+	// The path table lists every directory along with its parent, in an order
+	// where parents always come first, so full paths can be built in a single
+	// pass without recursion. It is usually a single sector long.
+	if (!_readSector(PVD_LBA))
+		return false;
+
+	const uint8_t *data = (const uint8_t *) _sector;
+
+	if ((data[0] != 1) || (data[1] != 'C') || (data[2] != 'D'))
+		return false;
+
+	uint32_t tableSize = _read32(&data[PVD_PATH_TABLE_SIZE]);
+	uint32_t tableLBA  = _read32(&data[PVD_PATH_TABLE_LBA]);
+
+	if (tableSize > CD_SECTOR_SIZE) {
+		puts("iso: path table larger than one sector, not supported");
+		return false;
+	}
+	if (!_readSector(tableLBA))
+		return false;
+
+	int numDirs = 0;
+
+	for (uint32_t offset = 0; offset < tableSize;) {
+		const uint8_t *entry     = &data[offset];
+		int           nameLength = entry[0];
+
+		if (!nameLength)
+			break;
+		if (numDirs >= MAX_DIRECTORIES) {
+			printf("iso: more than %d directories, rest ignored\n", MAX_DIRECTORIES);
+			break;
+		}
+
+		Directory *dir = &dirs[numDirs];
+		dir->lba       = _read32(&entry[2]);
+		dir->parent    = _read16(&entry[6]);
+
+		// The root directory's name is a single null byte and its path is
+		// empty; everything else is "parent path" + "name/".
+		if (!numDirs) {
+			dir->pathLength = 0;
+		} else {
+			// Parents always come before their children in the path table,
+			// so anything else means the table is corrupt.
+			if ((dir->parent < 1) || (dir->parent > numDirs)) {
+				printf("iso: bad path table parent (%d)\n", dir->parent);
+				return false;
+			}
+
+			const Directory *parent = &dirs[dir->parent - 1];
+			int             length  = parent->pathLength;
+
+			if ((length + nameLength + 1) > MAX_PATH_LENGTH)
+				return false;
+
+			for (int i = 0; i < length; i++)
+				dir->path[i] = parent->path[i];
+			for (int i = 0; i < nameLength; i++)
+				dir->path[length++] = entry[8 + i];
+
+			dir->path[length++] = '/';
+			dir->pathLength     = length;
+		}
+
+		numDirs++;
+		offset += 8 + nameLength + (nameLength & 1);
+	}
+
+	// Directory contents go through the same sector buffer, so the path table
+	// must not be needed past this point (it is fully copied into dirs[]).
+	for (int i = 0; i < numDirs; i++) {
+		if (!_indexDirectory(&dirs[i]))
+			return false;
+	}
+
+	_index = _entries;
+	return true;
+}
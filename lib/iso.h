@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The index is an open addressing hash table keyed by the 32-bit FNV-1a hash
+// of each file's normalized path (uppercase, no leading slash, no ";1" version
+// suffix, e.g. "DATA/LEVEL1.BIN"). Names themselves are not stored; the table
+// builder rejects discs with colliding hashes. ISO_INDEX_CAPACITY must be a
+// power of 2 and should be at least twice the number of files on the disc.
+#define ISO_INDEX_CAPACITY 256
+#define ISO_INDEX_MAGIC    0x584f5349 // "ISOX"
+
+typedef struct {
+	uint32_t hash; // 0 = unused slot
+	uint32_t lba;
+	uint32_t size;
+} ISOIndexEntry;
+
+// Layout of the prebuilt index files generated by tools/buildIsoIndex.py.
+typedef struct {
+	uint32_t      magic;
+	uint32_t      capacity;
+	uint32_t      numFiles;
+	uint32_t      _reserved;
+	ISOIndexEntry entries[];
+} ISOIndexHeader;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Reads the disc's primary volume descriptor, path table and all
+ * directories (blocking, using the CD driver) and builds the file index from
+ * them. Meant to be called once at boot, after initCD().
+ *
+ * @return false if the disc could not be read, has too many files or two
+ * files whose paths hash to the same value
+ */
+bool buildISOIndex(void);
+
+/**
+ * @brief Uses a prebuilt index (generated offline by tools/buildIsoIndex.py
+ * and linked into the executable) instead of reading the disc's directories.
+ * The data is used in place and must have ISO_INDEX_CAPACITY entries.
+ *
+ * @param data
+ * @return false if the data is not a valid index
+ */
+bool useISOIndex(const void *data);
+
+/**
+ * @brief Computes the hash used as the index's key for the given path.
+ * Lowercase letters, backslashes, a leading slash and a ";1" suffix are all
+ * accepted and normalized.
+ *
+ * @param path
+ */
+uint32_t hashISOPath(const char *path);
+
+/**
+ * @brief Looks up a file in the index. Does not access the disc.
+ *
+ * @param path
+ * @return The file's entry, or a null pointer if not found
+ */
+const ISOIndexEntry *findISOFile(const char *path);
+
+/**
+ * @brief Same as findISOFile() but takes a precomputed hash.
+ *
+ * @param hash
+ */
+const ISOIndexEntry *findISOFileByHash(uint32_t hash);
+
+#ifdef __cplusplus
+}
+#endif
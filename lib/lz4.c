@@ -0,0 +1,277 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "lz4.h"
+
+#define MIN_MATCH 4
+
+typedef enum {
+	STATE_TOKEN           = 0,
+	STATE_LITERAL_LENGTH  = 1,
+	STATE_LITERALS        = 2,
+	STATE_OFFSET_LOW      = 3,
+	STATE_OFFSET_HIGH     = 4,
+	STATE_MATCH_LENGTH    = 5
+} StreamState;
+
+/* Copy helpers */
+
+// Accessing a packed struct makes GCC emit lwl/lwr and swl/swr pairs, which
+// move 4 bytes regardless of alignment in two instructions each. This is much
+// faster than copying bytes individually on the R3000, which has no cache for
+// data and pays the full bus latency on every load.
+typedef struct {
+	uint32_t value;
+} __attribute__((packed)) Unaligned32;
+
+// Forward copy with the same semantics as a byte loop, i.e. overlapping
+// matches replicate their pattern and in-place literals only read bytes before
+// overwriting them. Each word has to be read after the previous one has been
+// written (matches) or before it gets overwritten (literals), which holds for
+// single words whenever src and dest are at least 4 bytes apart. The unrolled
+// loop does both loads before either store though, so it is only safe once
+// they are at least 8 bytes apart.
+static inline uint8_t *_copyForward(
+	uint8_t *dest, const uint8_t *src, uint32_t length
+) {
+	uint32_t distance = (src > dest) ? (src - dest) : (dest - src);
+
+	if (distance >= 8) {
+		for (; length >= 8; length -= 8) {
+			uint32_t a = ((const Unaligned32 *) src)[0].value;
+			uint32_t b = ((const Unaligned32 *) src)[1].value;
+
+			((Unaligned32 *) dest)[0].value = a;
+			((Unaligned32 *) dest)[1].value = b;
+			dest += 8;
+			src  += 8;
+		}
+	}
+	if (distance >= 4) {
+		for (; length >= 4; length -= 4) {
+			((Unaligned32 *) dest)->value = ((const Unaligned32 *) src)->value;
+			dest += 4;
+			src  += 4;
+		}
+	}
+
+	for (; length; length--)
+		*(dest++) = *(src++);
+
+	return dest;
+}
+
+static inline uint8_t *_copyMatch(
+	uint8_t *out, uint32_t offset, uint32_t length
+) {
+	const uint8_t *src = out - offset;
+
+	// Offset 1 (a run of the same byte) is common enough in image data and
+	// padding to be worth turning into a word fill.
+	if (offset == 1) {
+		uint32_t value = *src * 0x01010101u;
+
+		for (; length >= 4; length -= 4, out += 4)
+			((Unaligned32 *) out)->value = value;
+		for (; length; length--)
+			*(out++) = (uint8_t) value;
+
+		return out;
+	}
+
+	return _copyForward(out, src, length);
+}
+
+/* Block decoder */
+
+size_t decompressLZ4(
+	void *dest, size_t destLength, const void *src, size_t srcLength
+) {
+	uint8_t       *out    = (uint8_t *) dest;
+	uint8_t       *outEnd = out + destLength;
+	const uint8_t *in     = (const uint8_t *) src;
+	const uint8_t *inEnd  = in + srcLength;
+
+	while (in < inEnd) {
+		uint32_t token  = *(in++);
+		uint32_t length = token >> 4;
+
+		if (length == 15) {
+			uint32_t value;
+
+			do {
+				if (in >= inEnd)
+					return 0;
+
+				value   = *(in++);
+				length += value;
+			} while (value == 255);
+		}
+
+		if (
+			(length > (uint32_t) (inEnd - in)) ||
+			(length > (uint32_t) (outEnd - out))
+		)
+			return 0;
+
+		out = _copyForward(out, in, length);
+		in += length;
+
+		// The last sequence only has literals.
+		if (in >= inEnd)
+			break;
+		if ((inEnd - in) < 2)
+			return 0;
+
+		uint32_t offset = in[0] | (in[1] << 8);
+		in             += 2;
+		length          = (token & 15) + MIN_MATCH;
+
+		if ((token & 15) == 15) {
+			uint32_t value;
+
+			do {
+				if (in >= inEnd)
+					return 0;
+
+				value   = *(in++);
+				length += value;
+			} while (value == 255);
+		}
+
+		if (
+			!offset ||
+			(offset > (uint32_t) (out - (uint8_t *) dest)) ||
+			(length > (uint32_t) (outEnd - out))
+		)
+			return 0;
+
+		out = _copyMatch(out, offset, length);
+	}
+
+	return out - (uint8_t *) dest;
+}
+
+/* Streaming decoder */
+
+void initLZ4Stream(
+	LZ4Stream *stream, void *dest, size_t destLength, size_t srcLength
+) {
+	stream->dest      = (uint8_t *) dest;
+	stream->out       = (uint8_t *) dest;
+	stream->outEnd    = (uint8_t *) dest + destLength;
+	stream->inputLeft = srcLength;
+	stream->state     = STATE_TOKEN;
+	stream->status    = srcLength ? LZ4_STREAM_MORE : LZ4_STREAM_DONE;
+}
+
+// Sequence headers are parsed a byte at a time through the state machine so
+// they can be split across chunks at any point, but literals and matches are
+// still copied in bulk. With 2048-byte chunks the overhead compared to the
+// block decoder is only a few percent.
+LZ4StreamStatus feedLZ4Stream(
+	LZ4Stream *stream, const void *src, size_t length
+) {
+	if (stream->status != LZ4_STREAM_MORE)
+		return stream->status;
+	if (length > stream->inputLeft)
+		length = stream->inputLeft;
+
+	uint8_t       *out   = stream->out;
+	const uint8_t *in    = (const uint8_t *) src;
+	const uint8_t *inEnd = in + length;
+
+	uint32_t seqLength = stream->length;
+	uint32_t value;
+
+	while (in < inEnd) {
+		switch (stream->state) {
+			case STATE_TOKEN:
+				stream->token = *(in++);
+				seqLength     = stream->token >> 4;
+				stream->state = (seqLength == 15)
+					? STATE_LITERAL_LENGTH
+					: STATE_LITERALS;
+				break;
+
+			case STATE_LITERAL_LENGTH:
+				value      = *(in++);
+				seqLength += value;
+
+				if (value != 255)
+					stream->state = STATE_LITERALS;
+				break;
+
+			case STATE_LITERALS:
+				value = inEnd - in;
+
+				if (value > seqLength)
+					value = seqLength;
+				if (value > (uint32_t) (stream->outEnd - out))
+					goto _error;
+
+				out        = _copyForward(out, in, value);
+				in        += value;
+				seqLength -= value;
+
+				if (!seqLength)
+					stream->state = STATE_OFFSET_LOW;
+				break;
+
+			case STATE_OFFSET_LOW:
+				stream->offset = *(in++);
+				stream->state  = STATE_OFFSET_HIGH;
+				break;
+
+			case STATE_OFFSET_HIGH:
+				stream->offset |= *(in++) << 8;
+				seqLength       = (stream->token & 15) + MIN_MATCH;
+
+				if ((stream->token & 15) == 15) {
+					stream->state = STATE_MATCH_LENGTH;
+					break;
+				}
+
+				goto _copyMatch;
+
+			case STATE_MATCH_LENGTH:
+				value      = *(in++);
+				seqLength += value;
+
+				if (value == 255)
+					break;
+
+			_copyMatch:
+				if (
+					!stream->offset ||
+					(stream->offset > (uint32_t) (out - stream->dest)) ||
+					(seqLength > (uint32_t) (stream->outEnd - out))
+				)
+					goto _error;
+
+				out           = _copyMatch(out, stream->offset, seqLength);
+				stream->state = STATE_TOKEN;
+				break;
+		}
+	}
+
+	stream->out        = out;
+	stream->length     = seqLength;
+	stream->inputLeft -= length;
+
+	if (!stream->inputLeft) {
+		// A valid block always ends right after the last sequence's literals.
+		stream->status = (
+			(stream->state == STATE_OFFSET_LOW) ||
+			((stream->state == STATE_LITERALS) && !seqLength)
+		)
+			? LZ4_STREAM_DONE
+			: LZ4_STREAM_ERROR;
+	}
+
+	return stream->status;
+
+_error:
+	stream->status = LZ4_STREAM_ERROR;
+	return stream->status;
+}
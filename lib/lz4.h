@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Decoder for raw LZ4 blocks (no frame headers or checksums), as generated by
+// tools/packArchive.py. Both decoders can run in place, i.e. with the
+// compressed data placed at the end of the output buffer, provided the buffer
+// is large enough to keep the write pointer from catching up with the read
+// pointer; the packer computes and stores the required margin for each entry.
+
+typedef enum {
+	LZ4_STREAM_MORE  = 0, // Waiting for more input
+	LZ4_STREAM_DONE  = 1, // All input consumed, output complete
+	LZ4_STREAM_ERROR = 2  // Malformed data or output overflow
+} LZ4StreamStatus;
+
+typedef struct {
+	uint8_t  *dest, *out, *outEnd;
+	size_t   inputLeft;
+	uint32_t length, offset;
+	uint8_t  state, token;
+
+	LZ4StreamStatus status;
+} LZ4Stream;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Decompresses an entire LZ4 block in one go.
+ *
+ * @param dest
+ * @param destLength Size of the output buffer
+ * @param src
+ * @param srcLength Size of the compressed block
+ * @return The number of bytes written, or 0 if the data is malformed or does
+ * not fit
+ */
+size_t decompressLZ4(
+	void *dest, size_t destLength, const void *src, size_t srcLength
+);
+
+/**
+ * @brief Prepares a stream for decompressing a block fed in arbitrarily sized
+ * chunks (e.g. one sector at a time as they come in from the disc) through
+ * feedLZ4Stream(). Output is always written contiguously into dest, as matches
+ * can refer back to anything decompressed so far.
+ *
+ * @param stream
+ * @param dest
+ * @param destLength Size of the output buffer
+ * @param srcLength Total size of the compressed block
+ */
+void initLZ4Stream(
+	LZ4Stream *stream, void *dest, size_t destLength, size_t srcLength
+);
+
+/**
+ * @brief Decompresses the given chunk of input, which must directly follow
+ * the one passed in the previous call. The chunk does not need to be aligned
+ * to sequence boundaries.
+ *
+ * @param stream
+ * @param src
+ * @param length
+ * @return LZ4_STREAM_DONE once the last chunk has been processed
+ */
+LZ4StreamStatus feedLZ4Stream(
+	LZ4Stream *stream, const void *src, size_t length
+);
+
+#ifdef __cplusplus
+}
+#endif
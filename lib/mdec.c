@@ -0,0 +1,231 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "gpu.h"
+#include "mdec.h"
+#include "../ps1/registers.h"
+#include "../ps1/system.h"
+
+#define DMA_BLOCK_SIZE  32
+#define SLICE_LENGTH    (MDEC_MAX_HEIGHT * 16 / 2) // Words, 16bpp
+#define SECTOR_SIZE     2048
+
+/* Tables */
+
+// Standard quantization table (the same one used by Sony's tools), in zigzag
+// order, once for luma and once for chroma. The first entry is the DC
+// multiplier. tools/encodeMDEC.py must be kept in sync with it.
+static const uint8_t _quantTable[2][64] __attribute__((aligned(4))) = {
+	{
+		 2, 16, 16, 19, 16, 19, 22, 22, 22, 22, 22, 22, 26, 24, 26, 27,
+		27, 27, 26, 26, 26, 26, 27, 27, 27, 29, 29, 29, 34, 34, 34, 29,
+		29, 29, 27, 27, 29, 29, 32, 32, 34, 34, 37, 38, 37, 35, 35, 34,
+		35, 38, 38, 40, 40, 40, 48, 48, 46, 46, 56, 56, 58, 69, 69, 83
+	}, {
+		 2, 16, 16, 19, 16, 19, 22, 22, 22, 22, 22, 22, 26, 24, 26, 27,
+		27, 27, 26, 26, 26, 26, 27, 27, 27, 29, 29, 29, 34, 34, 34, 29,
+		29, 29, 27, 27, 29, 29, 32, 32, 34, 34, 37, 38, 37, 35, 35, 34,
+		35, 38, 38, 40, 40, 40, 48, 48, 46, 46, 56, 56, 58, 69, 69, 83
+	}
+};
+
+// Basis functions of the 8-point DCT, scaled so that the MDEC's IDCT is
+// orthonormal (row k is c(k) * cos((2n + 1) * k * pi / 16) * 0x8000).
+static const int16_t _idctTable[64] __attribute__((aligned(4))) = {
+	 23170,  23170,  23170,  23170,  23170,  23170,  23170,  23170,
+	 32138,  27245,  18204,   6392,  -6392, -18204, -27245, -32138,
+	 30273,  12539, -12539, -30273, -30273, -12539,  12539,  30273,
+	 27245,  -6392, -32138, -18204,  18204,  32138,   6392, -27245,
+	 23170, -23170, -23170,  23170,  23170, -23170, -23170,  23170,
+	 18204, -32138,   6392,  27245, -27245,  -6392,  32138, -18204,
+	 12539, -30273,  30273, -12539, -12539,  30273, -30273,  12539,
+	  6392, -18204,  27245, -32138,  32138, -27245,  18204,  -6392
+};
+
+/* Decoding state */
+
+static uint32_t _slices[2][SLICE_LENGTH];
+static uint32_t _sliceFences[2] = { 0, 0 };
+
+static volatile bool _busy = false;
+static int           _x, _y, _height, _numColumns;
+static volatile int  _column;
+static size_t        _sliceLength;
+
+static void _writeCommand(uint32_t command, const void *data, size_t length) {
+	const uint32_t *ptr = (const uint32_t *) data;
+
+	while (MDEC1 & MDEC_STAT_BUSY)
+		__asm__ volatile("");
+
+	MDEC0 = command;
+
+	for (; length; length--) {
+		while (MDEC1 & MDEC_STAT_DATA_FULL)
+			__asm__ volatile("");
+
+		MDEC0 = *(ptr++);
+	}
+}
+
+// Must be called with interrupts disabled.
+static void _startColumn(void) {
+	int index = _column % 2;
+
+	// The buffer may still be in the GPU upload queue from two columns ago.
+	// Decoding a column takes much longer than uploading one, so this should
+	// never actually have to wait.
+	waitForGPUFence(_sliceFences[index]);
+
+	DMA_MADR(DMA_MDEC_OUT) = (uint32_t) _slices[index];
+	DMA_BCR (DMA_MDEC_OUT) =
+		DMA_BLOCK_SIZE | ((_sliceLength / DMA_BLOCK_SIZE) << 16);
+	DMA_CHCR(DMA_MDEC_OUT) = 0
+		| DMA_CHCR_READ
+		| DMA_CHCR_MODE_SLICE
+		| DMA_CHCR_ENABLE;
+}
+
+static void _finishColumn(void) {
+	int index = _column % 2;
+
+	_sliceFences[index] = queueVRAMData(
+		_slices[index],
+		_x + _column * 16,
+		_y,
+		16,
+		_height
+	);
+
+	if (++_column < _numColumns)
+		_startColumn();
+	else
+		_busy = false;
+}
+
+static void _mdecOutHandler(void *arg) {
+	if (_busy && !(DMA_CHCR(DMA_MDEC_OUT) & DMA_CHCR_ENABLE))
+		_finishColumn();
+}
+
+// Same as the handler, for callers waiting with interrupts disabled.
+static void _pollDecode(void) {
+	int state = enterCriticalSection();
+
+	if (_busy && !(DMA_CHCR(DMA_MDEC_OUT) & DMA_CHCR_ENABLE))
+		_finishColumn();
+
+	exitCriticalSection(state);
+}
+
+/* Public API */
+
+void setupMDEC(void) {
+	MDEC1 = MDEC_CTRL_RESET;
+	MDEC1 = MDEC_CTRL_DMA_OUT | MDEC_CTRL_DMA_IN;
+
+	_writeCommand(MDEC_CMD_OP_SET_IDCT_TABLE, _idctTable, 64 / 2);
+
+	_writeCommand(
+		MDEC_CMD_OP_SET_QUANT_TABLE | MDEC_CMD_USE_CHROMA,
+		_quantTable,
+		(64 * 2) / 4
+	);
+
+	DMA_DPCR |= 0
+		| DMA_DPCR_CH_ENABLE(DMA_MDEC_IN)
+		| DMA_DPCR_CH_ENABLE(DMA_MDEC_OUT);
+
+	setDMAHandler(DMA_MDEC_OUT, &_mdecOutHandler, 0);
+}
+
+bool startMDECDecode(const MDECImage *image, int x, int y) {
+	if (_busy)
+		return false;
+	if (image->magic != MDEC_IMAGE_MAGIC)
+		return false;
+	if (
+		!image->width || (image->width % 16) ||
+		!image->height || (image->height % 16) ||
+		(image->height > MDEC_MAX_HEIGHT)
+	)
+		return false;
+	if (
+		!image->length || (image->length % DMA_BLOCK_SIZE) ||
+		(image->length > MDEC_MAX_LENGTH)
+	)
+		return false;
+
+	assert(((x + image->width) <= 1024) && ((y + image->height) <= 512));
+
+	int state = enterCriticalSection();
+
+	_x           = x;
+	_y           = y;
+	_height      = image->height;
+	_numColumns  = image->width / 16;
+	_column      = 0;
+	_sliceLength = image->height * 16 / 2;
+	_busy        = true;
+
+	// Make sure the previous command (or table upload) has been fully
+	// processed before sending a new one.
+	while (MDEC1 & MDEC_STAT_BUSY)
+		__asm__ volatile("");
+
+	MDEC0 = 0
+		| MDEC_CMD_OP_DECODE
+		| MDEC_CMD_FORMAT_16BPP
+		| image->length;
+
+	DMA_MADR(DMA_MDEC_IN) = (uint32_t) image->data;
+	DMA_BCR (DMA_MDEC_IN) =
+		DMA_BLOCK_SIZE | ((image->length / DMA_BLOCK_SIZE) << 16);
+	DMA_CHCR(DMA_MDEC_IN) = 0
+		| DMA_CHCR_WRITE
+		| DMA_CHCR_MODE_SLICE
+		| DMA_CHCR_ENABLE;
+
+	_startColumn();
+	exitCriticalSection(state);
+	return true;
+}
+
+bool isMDECDecodeDone(void) {
+	_pollDecode();
+
+	return !_busy
+		&& isGPUFenceDone(_sliceFences[0])
+		&& isGPUFenceDone(_sliceFences[1]);
+}
+
+void waitForMDECDecode(void) {
+	while (_busy)
+		_pollDecode();
+
+	waitForGPUFence(_sliceFences[0]);
+	waitForGPUFence(_sliceFences[1]);
+}
+
+bool decodeMDECImage(const MDECImage *image, int x, int y) {
+	if (!startMDECDecode(image, x, y))
+		return false;
+
+	waitForMDECDecode();
+	return true;
+}
+
+const MDECImage *getMDECFrame(const MDECSequence *sequence, int index) {
+	if (sequence->magic != MDEC_SEQUENCE_MAGIC)
+		return 0;
+	if ((index < 0) || (index >= sequence->numFrames))
+		return 0;
+
+	uint32_t offset = sequence->frameOffsets[index];
+
+	if (offset % SECTOR_SIZE)
+		return 0;
+
+	return (const MDECImage *) ((const uint8_t *) sequence + offset);
+}
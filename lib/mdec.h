@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Driver for the MDEC, which decodes images compressed with a JPEG-like scheme
+// (see tools/encodeMDEC.py). Compressed data is fed to the MDEC through DMA
+// while its output is read back, one 16 pixel wide column of macroblocks at a
+// time, into a pair of slice buffers in RAM. Each finished column is then
+// queued for upload to VRAM (the MDEC cannot write to the GPU directly), while
+// the next column is being decoded into the other buffer. The whole process is
+// driven by the MDEC output DMA IRQ and needs no CPU time beyond that.
+
+#define MDEC_IMAGE_MAGIC    0x4344424d // "MBDC"
+#define MDEC_SEQUENCE_MAGIC 0x5344424d // "MBDS"
+#define MDEC_MAX_HEIGHT     256
+#define MDEC_MAX_LENGTH     0xffe0     // Words, limited by the decode command
+
+typedef struct {
+	uint32_t magic;
+	uint16_t width, height; // Multiples of 16
+	uint32_t length;        // Bitstream length in words, multiple of 32
+	uint32_t data[];
+} MDECImage;
+
+// A sequence (e.g. a cutscene) is a header followed by one MDECImage per frame.
+// Each frame starts on a 2048 byte boundary, so that frames can also be read
+// one at a time straight from the disc.
+typedef struct {
+	uint32_t magic;
+	uint16_t numFrames, frameRate;
+	uint32_t frameOffsets[]; // In bytes from the beginning of the header
+} MDECSequence;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Resets the MDEC, uploads the IDCT and quantization tables used by
+ * tools/encodeMDEC.py and registers the output DMA handler. Requires
+ * installExceptionHandler() to have been called beforehand.
+ */
+void setupMDEC(void);
+
+/**
+ * @brief Starts decoding an image to the given location in VRAM and returns
+ * immediately. The image data must stay valid until the decode is done.
+ *
+ * @return False if another image is still being decoded or the image is not
+ * valid
+ */
+bool startMDECDecode(const MDECImage *image, int x, int y);
+bool isMDECDecodeDone(void);
+
+/**
+ * @brief Waits for the current decode to finish, including the upload of the
+ * last column to VRAM.
+ */
+void waitForMDECDecode(void);
+
+/**
+ * @brief Blocking version of startMDECDecode().
+ */
+bool decodeMDECImage(const MDECImage *image, int x, int y);
+
+/**
+ * @brief Returns the given frame of a sequence loaded in RAM, or a null
+ * pointer if the index is out of range or the sequence is not valid.
+ */
+const MDECImage *getMDECFrame(const MDECSequence *sequence, int index);
+
+#ifdef __cplusplus
+}
+#endif
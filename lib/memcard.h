@@ -0,0 +1,215 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../ps1/system.h"
+#include "pad.h"
+
+#pragma once
+
+// Memory card sector read/write, done in the background on the same async SIO0
+// engine as controller polling (see PadSubmitJob in pad.h), so a sector costs the
+// game nothing but a copy. Jobs are queued behind whatever else is on the bus,
+// so expect a poll or two to land in between.
+// - a card is 1024 sectors of 128 bytes (128KB), sector 0 is the "MC" header
+// - completion: either pass a callback (runs in the irq handler, keep it short)
+//   or check request->done from the game loop
+// - request structs hold the packet buffers and must stay alive until done
+// - in pcsx-redux, enable the card in Configuration -> Memory Cards and point it
+//   at a .mcd file (raw 128KB image), see the README
+#define MEMCARD_SECTOR_SIZE 128
+#define MEMCARD_NUM_SECTORS 1024
+
+typedef enum {
+	MEMCARD_OK = 0,
+	MEMCARD_PENDING,      //still queued/in flight
+	MEMCARD_NO_CARD,      //nothing answered on that port
+	MEMCARD_BAD_CHECKSUM, //read: data didn't match the checksum, write: card says it got garbage
+	MEMCARD_BAD_SECTOR,   //sector number out of range or the sector is broken
+	MEMCARD_PROTOCOL      //card answered with something unexpected
+} MemcardResult;
+
+// card answers the first command byte with this, bit 3 is set until the first
+// write after the card was plugged in/powered on (how games notice a card swap)
+#define MEMCARD_FLAG_FRESH 0x08
+
+// response offsets, counted from the response to the command byte
+#define MC_READ_LENGTH   139 //cmd, 2 id, 2 address, 2 ack, 2 confirmed address, 128 data, checksum, end
+#define MC_READ_DATA     9
+#define MC_READ_CHECKSUM 137
+#define MC_WRITE_LENGTH  137 //cmd, 2 id, 2 address, 128 data, checksum, 2 ack, end
+#define MC_WRITE_DATA    5
+
+#define MC_END_GOOD         'G'
+#define MC_END_BAD_CHECKSUM 'N'
+#define MC_END_BAD_SECTOR   0xff
+
+typedef struct MemcardRequest MemcardRequest;
+typedef void (*MemcardCallback)(MemcardRequest *request, void *arg);
+
+struct MemcardRequest {
+	PadJob          job;
+	uint8_t         packet[MC_WRITE_LENGTH];
+	uint8_t         response[MC_READ_LENGTH];
+	uint8_t         *readBuffer; //read destination, 128 bytes
+	int             sector;
+	bool            write;
+	MemcardCallback callback;
+	void            *arg;
+	uint8_t                flag; //first response byte, see MEMCARD_FLAG_FRESH
+	volatile MemcardResult result;
+	volatile bool          done;
+};
+
+static MemcardResult MemcardCheckResponse(MemcardRequest *request)
+{
+	const uint8_t *response = request->response;
+	int length = request->job.respLength;
+
+	if (length < 3){return MEMCARD_NO_CARD;}
+	request->flag = response[0];
+	if (response[1] != 0x5a || response[2] != 0x5d){return MEMCARD_PROTOCOL;}
+
+	if (request->write)
+	{
+		if (length < MC_WRITE_LENGTH){return MEMCARD_PROTOCOL;}
+		switch (response[MC_WRITE_LENGTH - 1])
+		{
+			case MC_END_GOOD:         return MEMCARD_OK;
+			case MC_END_BAD_CHECKSUM: return MEMCARD_BAD_CHECKSUM;
+			case MC_END_BAD_SECTOR:   return MEMCARD_BAD_SECTOR;
+			default:                  return MEMCARD_PROTOCOL;
+		}
+	}
+
+	//reads bail out early (card stops acking) if the sector is bad, the card sends
+	//0xffff back as the confirmed address in that case
+	if (length < MC_READ_LENGTH)
+	{
+		if (length > 8 && response[7] == 0xff && response[8] == 0xff){return MEMCARD_BAD_SECTOR;}
+		return MEMCARD_PROTOCOL;
+	}
+	if (response[5] != 0x5c || response[6] != 0x5d){return MEMCARD_PROTOCOL;}
+	if (response[MC_READ_LENGTH - 1] != MC_END_GOOD){return MEMCARD_PROTOCOL;}
+
+	uint8_t checksum = response[7] ^ response[8];
+	for (int i = 0; i < MEMCARD_SECTOR_SIZE; i++){checksum ^= response[MC_READ_DATA + i];}
+	if (checksum != response[MC_READ_CHECKSUM]){return MEMCARD_BAD_CHECKSUM;}
+	return MEMCARD_OK;
+}
+
+//runs in the irq handler once the engine is done with the transfer
+static void MemcardJobDone(void *arg)
+{
+	MemcardRequest *request = (MemcardRequest *) arg;
+	MemcardResult result = MemcardCheckResponse(request);
+
+	if (result == MEMCARD_OK && !request->write)
+	{
+		for (int i = 0; i < MEMCARD_SECTOR_SIZE; i++){request->readBuffer[i] = request->response[MC_READ_DATA + i];}
+	}
+
+	request->result = result;
+	request->done   = true;
+	if (request->callback){request->callback(request, request->arg);}
+}
+
+static bool MemcardSubmit(MemcardRequest *request, int port, int reqLength, int respLength)
+{
+	request->result = MEMCARD_PENDING;
+	request->done   = false;
+
+	PadJob *job        = &request->job;
+	job->port          = port;
+	job->address       = ADDR_MEMORY_CARD;
+	job->request       = request->packet;
+	job->response      = request->response;
+	job->reqLength     = reqLength;
+	job->maxRespLength = respLength;
+	job->callback      = &MemcardJobDone;
+	job->arg           = request;
+	return PadSubmitJob(job);
+}
+
+/// @brief queue a sector read
+/// @param request - holds the packet buffers, keep it around until request->done
+/// @param port - 0 or 1
+/// @param sector - 0 to MEMCARD_NUM_SECTORS - 1
+/// @param dest - 128 bytes, only written if the read succeeds
+/// @param callback - optional, called from the irq handler when done
+/// @return false if the sector is out of range or the job queue is full
+static bool MemcardReadSector(MemcardRequest *request, int port, int sector, uint8_t *dest, MemcardCallback callback, void *arg)
+{
+	if (sector < 0 || sector >= MEMCARD_NUM_SECTORS){return false;}
+
+	request->readBuffer = dest;
+	request->sector     = sector;
+	request->write      = false;
+	request->callback   = callback;
+	request->arg        = arg;
+
+	//only the command and address need sending, the engine pads the rest with zeroes
+	uint8_t *packet = request->packet;
+	packet[0] = CMD_CARD_READ;
+	packet[1] = 0;
+	packet[2] = 0;
+	packet[3] = sector >> 8;
+	packet[4] = sector & 0xff;
+	return MemcardSubmit(request, port, 5, MC_READ_LENGTH);
+}
+
+/// @brief queue a sector write, src is copied so it can be reused right away
+/// @return false if the sector is out of range or the job queue is full
+static bool MemcardWriteSector(MemcardRequest *request, int port, int sector, const uint8_t *src, MemcardCallback callback, void *arg)
+{
+	if (sector < 0 || sector >= MEMCARD_NUM_SECTORS){return false;}
+
+	request->readBuffer = 0;
+	request->sector     = sector;
+	request->write      = true;
+	request->callback   = callback;
+	request->arg        = arg;
+
+	uint8_t *packet  = request->packet;
+	uint8_t checksum = (sector >> 8) ^ (sector & 0xff);
+	packet[0] = CMD_CARD_WRITE;
+	packet[1] = 0;
+	packet[2] = 0;
+	packet[3] = sector >> 8;
+	packet[4] = sector & 0xff;
+	for (int i = 0; i < MEMCARD_SECTOR_SIZE; i++)
+	{
+		packet[MC_WRITE_DATA + i] = src[i];
+		checksum ^= src[i];
+	}
+	packet[MC_WRITE_DATA + MEMCARD_SECTOR_SIZE] = checksum;
+	for (int i = MC_WRITE_DATA + MEMCARD_SECTOR_SIZE + 1; i < MC_WRITE_LENGTH; i++){packet[i] = 0;}
+	return MemcardSubmit(request, port, MC_WRITE_LENGTH, MC_WRITE_LENGTH);
+}
+
+static const char *const memcardResultNames[] = {
+	"ok", "pending", "no card", "bad checksum", "bad sector", "protocol error"
+};
+
+/// @brief read the header sector of the card in the given port and print what came back,
+/// handy for checking things work with a virtual card in the emulator
+static void MemcardSelfTest(int port)
+{
+	static MemcardRequest request;
+	static uint8_t sector[MEMCARD_SECTOR_SIZE];
+
+	if (!MemcardReadSector(&request, port, 0, sector, 0, 0))
+	{
+		puts("memcard: couldn't queue read");
+		return;
+	}
+	while (!request.done)
+		__asm__ volatile("");
+
+	printf("memcard %d: sector 0 read %s, flag %02x", port + 1, memcardResultNames[request.result], request.flag);
+	if (request.result == MEMCARD_OK)
+	{
+		bool formatted = (sector[0] == 'M' && sector[1] == 'C');
+		printf(", %s", formatted ? "formatted" : "not formatted");
+	}
+	printf("\n");
+}
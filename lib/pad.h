@@ -5,6 +5,7 @@
 #include "gpu.h"
 #include "../ps1/gpucmd.h"
 #include "../ps1/registers.h"
+#include "../ps1/system.h"
 
 #pragma once
 
@@ -30,6 +31,9 @@ static void delayMicroseconds(int time) {
 	);
 }
 
+static void PadTimerHandler(void *arg);
+static void PadSIOHandler(void *arg);
+
 static void initControllerBus(void) {
 	// Reset the serial interface, initialize it with the settings used by
 	// controllers and memory cards (250000bps, 8 data bits) and configure it to
@@ -45,6 +49,11 @@ static void initControllerBus(void) {
 		| SIO_CTRL_TX_ENABLE
 		| SIO_CTRL_RX_ENABLE
 		| SIO_CTRL_DSR_IRQ_ENABLE;
+
+	// hook up the async transfer engine (see PadSubmitJob) to those irqs
+	TIMER_CTRL(0) = 0;
+	setIRQHandler(IRQ_TIMER0, &PadTimerHandler, 0);
+	setIRQHandler(IRQ_SIO0, &PadSIOHandler, 0);
 }
 
 static bool waitForAcknowledge(int timeout) {
@@ -113,6 +122,195 @@ static void selectPort(int port) {
 		SIO_CTRL(0) &= ~SIO_CTRL_CS_PORT_2;
 }
 
+// Asynchronous controller/memory card transfers. Instead of spinning on every
+// byte like exchangePacket() does, a transfer is queued as a PadJob and carried
+// out in the background by a small state machine driven by the SIO0 interrupt
+// (DSR pulse from the device = byte acknowledged, or RX for the final byte,
+// which devices never acknowledge) and root counter 0 (used as a one-shot timer
+// for the DTR delays and the acknowledge timeout). Needs installExceptionHandler()
+// to have been called before initControllerBus().
+#define PAD_QUEUE_SIZE 8  //power of 2
+#define PAD_MAX_RESPONSE 34 //multitap poll: 2 byte header + 4 slots * 8 bytes
+
+typedef enum {
+	PAD_IDLE = 0,
+	PAD_SELECT,   //DTR asserted, waiting out DTR_DELAY
+	PAD_ADDRESS,  //address byte sent, waiting for the device to ack it
+	PAD_TRANSFER, //exchanging the packet
+	PAD_RELEASE   //done, waiting out DTR_DELAY before releasing DTR
+} PadEngineState;
+
+typedef struct {
+	uint8_t       port;
+	DeviceAddress address;
+	const uint8_t *request;
+	uint8_t       *response;
+	int           reqLength, maxRespLength;
+	ArgFunction   callback; //optional, called from the irq handler once done
+	void          *arg;
+	volatile int  respLength;
+	volatile bool done;
+} PadJob;
+
+static PadJob *padQueue[PAD_QUEUE_SIZE];
+static volatile uint8_t padQueueHead = 0, padQueueTail = 0;
+static PadJob *padCurrent = 0;
+static volatile PadEngineState padEngineState = PAD_IDLE;
+static int padExpectedLength = 0;
+
+static void StartPadTimer(int time)
+{
+	// root counter 0 at sysclk, reset and fire once when it hits the target
+	TIMER_RELOAD(0) = ((time * 271) + 4) / 8;
+	TIMER_CTRL(0)   = TIMER_CTRL_RELOAD | TIMER_CTRL_IRQ_ON_RELOAD;
+}
+
+//must be called with interrupts disabled
+static void PadStartNextJob(void)
+{
+	if (padQueueTail == padQueueHead)
+	{
+		padCurrent     = 0;
+		padEngineState = PAD_IDLE;
+		return;
+	}
+
+	PadJob *job  = padQueue[padQueueTail];
+	padQueueTail = (padQueueTail + 1) & (PAD_QUEUE_SIZE - 1);
+
+	padCurrent        = job;
+	padExpectedLength = job->maxRespLength;
+	job->respLength   = 0;
+
+	selectPort(job->port);
+	SIO_CTRL(0) |= SIO_CTRL_DTR | SIO_CTRL_ACKNOWLEDGE;
+	padEngineState = PAD_SELECT;
+	StartPadTimer(DTR_DELAY);
+}
+
+static void PadSendNextByte(void)
+{
+	PadJob *job = padCurrent;
+	int index   = job->respLength;
+
+	//the device won't ack the last byte, so ask for an irq when it comes in instead
+	if (index == padExpectedLength - 1){SIO_CTRL(0) |= SIO_CTRL_RX_IRQ_ENABLE;}
+
+	SIO_DATA(0) = (index < job->reqLength) ? job->request[index] : 0;
+	StartPadTimer(DSR_TIMEOUT);
+}
+
+static void PadEndTransfer(void)
+{
+	SIO_CTRL(0)   &= ~SIO_CTRL_RX_IRQ_ENABLE;
+	padEngineState = PAD_RELEASE;
+	StartPadTimer(DTR_DELAY);
+}
+
+static void PadTimerHandler(void *arg)
+{
+	switch (padEngineState)
+	{
+		case PAD_SELECT:
+			while (SIO_STAT(0) & SIO_STAT_RX_NOT_EMPTY){SIO_DATA(0);}
+			padEngineState = PAD_ADDRESS;
+			SIO_DATA(0)    = padCurrent->address;
+			StartPadTimer(DSR_TIMEOUT);
+			break;
+
+		case PAD_ADDRESS:
+		case PAD_TRANSFER:
+			//no ack in time, either nothing is plugged in or the device is done talking
+			PadEndTransfer();
+			break;
+
+		case PAD_RELEASE:
+		{
+			SIO_CTRL(0) &= ~SIO_CTRL_DTR;
+			PadJob *job = padCurrent;
+			job->done   = true;
+			if (job->callback){job->callback(job->arg);}
+			PadStartNextJob();
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+static void PadSIOHandler(void *arg)
+{
+	PadJob *job = padCurrent;
+
+	switch (padEngineState)
+	{
+		case PAD_ADDRESS:
+			//the device acked its address, throw away the dummy byte it sent back
+			while (SIO_STAT(0) & SIO_STAT_RX_NOT_EMPTY){SIO_DATA(0);}
+			padEngineState = PAD_TRANSFER;
+			PadSendNextByte();
+			break;
+
+		case PAD_TRANSFER:
+			if (!(SIO_STAT(0) & SIO_STAT_RX_NOT_EMPTY)){break;}
+			job->response[job->respLength++] = SIO_DATA(0);
+
+			//controllers tell us how long their response is in the first byte (in 2 byte units
+			//after the 2 byte header, 0 meaning 16), so we can stop right after the last one
+			if (job->respLength == 1 && job->address == ADDR_CONTROLLER)
+			{
+				int halfwords = job->response[0] & 0xf;
+				int length    = 2 + (halfwords ? halfwords : 16) * 2;
+				if (length < padExpectedLength){padExpectedLength = length;}
+			}
+
+			if (job->respLength >= padExpectedLength){PadEndTransfer();}
+			else{PadSendNextByte();}
+			break;
+
+		default:
+			//stray ack after we gave up on the transfer, nothing to do
+			break;
+	}
+
+	//acknowledge last, after the rx fifo has been read, or the rx irq would fire again right away
+	SIO_CTRL(0) |= SIO_CTRL_ACKNOWLEDGE;
+}
+
+/// @brief queue a transfer, returns immediately. job and its buffers have to stay around until job->done
+/// @return false if the queue is full
+static bool PadSubmitJob(PadJob *job)
+{
+	int state = enterCriticalSection();
+	uint8_t next = (padQueueHead + 1) & (PAD_QUEUE_SIZE - 1);
+	if (next == padQueueTail)
+	{
+		exitCriticalSection(state);
+		return false;
+	}
+
+	job->done       = false;
+	job->respLength = 0;
+	padQueue[padQueueHead] = job;
+	padQueueHead = next;
+
+	if (padEngineState == PAD_IDLE){PadStartNextJob();}
+	exitCriticalSection(state);
+	return true;
+}
+
+static bool PadIsBusy(void)
+{
+	return padEngineState != PAD_IDLE;
+}
+
+static void PadWaitIdle(void)
+{
+	while (padEngineState != PAD_IDLE)
+		__asm__ volatile("");
+}
+
 static uint8_t exchangeByte(uint8_t value) {
 	// Wait until the interface is ready to accept a byte to send, then wait for
 	// it to finish receiving the byte sent by the device.
@@ -134,6 +332,12 @@ static int exchangePacket(
 	int           reqLength,
 	int           maxRespLength
 ) {
+	// The async engine (see below) owns the bus and its irqs while it's running,
+	// so wait for it to go idle and keep it from seeing the acks we poll for.
+	// This blocks interrupts for the whole transfer, fine for debugging only.
+	PadWaitIdle();
+	int state = enterCriticalSection();
+
 	// Reset the interrupt flag and assert the DTR signal to tell the controller
 	// or memory card that we're about to send a packet. Devices may take some
 	// time to prepare for incoming bytes so we need a small delay here.
@@ -178,6 +382,8 @@ static int exchangePacket(
 	delayMicroseconds(DTR_DELAY);
 	SIO_CTRL(0) &= ~SIO_CTRL_DTR;
 
+	IRQ_STAT = ~(1 << IRQ_SIO0);
+	exitCriticalSection(state);
 	return respLength;
 }
 
@@ -310,69 +516,117 @@ static void LogControllerInfo(int port) {
 	if(anyButt){printf("\n%s \n\n", output);}
 }
 
+// button masks for PlayerInput.held/pressed/released, test with a single and:
+//   if (in.pressed & BTN_CROSS){jump}
+//   if (in.held & (BTN_L1 | BTN_R1)){...}
+#define BTN_SELECT   (1 << CB_SELECT)
+#define BTN_L3       (1 << CB_L3)
+#define BTN_R3       (1 << CB_R3)
+#define BTN_START    (1 << CB_START)
+#define BTN_UP       (1 << CB_UP)
+#define BTN_RIGHT    (1 << CB_RIGHT)
+#define BTN_DOWN     (1 << CB_DOWN)
+#define BTN_LEFT     (1 << CB_LEFT)
+#define BTN_L2       (1 << CB_L2)
+#define BTN_R2       (1 << CB_R2)
+#define BTN_L1       (1 << CB_L1)
+#define BTN_R1       (1 << CB_R1)
+#define BTN_TRIANGLE (1 << CB_TRIANGLE)
+#define BTN_CIRCLE   (1 << CB_CIRCLE)
+#define BTN_CROSS    (1 << CB_CROSS)
+#define BTN_SQUARE   (1 << CB_SQUARE)
+#define BTN_DPAD     (BTN_UP | BTN_RIGHT | BTN_DOWN | BTN_LEFT)
+
 typedef struct {
-	bool connected; //is the controller connected
+	uint16_t held;     //buttons down right now, one bit per ControllerButton (active high)
+	uint16_t pressed;  //went down since the previous poll
+	uint16_t released; //came up since the previous poll
 	uint8_t type;
+	bool connected; //is the controller connected
 	bool type_ok;
-	bool select; // 	"Select",   // Bit  0
-	bool L3;// "L3",       // Bit  1
-	bool R3;// "R3",       // Bit  2
-	bool start;// "Start",    // Bit  3
-	bool up;// "Up",       // Bit  4
-	bool right;// "Right",    // Bit  5
-	bool down;// "Down",     // Bit  6
-	bool left;// "Left",     // Bit  7
-	bool L2;// "L2",       // Bit  8
-	bool R2;// "R2",       // Bit  9
-	bool L1;// "L1",       // Bit 10
-	bool R1;// "R1",       // Bit 11
-	bool triangle;// "Triangle", // Bit 12
-	bool circle;// "Circle",   // Bit 13
-	bool cross;// "X",        // Bit 14
-	bool square;// "Square"    // Bit 15
 	bool analog_on; // do we have joysticks
-	uint8_t analog_lv; //left stick vertical direction
-	uint8_t analog_lh; //left stick horizontal direction
-	uint8_t analog_rv; // right stick vertical
-	uint8_t analog_rh; //right stick horizontal
-	//these guys are the analog stick values but not the raw chars, 
-	//80 is center, so this will be the value 
-	// - 80 so its centered at 0 and goes negative
-	int16_t left_x; //left stick vertical direction, adjusted //todo: probably a better choice than short, like signed 8bit int...?
-	int16_t left_y; //left stick horizontal direction, adjusted
-	int16_t right_x; // right stick vertical, adjusted
-	int16_t right_y; //right stick horizontal, adjusted
+	//analog stick values, 80 is center on the raw bytes,
+	//so these are centered at 0 and go negative
+	int16_t left_x; //left stick horizontal direction
+	int16_t left_y; //left stick vertical direction, up is positive
+	int16_t right_x; // right stick horizontal
+	int16_t right_y; // right stick vertical, up is positive
 } PlayerInput;
 
-//todo, how to handle players holding and releasing actions?
-
 char CONT_1_RUMBLE = 0;
 char CONT_2_RUMBLE = 0;
 const char PLAYER_ONE = 0;
 const char PLAYER_TWO = 1;
 
-static PlayerInput GetControllerInput(int port)
+#define PAD_NUM_PORTS 2
+#define PAD_NUM_SLOTS 4 //multitap slots A-D, plain controllers show up as slot A
+
+// one poll job per port, kicked off once a frame by PadStartPoll() and finished in the
+// background. The irq copies each finished response into padLatest, which is what
+// GetControllerInput reads, so the game never waits on the bus.
+typedef struct {
+	PadJob  job;
+	uint8_t request[4];
+	uint8_t response[PAD_MAX_RESPONSE];
+} PadPoll;
+
+typedef struct {
+	uint8_t  response[PAD_MAX_RESPONSE];
+	int      length;
+	uint32_t count; //completed polls so far
+} PadResult;
+
+static PadPoll   padPolls[PAD_NUM_PORTS];
+static PadResult padLatest[PAD_NUM_PORTS];
+static uint32_t  padPollsSkipped = 0; //frames where the previous poll hadn't finished yet
+
+static void PadPollDone(void *arg)
 {
-	// Build the request packet.
-	uint8_t request[4], response[8];
-	PlayerInput input = {0};
+	int port = (int) (intptr_t) arg;
+	PadPoll *poll = &padPolls[port];
+	PadResult *result = &padLatest[port];
+	for (int i = 0; i < poll->job.respLength; i++){result->response[i] = poll->response[i];}
+	result->length = poll->job.respLength;
+	result->count++;
+}
 
-	request[0] = CMD_POLL; // Command
-	request[1] = 0x00;     // Multitap address
-	request[2] = CONT_1_RUMBLE;  // Rumble motor control 1
-	request[3] = CONT_2_RUMBLE;  // Rumble motor control 2
+/// @brief start polling both ports in the background, call once per frame
+static void PadStartPoll(void)
+{
+	for (int port = 0; port < PAD_NUM_PORTS; port++)
+	{
+		PadPoll *poll = &padPolls[port];
+		//still going from last time (queue backed up by memory card traffic etc), don't pile up
+		if (poll->job.callback && !poll->job.done)
+		{
+			padPollsSkipped++;
+			continue;
+		}
 
-	selectPort(port);
-	int respLength = exchangePacket(
-		ADDR_CONTROLLER,
-		request,
-		response,
-		sizeof(request),
-		sizeof(response)
-	);
+		poll->request[0] = CMD_POLL; // Command
+		poll->request[1] = 0x01;     // Multitap address, a multitap answers with all 4 slots, plain controllers ignore it
+		poll->request[2] = CONT_1_RUMBLE; // Rumble motor control 1
+		poll->request[3] = CONT_2_RUMBLE; // Rumble motor control 2
+
+		poll->job.port          = port;
+		poll->job.address       = ADDR_CONTROLLER;
+		poll->job.request       = poll->request;
+		poll->job.response      = poll->response;
+		poll->job.reqLength     = sizeof(poll->request);
+		poll->job.maxRespLength = sizeof(poll->response);
+		poll->job.callback      = &PadPollDone;
+		poll->job.arg           = (void *) (intptr_t) port;
+		PadSubmitJob(&poll->job);
+	}
+}
+
+/// @brief turn a raw poll response (8 bytes max, type/0x5a/buttons/sticks) into a PlayerInput
+static PlayerInput ParsePadResponse(const uint8_t *response, int respLength)
+{
+	PlayerInput input = {0};
 
 	//is it connected?
-	if (respLength < 4) {
+	if (respLength < 4 || response[0] == 0xff) {
 		// All controllers reply with at least 4 bytes of data.
 		input.connected = false;
 		return input;
@@ -394,40 +648,118 @@ static PlayerInput GetControllerInput(int port)
 		return input;
 	}
 
-	uint16_t buttons = (response[2] | (response[3] << 8)) ^ 0xffff;
-
-	if ((buttons >> CB_SELECT	) & 1){input.select 	= true;} // CB_SELECT = 0
-	if ((buttons >> CB_L3		) & 1){input.L3 		= true;} // CB_L3 = 1
-	if ((buttons >> CB_R3		) & 1){input.R3 		= true;} // CB_R3 = 2
-	if ((buttons >> CB_START	) & 1){input.start 		= true;} // CB_START
-	if ((buttons >> CB_UP		) & 1){input.up 		= true;} // CB_UP
-	if ((buttons >> CB_RIGHT	) & 1){input.right 		= true;} // CB_RIGHT
-	if ((buttons >> CB_DOWN		) & 1){input.down 		= true;} // CB_DOWN
-	if ((buttons >> CB_LEFT		) & 1){input.left 		= true;} // CB_LEFT
-	if ((buttons >> CB_L2		) & 1){input.L2 		= true;} // CB_L2
-	if ((buttons >> CB_R2		) & 1){input.R2 		= true;} // CB_R2
-	if ((buttons >> CB_L1		) & 1){input.L1 		= true;} // CB_L1
-	if ((buttons >> CB_R1		) & 1){input.R1 		= true;} // CB_R1
-	if ((buttons >> CB_TRIANGLE	) & 1){input.triangle 	= true;} // CB_TRIANGLE
-	if ((buttons >> CB_CIRCLE	) & 1){input.circle 	= true;} // CB_CIRCLE
-	if ((buttons >> CB_CROSS	) & 1){input.cross 		= true;} // CB_CROSS = 14
-	if ((buttons >> CB_SQUARE	) & 1){input.square 	= true;} // CB_SQUARE = 15
+	// buttons are active low on the wire, flip them so a set bit means held
+	input.held = (response[2] | (response[3] << 8)) ^ 0xffff;
 
 	if(respLength == 8) //todo: do we need this to be locked to controller type also?
 	{
 		input.analog_on = true;
-		input.analog_rh = response[4];
-		input.analog_rv = response[5];
-		input.analog_lh = response[6];
-		input.analog_lv = response[7];
-		input.left_x =  (int16_t)input.analog_lh - 0x80;
-		input.left_y =  0x80 - (int16_t)input.analog_lv;
-		input.right_x = (int16_t)input.analog_rh - 0x80;
-		input.right_y = 0x80 - (int16_t)input.analog_rv;
+		// raw bytes are right h, right v, left h, left v
+		input.left_x =  (int16_t)response[6] - 0x80;
+		input.left_y =  0x80 - (int16_t)response[7];
+		input.right_x = (int16_t)response[4] - 0x80;
+		input.right_y = 0x80 - (int16_t)response[5];
 	}
 	else
 	{
 		input.analog_on = false;
 	}
 	return input;
-}
\ No newline at end of file
+}
+
+// per port/slot edge tracking and a short history of recent polls, for input
+// buffering (e.g. accept a jump pressed a few frames before landing)
+#define PAD_HISTORY_SIZE 16 //power of 2, in polls (~frames)
+
+typedef struct {
+	uint16_t held, pressed;
+} PadHistoryEntry;
+
+typedef struct {
+	uint32_t        lastCount; //padLatest count we last updated from
+	uint16_t        held, pressed, released;
+	uint8_t         historyHead;
+	PadHistoryEntry history[PAD_HISTORY_SIZE];
+} PadTracker;
+
+static PadTracker padTrackers[PAD_NUM_PORTS][PAD_NUM_SLOTS];
+
+static PlayerInput ReadLatestPadInput(int port, int slot, uint32_t *count)
+{
+	uint8_t response[PAD_MAX_RESPONSE];
+	int length;
+
+	//copy it out with irqs off so we don't get half of one poll and half of the next
+	int state = enterCriticalSection();
+	length = padLatest[port].length;
+	*count = padLatest[port].count;
+	for (int i = 0; i < length; i++){response[i] = padLatest[port].response[i];}
+	exitCriticalSection(state);
+
+	if (length >= 2 && response[0] == 0x80)
+	{
+		//multitap, 8 bytes per slot after the 2 byte header, each laid out like a normal
+		//controller response. empty slots are all 0xff.
+		if (2 + (slot + 1) * 8 > length){return (PlayerInput) {0};}
+		const uint8_t *slotData = &response[2 + (slot * 8)];
+		int slotLength = 2 + (slotData[0] & 0xf) * 2;
+		return ParsePadResponse(slotData, slotLength > 8 ? 8 : slotLength);
+	}
+
+	if (slot){return (PlayerInput) {0};} //no multitap, only slot A exists
+	return ParsePadResponse(response, length);
+}
+
+/// @brief latest completed poll for a port/multitap slot, never waits on the bus.
+/// pressed/released are against the poll before it, so they stay the same no matter
+/// how many times this gets called until the next poll comes in.
+/// @param port - 0 or 1
+/// @param slot - multitap slot 0-3, use 0 for a controller plugged straight in
+static PlayerInput GetPadInput(int port, int slot)
+{
+	uint32_t count;
+	PlayerInput input = ReadLatestPadInput(port, slot, &count);
+	PadTracker *tracker = &padTrackers[port][slot];
+
+	if (!input.type_ok){input.held = 0;} //unplugged or unsupported, treat as nothing held
+	if (count != tracker->lastCount)
+	{
+		uint16_t previous = tracker->held;
+		tracker->lastCount = count;
+		tracker->held      = input.held;
+		tracker->pressed   = input.held & ~previous;
+		tracker->released  = previous & ~input.held;
+
+		tracker->historyHead = (tracker->historyHead + 1) & (PAD_HISTORY_SIZE - 1);
+		tracker->history[tracker->historyHead] = (PadHistoryEntry) { tracker->held, tracker->pressed };
+	}
+
+	input.pressed  = tracker->pressed;
+	input.released = tracker->released;
+	return input;
+}
+
+/// @brief was any of the buttons in mask pressed in the last `polls` polls (1 = just the latest)
+static bool PadPressedWithin(int port, int slot, uint16_t mask, int polls)
+{
+	const PadTracker *tracker = &padTrackers[port][slot];
+	if (polls > PAD_HISTORY_SIZE){polls = PAD_HISTORY_SIZE;}
+	for (int i = 0; i < polls; i++)
+	{
+		const PadHistoryEntry *entry = &tracker->history[(tracker->historyHead - i) & (PAD_HISTORY_SIZE - 1)];
+		if (entry->pressed & mask){return true;}
+	}
+	return false;
+}
+
+/// @brief held mask from `ago` polls back (0 = latest), for combos/charge moves
+static uint16_t PadHeldAgo(int port, int slot, int ago)
+{
+	const PadTracker *tracker = &padTrackers[port][slot];
+	return tracker->history[(tracker->historyHead - ago) & (PAD_HISTORY_SIZE - 1)].held;
+}
+
+static PlayerInput GetControllerInput(int port)
+{
+	return GetPadInput(port, 0);
+}
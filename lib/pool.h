@@ -0,0 +1,109 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#pragma once
+
+// Fixed size object pools, for stuff we spawn and despawn a lot (projectiles,
+// particles, pickups...) without going anywhere near malloc.
+// - acquire and release are O(1)
+// - alive objects are kept packed at the front of items[], so update loops
+//   just walk items[0..count-1] with no holes to skip
+// - because of that, releasing moves the last alive object into the hole, so
+//   raw pointers into the pool are only good until the next release. Hang on
+//   to a PoolHandle instead, it has a generation counter in it so a handle to
+//   something that got released (and maybe reused) will fail to resolve
+//   instead of silently pointing at the wrong object
+//
+// usage:
+//   DEFINE_POOL(Projectile, Projectile, 64)
+//   static ProjectilePool projectiles;
+//   ProjectilePoolInit(&projectiles);
+//   PoolHandle h;
+//   Projectile *p = ProjectilePoolAcquire(&projectiles, &h);
+//   ...
+//   for (int i = projectiles.count - 1; i >= 0; i--) //backwards so releasing inside the loop is safe
+//   {
+//       if (done){ProjectilePoolRelease(&projectiles, ProjectilePoolHandleAt(&projectiles, i));}
+//   }
+
+//low 16 bits are the slot, high 16 bits are the slot's generation (never 0)
+typedef uint32_t PoolHandle;
+#define POOL_INVALID_HANDLE 0
+
+#define POOL_HANDLE(slot, generation) ((PoolHandle) (((uint32_t) (generation) << 16) | (slot)))
+#define POOL_HANDLE_SLOT(handle)       ((uint16_t) ((handle) & 0xffff))
+#define POOL_HANDLE_GENERATION(handle) ((uint16_t) ((handle) >> 16))
+
+//capacity has to fit in a uint16_t
+#define DEFINE_POOL(Type, Name, Capacity) \
+typedef struct { \
+	Type     items[Capacity];       /* dense, items[0..count-1] are alive */ \
+	uint16_t denseToSlot[Capacity]; /* item index -> slot */ \
+	uint16_t slotToDense[Capacity]; /* slot -> item index */ \
+	uint16_t generation[Capacity];  /* bumped every time the slot is released */ \
+	uint16_t freeSlots[Capacity];   /* stack of unused slots */ \
+	uint16_t count, numFree; \
+} Name##Pool; \
+\
+static void Name##PoolInit(Name##Pool *pool) \
+{ \
+	pool->count   = 0; \
+	pool->numFree = (Capacity); \
+	for (int i = 0; i < (Capacity); i++) \
+	{ \
+		pool->freeSlots[i]  = (uint16_t) ((Capacity) - 1 - i); /* hand out slot 0 first */ \
+		pool->generation[i] = 1; \
+	} \
+} \
+\
+static Type *Name##PoolAcquire(Name##Pool *pool, PoolHandle *handle) \
+{ \
+	if (!pool->numFree) \
+	{ \
+		if (handle){*handle = POOL_INVALID_HANDLE;} \
+		return 0; \
+	} \
+	uint16_t slot  = pool->freeSlots[--pool->numFree]; \
+	uint16_t dense = pool->count++; \
+	pool->denseToSlot[dense] = slot; \
+	pool->slotToDense[slot]  = dense; \
+	pool->items[dense]       = (Type) {0}; \
+	if (handle){*handle = POOL_HANDLE(slot, pool->generation[slot]);} \
+	return &pool->items[dense]; \
+} \
+\
+static Type *Name##PoolGet(Name##Pool *pool, PoolHandle handle) \
+{ \
+	uint16_t slot = POOL_HANDLE_SLOT(handle); \
+	if (slot >= (Capacity) || pool->generation[slot] != POOL_HANDLE_GENERATION(handle)){return 0;} \
+	uint16_t dense = pool->slotToDense[slot]; \
+	if (dense >= pool->count || pool->denseToSlot[dense] != slot){return 0;} \
+	return &pool->items[dense]; \
+} \
+\
+static PoolHandle Name##PoolHandleAt(const Name##Pool *pool, int dense) \
+{ \
+	if (dense < 0 || dense >= pool->count){return POOL_INVALID_HANDLE;} \
+	uint16_t slot = pool->denseToSlot[dense]; \
+	return POOL_HANDLE(slot, pool->generation[slot]); \
+} \
+\
+static bool Name##PoolRelease(Name##Pool *pool, PoolHandle handle) \
+{ \
+	if (!Name##PoolGet(pool, handle)){return false;} /* stale or bogus handle */ \
+	uint16_t slot  = POOL_HANDLE_SLOT(handle); \
+	uint16_t dense = pool->slotToDense[slot]; \
+	uint16_t last  = --pool->count; \
+	/* keep things packed, move the last alive item into the hole */ \
+	if (dense != last) \
+	{ \
+		uint16_t movedSlot         = pool->denseToSlot[last]; \
+		pool->items[dense]         = pool->items[last]; \
+		pool->denseToSlot[dense]   = movedSlot; \
+		pool->slotToDense[movedSlot] = dense; \
+	} \
+	/* invalidate any handles still pointing at this slot, 0 is reserved for invalid */ \
+	if (!++pool->generation[slot]){pool->generation[slot] = 1;} \
+	pool->freeSlots[pool->numFree++] = slot; \
+	return true; \
+}
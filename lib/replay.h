@@ -0,0 +1,229 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "pad.h"
+#include "timer.h"
+
+#pragma once
+
+// Deterministic input recording/replay, so profiling runs follow the exact same
+// camera path every time and numbers can be compared between builds.
+// ReplayInput() stands in for GetControllerInput() and does one of three things
+// depending on replayBuffer.mode:
+// - REPLAY_MODE_OFF:      passthrough, just reads the controller
+// - REPLAY_MODE_RECORD:   reads the controller and appends the result to the buffer,
+//                         when the buffer fills up (or select+start is pressed) it
+//                         gets dumped over serial as hex, see tools/convertReplay.py
+// - REPLAY_MODE_PLAYBACK: ignores the controller and hands back the recorded
+//                         frames instead, then goes back to live input and prints
+//                         "REPLAY DONE" so capture scripts know when to stop
+// The main loop calls it once per simulation step (see sim.h), so one call = one
+// recorded frame and playback stays in step with the game whatever the frame rate.
+// Only call it once per step (per player, only player one is recorded).
+//
+// picking the mode:
+// - at build time, -DREPLAY_RECORD or -DREPLAY_PLAYBACK. Playback plays the
+//   recording linked in as replayData (tools/convertReplay.py + tools/linkData.py)
+// - at run time, build with -DREPLAY_ENABLE (just reserves the buffer) and use
+//   the replayBuffer struct in ram as the switch: break on main in the debugger,
+//   then `restore capture.rpl binary &replayBuffer` loads a recording over it
+//   (magic, mode and all, the file has the same layout), or set .magic and .mode
+//   by hand to start recording. A valid magic overrides the build setting.
+// without any of those defines ReplayInput() is a plain GetControllerInput()
+#define REPLAY_MAGIC      0x594c5052 // "RPLY"
+#define REPLAY_VERSION    1
+#define REPLAY_MAX_FRAMES 7200 //2 minutes at 60fps, 12 bytes each
+#define REPLAY_DUMP_TIMEOUT (TIMER_TICKS_PER_SECOND / 4) //longest ReplayDump waits for tx room before giving up
+
+typedef enum {
+	REPLAY_MODE_OFF      = 0,
+	REPLAY_MODE_RECORD   = 1,
+	REPLAY_MODE_PLAYBACK = 2
+} ReplayMode;
+
+//one frame of PlayerInput, minus the edges (those get recomputed on playback)
+typedef struct {
+	uint16_t held;
+	uint8_t  type;
+	uint8_t  flags; //REPLAY_FLAG_*
+	int16_t  left_x, left_y, right_x, right_y;
+} ReplayFrame;
+
+#define REPLAY_FLAG_CONNECTED 1
+#define REPLAY_FLAG_TYPE_OK   2
+#define REPLAY_FLAG_ANALOG_ON 4
+
+//same layout as the .rpl files convertReplay.py spits out
+typedef struct {
+	uint32_t    magic;
+	uint16_t    version, mode;
+	uint32_t    numFrames;
+	uint32_t    cursor; //next frame to record/play
+	ReplayFrame frames[REPLAY_MAX_FRAMES];
+} ReplayBuffer;
+
+#if defined(REPLAY_ENABLE) || defined(REPLAY_RECORD) || defined(REPLAY_PLAYBACK)
+static ReplayBuffer replayBuffer;
+#else
+//only the header, not worth 86KB of bss when it's not being used
+static struct { uint32_t magic; uint16_t version, mode; uint32_t numFrames, cursor; } replayBuffer;
+#define REPLAY_NO_BUFFER
+#endif
+
+#ifdef REPLAY_PLAYBACK
+//recording to play back, linked in by prep (a .rpl file, so it starts with the header)
+extern const uint8_t replayData[];
+#endif
+
+static uint16_t replayPreviousHeld = 0;
+
+static ReplayFrame *ReplayFrames(void)
+{
+#ifdef REPLAY_NO_BUFFER
+	return 0;
+#else
+	return replayBuffer.frames;
+#endif
+}
+
+/// @brief pick the replay mode, call once at boot after GeneralSetup
+static void ReplayInit(void)
+{
+	if (replayBuffer.magic == REPLAY_MAGIC)
+	{
+		//somebody (the debugger) set things up for us already
+		printf("replay: mode %d from ram, %d frames\n", replayBuffer.mode, (int) replayBuffer.numFrames);
+	}
+	else
+	{
+		replayBuffer.magic     = REPLAY_MAGIC;
+		replayBuffer.version   = REPLAY_VERSION;
+		replayBuffer.mode      = REPLAY_MODE_OFF;
+		replayBuffer.numFrames = 0;
+#if defined(REPLAY_PLAYBACK)
+		const ReplayBuffer *data = (const ReplayBuffer *) replayData;
+		uint32_t numFrames = data->numFrames;
+		if (data->magic == REPLAY_MAGIC && data->version == REPLAY_VERSION)
+		{
+			if (numFrames > REPLAY_MAX_FRAMES){numFrames = REPLAY_MAX_FRAMES;}
+			for (uint32_t i = 0; i < numFrames; i++){replayBuffer.frames[i] = data->frames[i];}
+			replayBuffer.numFrames = numFrames;
+			replayBuffer.mode      = REPLAY_MODE_PLAYBACK;
+		}
+		else
+		{
+			puts("replay: linked replayData is not a valid recording");
+		}
+#elif defined(REPLAY_RECORD)
+		replayBuffer.mode = REPLAY_MODE_RECORD;
+#endif
+	}
+
+	if (!ReplayFrames()){replayBuffer.mode = REPLAY_MODE_OFF;}
+	replayBuffer.cursor = 0;
+	replayPreviousHeld  = 0;
+	if (replayBuffer.mode == REPLAY_MODE_RECORD){replayBuffer.numFrames = 0;}
+}
+
+/// @brief send the recording out over serial as hex lines, blocks until it's all in the tx buffer.
+/// if the port stops draining (flow control on and nothing reading) it gives up waiting after
+/// REPLAY_DUMP_TIMEOUT and drops the rest of the lines instead of hanging the game
+static void ReplayDump(void)
+{
+	const uint8_t *bytes = (const uint8_t *) &replayBuffer;
+	uint32_t length = 16 + replayBuffer.numFrames * sizeof(ReplayFrame); //header + used frames
+
+	//mode gets saved as playback so the file can be restored straight over replayBuffer
+	uint16_t mode = replayBuffer.mode;
+	replayBuffer.mode = REPLAY_MODE_PLAYBACK;
+	replayBuffer.cursor = 0;
+
+	printf("REPLAY BEGIN %d\n", (int) length);
+	int dropped = 0;
+	for (uint32_t offset = 0; offset < length; offset += 32)
+	{
+		char line[72];
+		char *ptr = line;
+		for (uint32_t i = offset; i < offset + 32 && i < length; i++){ptr += sprintf(ptr, "%02x", bytes[i]);}
+		*(ptr++) = '\n';
+
+		//the tx buffer drops whatever doesn't fit, so wait for room rather than lose lines
+		uint32_t start = ReadTimebase();
+		while (!dropped && getSerialTXSpace() < (size_t) (ptr - line))
+		{
+			if (ReadTimebase() - start > REPLAY_DUMP_TIMEOUT){break;}
+		}
+		if (getSerialTXSpace() < (size_t) (ptr - line)){dropped++; continue;}
+		_serialWrite(line, ptr - line);
+	}
+	puts("REPLAY END");
+	if (dropped){printf("replay: serial port stalled, %d lines dropped\n", dropped);}
+
+	replayBuffer.mode = mode;
+}
+
+static void ReplayStopRecording(void)
+{
+	printf("replay: recorded %d frames\n", (int) replayBuffer.numFrames);
+	ReplayDump();
+	replayBuffer.mode = REPLAY_MODE_OFF;
+}
+
+/// @brief GetControllerInput() that records or plays back, see the top of the file
+static PlayerInput ReplayInput(int port)
+{
+	ReplayFrame *frames = ReplayFrames();
+
+	if (replayBuffer.mode == REPLAY_MODE_PLAYBACK)
+	{
+		if (replayBuffer.cursor >= replayBuffer.numFrames)
+		{
+			printf("REPLAY DONE %d\n", (int) replayBuffer.numFrames);
+			replayBuffer.mode = REPLAY_MODE_OFF;
+		}
+		else
+		{
+			const ReplayFrame *frame = &frames[replayBuffer.cursor++];
+			PlayerInput input = {0};
+			input.held      = frame->held;
+			input.pressed   = frame->held & ~replayPreviousHeld;
+			input.released  = replayPreviousHeld & ~frame->held;
+			input.type      = frame->type;
+			input.connected = (frame->flags & REPLAY_FLAG_CONNECTED) != 0;
+			input.type_ok   = (frame->flags & REPLAY_FLAG_TYPE_OK) != 0;
+			input.analog_on = (frame->flags & REPLAY_FLAG_ANALOG_ON) != 0;
+			input.left_x    = frame->left_x;
+			input.left_y    = frame->left_y;
+			input.right_x   = frame->right_x;
+			input.right_y   = frame->right_y;
+			replayPreviousHeld = frame->held;
+			return input;
+		}
+	}
+
+	PlayerInput input = GetControllerInput(port);
+
+	if (replayBuffer.mode == REPLAY_MODE_RECORD)
+	{
+		if ((input.held & (BTN_SELECT | BTN_START)) == (BTN_SELECT | BTN_START) && (input.pressed & (BTN_SELECT | BTN_START)))
+		{
+			ReplayStopRecording();
+			return input;
+		}
+
+		ReplayFrame *frame = &frames[replayBuffer.numFrames++];
+		frame->held    = input.held;
+		frame->type    = input.type;
+		frame->flags   = (input.connected ? REPLAY_FLAG_CONNECTED : 0)
+			| (input.type_ok ? REPLAY_FLAG_TYPE_OK : 0)
+			| (input.analog_on ? REPLAY_FLAG_ANALOG_ON : 0);
+		frame->left_x  = input.left_x;
+		frame->left_y  = input.left_y;
+		frame->right_x = input.right_x;
+		frame->right_y = input.right_y;
+
+		if (replayBuffer.numFrames >= REPLAY_MAX_FRAMES){ReplayStopRecording();}
+	}
+
+	return input;
+}
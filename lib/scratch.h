@@ -0,0 +1,103 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#pragma once
+
+// Per-frame linear scratch memory. There is one region per in-flight frame
+// (same as the dma chains), anything allocated from it lives until the next
+// time that frame's region gets reset, which is 2 frames later. That means the
+// gpu can still be reading stuff (packets, clipped tris, etc) out of the
+// previous frame's region while we fill up the current one.
+// - allocating is a pointer bump, freeing is free (it all goes away on reset)
+// - don't keep pointers into it across frames!
+#define FRAME_SCRATCH_SIZE  32768 //bytes per frame region, tune with the high water mark
+#define FRAME_SCRATCH_COUNT 2     //matches dmaChains[2] in main.c
+#define FRAME_SCRATCH_ALIGN 8
+
+typedef struct {
+	uint8_t *next;      //next free byte
+	uint8_t *end;       //one past the last usable byte
+	size_t   used;      //bytes handed out this frame (includes alignment padding)
+	size_t   highWater; //most bytes this region has ever had in use in a single frame
+	uint32_t failed;    //allocations that didn't fit this frame
+} FrameScratch;
+
+static uint8_t frameScratchData[FRAME_SCRATCH_COUNT][FRAME_SCRATCH_SIZE]
+	__attribute__((aligned(FRAME_SCRATCH_ALIGN)));
+static FrameScratch frameScratch[FRAME_SCRATCH_COUNT];
+static FrameScratch *currentScratch = NULL;
+
+/// @brief reset a frame's scratch region and make it the current one, call this
+/// where main.c swaps usingSecondFrame (same index as the dma chain being built)
+/// @param frame - which region (0 or 1)
+static void FrameScratchBegin(int frame)
+{
+	FrameScratch *scratch = &frameScratch[frame];
+	//record the high water mark of whatever was in this region before we throw it away
+	if (scratch->used > scratch->highWater){scratch->highWater = scratch->used;}
+
+	scratch->next   = frameScratchData[frame];
+	scratch->end    = &frameScratchData[frame][FRAME_SCRATCH_SIZE];
+	scratch->used   = 0;
+	scratch->failed = 0;
+	currentScratch  = scratch;
+}
+
+/// @brief grab some bytes from the current frame's scratch region
+/// @param size - number of bytes
+/// @return pointer aligned to FRAME_SCRATCH_ALIGN, or NULL if the region is full
+static void *FrameAlloc(size_t size)
+{
+	FrameScratch *scratch = currentScratch;
+	size_t _size = (size + (FRAME_SCRATCH_ALIGN - 1)) & ~(FRAME_SCRATCH_ALIGN - 1);
+
+	if (!scratch || _size > (size_t)(scratch->end - scratch->next))
+	{
+		if (scratch){scratch->failed++;}
+		return NULL;
+	}
+
+	void *ptr = scratch->next;
+	scratch->next += _size;
+	scratch->used += _size;
+	return ptr;
+}
+
+//typed helper, FRAME_ALLOC(GTEVector16, 6) etc
+#define FRAME_ALLOC(type, count) ((type *) FrameAlloc(sizeof(type) * (count)))
+
+/// @brief bytes left in the current frame's region
+static size_t FrameScratchRemaining(void)
+{
+	if (!currentScratch){return 0;}
+	return (size_t)(currentScratch->end - currentScratch->next);
+}
+
+/// @brief highest usage seen in any single frame so far (includes the current frame)
+static size_t FrameScratchHighWater(void)
+{
+	size_t highWater = 0;
+	for (int i = 0; i < FRAME_SCRATCH_COUNT; i++)
+	{
+		const FrameScratch *scratch = &frameScratch[i];
+		if (scratch->highWater > highWater){highWater = scratch->highWater;}
+		if (scratch->used > highWater){highWater = scratch->used;}
+	}
+	return highWater;
+}
+
+/// @brief print the per frame region usage over serial, for tuning FRAME_SCRATCH_SIZE
+static void LogFrameScratch(void)
+{
+	for (int i = 0; i < FRAME_SCRATCH_COUNT; i++)
+	{
+		const FrameScratch *scratch = &frameScratch[i];
+		printf(
+			"scratch %d: used %d, high water %d / %d, failed %d\n",
+			i, (int) scratch->used, (int) scratch->highWater,
+			FRAME_SCRATCH_SIZE, (int) scratch->failed
+		);
+	}
+}
@@ -1,11 +1,21 @@
+#include <heap.h>
 #include "../ps1/cop0.h"
 #include "../ps1/gpucmd.h"
 #include "../ps1/gte.h"
 #include "../ps1/registers.h"
+#include "../ps1/system.h"
+#include "../lib/cd.h"
 #include "../lib/gpu.h"
+#include "../lib/iso.h"
+#include "../lib/mdec.h"
 #include "../lib/draw.h"
 #include "../lib/pad.h"
+#include "../lib/sim.h"
+#include "../lib/sound.h"
+#include "../lib/texcache.h"
+#include "../lib/vram.h"
 #include "font.h"
+#include "timer.h"
 
 #pragma once
 
@@ -13,10 +23,19 @@ static void GeneralSetup()
 {
     //init stuff
 	initSerialIO(115200);
+	//take over the exception vector so drivers can use irqs, then stop printf from stalling on the serial port
+	installExceptionHandler();
+	enableSerialBuffering();
+	InitTimer();
 	initControllerBus();
+	if (!initCD()){puts("CD-ROM drive not responding");}
+	//scan the disc's directories once so file lookups never have to touch the drive again
+	else if (!buildISOIndex()){puts("no ISO9660 filesystem on disc, file index is empty");}
+	printf("RAM: %d KB, heap limit %08x, stack %d bytes\n", getRAMSize() / 1024, (uint32_t) getHeapLimit(), getStackSize());
 	
 	//setup gpu
-	if ((GPU_GP1 & GP1_STAT_FB_MODE_BITMASK) == GP1_STAT_FB_MODE_PAL)
+	bool pal = (GPU_GP1 & GP1_STAT_FB_MODE_BITMASK) == GP1_STAT_FB_MODE_PAL;
+	if (pal)
 	{
 		puts("Using PAL mode");
 		setupGPU(GP1_MODE_PAL, SCREEN_WIDTH, SCREEN_HEIGHT);
@@ -27,6 +46,12 @@ static void GeneralSetup()
 		setupGPU(GP1_MODE_NTSC, SCREEN_WIDTH, SCREEN_HEIGHT);
 	}
 
+	//mdec tables, backgrounds and fmv decode through it (see mdec.h)
+	setupMDEC();
+
+	//spu and voice allocator, load sounds with SoundLoad (see sound.h)
+	SoundInit();
+
 	//setup gte
 	setupGTE(SCREEN_WIDTH, SCREEN_HEIGHT);
 
@@ -36,33 +61,17 @@ static void GeneralSetup()
 	GPU_GP1 = gp1_dmaRequestMode(GP1_DREQ_GP0_WRITE);
 	GPU_GP1 = gp1_dispBlank(false);
 
-	int double_screen = SCREEN_WIDTH << 1;
-	//font texture
-	uploadIndexedTexture(
-		&font,
-		fontTexture,
-		fontPalette,
-		double_screen,
-		0,
-		double_screen,
-		FONT_HEIGHT,
-		FONT_WIDTH,
-		FONT_HEIGHT,
-		FONT_COLOR_DEPTH
-	);
-	int offset_from_font = FONT_HEIGHT+16; //(16 is a guess for font palette size)
-	//todo: i need a way to track this and uise the space efficiently but automatically know what x and y's to use
-	//player texture
-	uploadIndexedTexture(
-		&playerTextInfo,
-		playerTexture,
-		playerPalette,
-		double_screen,
-		offset_from_font, 
-		double_screen,
-		offset_from_font + 64, //my image is 64x64, we are storing straight down (probably wastes some x space), so x is same as font, but y needs to be adjusted 
-		64,
-		64,
-		GP0_COLOR_4BPP
-	);
+	//textures, the allocator picks where they go in vram (and where their palettes go)
+	VramInit(SCREEN_WIDTH, SCREEN_HEIGHT);
+	VramUploadTexture(&font, fontTexture, fontPalette, FONT_WIDTH, FONT_HEIGHT, FONT_COLOR_DEPTH, "font");
+	VramUploadTexture(&playerTextInfo, playerTexture, playerPalette, 64, 64, GP0_COLOR_4BPP, "player");
+	//anything that doesn't need to stay resident goes through the texture cache instead, it
+	//gets whatever vram is left over (register with TexCacheAddAsset, set DrawObj.textureId)
+	TexCacheInit();
+#ifdef VRAM_DUMP
+	VramDump();
+#endif
+
+	//game speed comes from the timer from here on, not from how many frames got drawn (see sim.h)
+	SimInit(pal);
 }
\ No newline at end of file
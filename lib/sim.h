@@ -0,0 +1,105 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "gpu.h"
+#include "timer.h"
+#include "../ps1/registers.h"
+
+#pragma once
+
+// Fixed timestep simulation, so game speed doesn't depend on the frame rate.
+// - game logic runs in steps of exactly 1/SIM_TICKS_PER_SECOND, SimBeginFrame works out how
+//   many steps are due from the timebase (timer.h) and the main loop runs that many, so PAL
+//   (50 hz) runs the same game as NTSC (60 hz) and a slow frame gets caught up next frame
+// - at most SIM_MAX_STEPS run per frame, anything past that is dropped so one really slow
+//   frame (loading, a huge scene) makes the game slow down for a moment instead of spiraling
+// - frames that took almost exactly a whole number of steps are snapped to it, so NTSC's
+//   ~59.8 hz refresh doesn't turn into a double step every few seconds
+// - build with -DLOCK_30FPS to only flip every other vblank (25 fps on PAL), heavy scenes
+//   then get a steady frame rate instead of bouncing between 60 and 30
+#define SIM_TICKS_PER_SECOND 60
+#define SIM_MAX_STEPS        4
+#ifdef LOCK_30FPS
+#define SIM_VSYNCS_PER_FRAME 2
+#else
+#define SIM_VSYNCS_PER_FRAME 1
+#endif
+
+typedef struct {
+	uint32_t tickLength;     //timer ticks per step
+	uint32_t vsyncLength;    //timer ticks per vblank
+	uint32_t last;           //timebase at the last SimBeginFrame
+	uint32_t accumulator;    //timer ticks not simulated yet
+	uint32_t lastFlip;       //timebase at the last SimWaitVSync
+	uint32_t steps;          //total, since SimInit
+	uint16_t dropped;        //steps thrown away by the catch-up limit, since the last SimLog
+	uint8_t  vsyncsPerFrame;
+	bool     pal;
+} SimClock;
+
+static SimClock sim;
+
+/// @brief call once the gpu is set up and the timer is running
+/// @param pal - video mode, decides how long a vblank is
+static void SimInit(bool pal)
+{
+	sim.tickLength = TIMER_TICKS_PER_SECOND / SIM_TICKS_PER_SECOND;
+	sim.vsyncLength = TIMER_TICKS_PER_SECOND / (pal ? 50 : 60);
+	sim.last = ReadTimebase();
+	sim.lastFlip = sim.last;
+	sim.accumulator = 0;
+	sim.steps = 0;
+	sim.dropped = 0;
+	sim.vsyncsPerFrame = SIM_VSYNCS_PER_FRAME;
+	sim.pal = pal;
+	printf("sim: %d steps/s, display %d fps\n", SIM_TICKS_PER_SECOND, (pal ? 50 : 60) / SIM_VSYNCS_PER_FRAME);
+}
+
+/// @brief call at the start of every frame
+/// @return how many steps of game logic to run this frame (0 to SIM_MAX_STEPS)
+static int SimBeginFrame(void)
+{
+	uint32_t now = ReadTimebase();
+	uint32_t delta = now - sim.last;
+	sim.last = now;
+
+	uint32_t whole = (delta + sim.tickLength / 2) / sim.tickLength;
+	int32_t error = (int32_t) (delta - whole * sim.tickLength);
+	if (whole && error > -(int32_t) (sim.tickLength / 64) && error < (int32_t) (sim.tickLength / 64)){delta = whole * sim.tickLength;}
+
+	sim.accumulator += delta;
+	uint32_t steps = sim.accumulator / sim.tickLength;
+	if (steps > SIM_MAX_STEPS)
+	{
+		sim.dropped += steps - SIM_MAX_STEPS;
+		steps = SIM_MAX_STEPS;
+	}
+	sim.accumulator -= steps * sim.tickLength;
+	if (sim.accumulator >= sim.tickLength){sim.accumulator %= sim.tickLength;} //only left over when steps got dropped
+	sim.steps += steps;
+	return steps;
+}
+
+/// @brief stands in for waitForVSync, waits for the vblank the frame should be shown on
+static void SimWaitVSync(void)
+{
+	//the vsync irq flag only says "at least one vblank since it was cleared", so work out from
+	//the timebase how many actually went by since the last flip
+	uint32_t passed = (ReadTimebase() - sim.lastFlip) / sim.vsyncLength;
+	int wait = sim.vsyncsPerFrame - (int) passed;
+	if (wait <= 0){waitForVSync();} //late already, take the vblank that's pending (same as unlocked)
+	else
+	{
+		//the flag is still up from a vblank we're not flipping on, throw it away
+		if (passed){IRQ_STAT = ~(1 << IRQ_VSYNC);}
+		while (wait--){waitForVSync();}
+	}
+	sim.lastFlip = ReadTimebase();
+}
+
+/// @brief print step counters over serial, then reset the dropped count
+static void SimLog(void)
+{
+	printf("sim: %d steps, %d dropped\n", (int) sim.steps, sim.dropped);
+	sim.dropped = 0;
+}
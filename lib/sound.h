@@ -0,0 +1,218 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "cd.h"
+#include "iso.h"
+#include "spu.h"
+#include "../ps1/registers.h"
+
+#pragma once
+
+// Sound effects on top of the spu driver.
+// - samples are .vag files from tools/convertAudio.py, SoundLoad copies them into spu ram
+//   (by dma) once, after that they cost nothing in main ram
+// - SoundPlay picks a voice and sets it up, but key on/off only gets written once a frame
+//   by SoundUpdate, so playing a sound is a handful of register writes and the spu does
+//   the rest (no per sample cpu work at all)
+// - when all 24 voices are busy, a new sound steals the lowest priority one (oldest first
+//   among equals) as long as it isn't more important than the new one, otherwise it's dropped
+// - music is xa-adpcm from tools/buildXA.py, streamed and decoded by the cd drive itself
+//   and mixed in by the spu, so it needs no ram and no voices. the drive is busy with it
+//   while it plays though, so disc reads (archive loads, world cells) fail until MusicStop
+#define SOUND_PAN_CENTER 0
+
+typedef struct {
+	uint32_t addr;   //in spu ram
+	uint32_t length; //bytes of adpcm data
+	uint16_t pitch;
+	bool     loops;  //has a loop point, keeps playing until stopped
+} Sound;
+
+typedef struct {
+	const Sound *sound;
+	uint8_t     priority;
+	uint32_t    started; //frame it was started on
+} SoundVoice;
+
+typedef struct {
+	SoundVoice voices[SPU_NUM_VOICES];
+	uint32_t   busy; //bit per voice
+	uint32_t   pendingOn, pendingOff; //written out by the next SoundUpdate
+	uint32_t   ramNext; //next free spu ram address
+	uint32_t   frame;
+	uint16_t   plays, steals, drops; //since the last SoundLog
+	int        musicVolume;
+} SoundEngine;
+
+static SoundEngine sound;
+
+static void SoundInit(void)
+{
+	setupSPU();
+	sound = (SoundEngine) {0};
+	sound.ramNext = SPU_RAM_USER_START;
+	sound.musicVolume = SPU_MAX_VOLUME;
+}
+
+/// @brief upload a .vag file to spu ram, the file can be freed afterwards
+/// @return false if the file isn't a .vag or spu ram is full
+static bool SoundLoad(Sound *snd, const void *vagFile)
+{
+	const void *data;
+	size_t length;
+	uint32_t sampleRate = parseVAGHeader(vagFile, &data, &length);
+	if (!sampleRate){puts("sound: not a .vag file"); return false;}
+
+	uint32_t size = (length + SPU_DMA_BLOCK_SIZE - 1) & ~(SPU_DMA_BLOCK_SIZE - 1);
+	if (sound.ramNext + size > SPU_RAM_SIZE){printf("sound: out of spu ram (%d bytes)\n", (int) length); return false;}
+
+	snd->addr = sound.ramNext;
+	snd->length = length;
+	snd->pitch = getSPUPitch(sampleRate);
+	//bit 1 of a block's flags (second byte) means jump back to the loop start at the end
+	snd->loops = false;
+	const uint8_t *blocks = (const uint8_t *) data;
+	for (uint32_t i = 0; i < length; i += 16){if (blocks[i + 1] & 2){snd->loops = true; break;}}
+
+	startSPUUpload(snd->addr, data, length);
+	waitForSPUUpload();
+	sound.ramNext += size;
+	return true;
+}
+
+/// @brief forget every loaded sound (between levels), stops everything too
+static void SoundUnloadAll(void)
+{
+	sound.pendingOff |= sound.busy;
+	sound.pendingOn = 0;
+	sound.busy = 0;
+	sound.ramNext = SPU_RAM_USER_START;
+}
+
+/// @brief pick a voice for a new sound: a free one, or else steal one
+/// @return voice index, -1 if everything playing is more important
+static int SoundAllocVoice(uint8_t priority)
+{
+	int victim = -1;
+	for (int i = 0; i < SPU_NUM_VOICES; i++)
+	{
+		if (!(sound.busy & (1 << i))){return i;}
+		SoundVoice *voice = &sound.voices[i];
+		if (voice->priority > priority){continue;}
+		if (victim < 0){victim = i; continue;}
+		SoundVoice *best = &sound.voices[victim];
+		if (voice->priority < best->priority || (voice->priority == best->priority && voice->started < best->started)){victim = i;}
+	}
+	if (victim >= 0){sound.steals++;}
+	return victim;
+}
+
+/// @brief start a sound, it actually starts at the next SoundUpdate
+/// @param priority - higher is more important
+/// @param volume - 0 to SPU_MAX_VOLUME
+/// @param pan - -128 (left) to 127 (right)
+/// @return the voice it's playing on (for SoundStop), -1 if it was dropped
+static int SoundPlay(const Sound *snd, uint8_t priority, int volume, int pan)
+{
+	int index = SoundAllocVoice(priority);
+	if (index < 0){sound.drops++; return -1;}
+
+	SoundVoice *voice = &sound.voices[index];
+	voice->sound = snd;
+	voice->priority = priority;
+	voice->started = sound.frame;
+
+	int left = (volume * (128 - pan)) >> 7, right = (volume * (128 + pan)) >> 7;
+	SPU_CH_VOLL(index) = (left > SPU_MAX_VOLUME) ? SPU_MAX_VOLUME : left;
+	SPU_CH_VOLR(index) = (right > SPU_MAX_VOLUME) ? SPU_MAX_VOLUME : right;
+	SPU_CH_PITCH(index) = snd->pitch;
+	SPU_CH_SSA(index) = snd->addr / 8;
+
+	sound.busy |= 1 << index;
+	sound.pendingOn |= 1 << index;
+	sound.pendingOff &= ~(1 << index);
+	sound.plays++;
+	return index;
+}
+
+/// @brief stop a voice returned by SoundPlay (needed for looping sounds). give looping sounds a
+/// high enough priority that nothing steals their voice, or this stops whatever stole it
+static void SoundStop(int index)
+{
+	if (index < 0 || index >= SPU_NUM_VOICES){return;}
+	sound.busy &= ~(1 << index);
+	if (sound.pendingOn & (1 << index)){sound.pendingOn &= ~(1 << index); return;} //never started
+	sound.pendingOff |= 1 << index;
+}
+
+/// @brief call once a frame, writes out all key on/offs at once and frees finished voices
+static void SoundUpdate(void)
+{
+	sound.frame++;
+
+	//end flags get set when a voice reaches the last block of a sample (and reset on key on),
+	//looping sounds set them every time around so they only stop when told to
+	uint32_t ended = SPU_ENDX0 | (SPU_ENDX1 << 16);
+	for (int i = 0; i < SPU_NUM_VOICES; i++)
+	{
+		uint32_t bit = 1 << i;
+		if ((ended & bit) && !(sound.pendingOn & bit) && sound.voices[i].sound && !sound.voices[i].sound->loops){sound.busy &= ~bit;}
+	}
+
+	if (sound.pendingOff)
+	{
+		SPU_KOFF0 = sound.pendingOff & 0xffff;
+		SPU_KOFF1 = sound.pendingOff >> 16;
+		sound.pendingOff = 0;
+	}
+	if (sound.pendingOn)
+	{
+		SPU_KON0 = sound.pendingOn & 0xffff;
+		SPU_KON1 = sound.pendingOn >> 16;
+		sound.pendingOn = 0;
+	}
+}
+
+/// @brief start streaming music, playing it again just switches channel
+/// @param path - .xa file on disc (needs the iso index, see iso.h)
+/// @param channel - which of the file's interleaved tracks to play
+/// @return false if the file isn't on the disc or the drive is busy loading something
+static bool MusicPlay(const char *path, int channel, bool loop)
+{
+	const ISOIndexEntry *entry = findISOFile(path);
+	if (!entry){printf("music: %s not found\n", path); return false;}
+	setSPUCDVolume(sound.musicVolume, sound.musicVolume);
+	//file number 1 is what buildXA.py writes unless told otherwise
+	return playCDXA(entry->lba, 1, channel, loop);
+}
+
+/// @brief switch tracks without a gap, the stream keeps going
+static void MusicSetChannel(int channel){setCDXAChannel(channel);}
+
+static void MusicStop(void)
+{
+	stopCDXA();
+	setSPUCDVolume(0, 0);
+}
+
+/// @param volume - 0 to SPU_MAX_VOLUME
+static void MusicSetVolume(int volume)
+{
+	sound.musicVolume = volume;
+	if (isCDXAPlaying()){setSPUCDVolume(volume, volume);}
+}
+
+/// @brief print voice usage and counters over serial, then reset the counters
+static void SoundLog(void)
+{
+	int busy = 0;
+	for (int i = 0; i < SPU_NUM_VOICES; i++){if (sound.busy & (1 << i)){busy++;}}
+	printf(
+		"sound: %d/%d voices, %d plays, %d steals, %d drops, %d KB spu ram free\n",
+		busy, SPU_NUM_VOICES, sound.plays, sound.steals, sound.drops,
+		(int) (SPU_RAM_SIZE - sound.ramNext) / 1024
+	);
+	sound.plays = 0;
+	sound.steals = 0;
+	sound.drops = 0;
+}
@@ -0,0 +1,162 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "spu.h"
+#include "../ps1/registers.h"
+
+#define DMA_CHUNK_SIZE (SPU_DMA_BLOCK_SIZE / 4)
+#define VOICE_MASK     ((1 << SPU_NUM_VOICES) - 1)
+
+static const uint8_t _dummyBlock[SPU_DMA_BLOCK_SIZE]
+	__attribute__((aligned(4))) = {
+	// Silent ADPCM block with the loop start, loop end and repeat flags set,
+	// so a voice playing it loops on it forever.
+	0x00, 0x07
+};
+
+static uint16_t _ctrl = 0;
+
+static uint32_t _swapEndian(uint32_t value) {
+	return 0
+		| ((value >> 24) & 0x000000ff)
+		| ((value >>  8) & 0x0000ff00)
+		| ((value <<  8) & 0x00ff0000)
+		| ((value << 24) & 0xff000000);
+}
+
+static void _setTransferMode(uint16_t mode) {
+	_ctrl    = (_ctrl & ~SPU_CTRL_XFER_BITMASK) | mode;
+	SPU_CTRL = _ctrl;
+
+	// The status register reflects the new mode once the SPU is ready for it.
+	while ((SPU_STAT & SPU_STAT_XFER_BITMASK) != mode)
+		__asm__ volatile("");
+}
+
+/* Public API */
+
+void setupSPU(void) {
+	BIU_DEV4_CTRL = 0
+		| ( 1 <<  0) // Write delay
+		| (14 <<  4) // Read delay
+		| BIU_CTRL_RECOVERY
+		| BIU_CTRL_WIDTH_16
+		| BIU_CTRL_AUTO_INCR
+		| ( 9 << 16) // Number of address lines
+		| ( 0 << 24) // DMA read/write delay
+		| BIU_CTRL_DMA_DELAY;
+
+	_ctrl    = 0;
+	SPU_CTRL = 0;
+
+	while (SPU_STAT & 0x3f)
+		__asm__ volatile("");
+
+	SPU_MVOLL = 0;
+	SPU_MVOLR = 0;
+	SPU_EVOLL = 0;
+	SPU_EVOLR = 0;
+	SPU_AVOLL = 0;
+	SPU_AVOLR = 0;
+	SPU_BVOLL = 0;
+	SPU_BVOLR = 0;
+
+	SPU_KOFF0 = VOICE_MASK & 0xffff;
+	SPU_KOFF1 = VOICE_MASK >> 16;
+	SPU_PMON0 = 0;
+	SPU_PMON1 = 0;
+	SPU_NON0  = 0;
+	SPU_NON1  = 0;
+	SPU_EON0  = 0;
+	SPU_EON1  = 0;
+
+	// Normal (non-interleaved) transfers through the FIFO.
+	SPU_FIFO_CTRL = 4;
+
+	_ctrl    = SPU_CTRL_ENABLE;
+	SPU_CTRL = _ctrl;
+
+	DMA_DPCR |= DMA_DPCR_CH_ENABLE(DMA_SPU);
+
+	startSPUUpload(SPU_RAM_DUMMY, _dummyBlock, sizeof(_dummyBlock));
+	waitForSPUUpload();
+
+	for (int i = 0; i < SPU_NUM_VOICES; i++) {
+		SPU_CH_VOLL (i) = 0;
+		SPU_CH_VOLR (i) = 0;
+		SPU_CH_PITCH(i) = 0;
+		SPU_CH_SSA  (i) = SPU_RAM_DUMMY / 8;
+		SPU_CH_ADSR1(i) = 0x00ff;
+		SPU_CH_ADSR2(i) = 0x0000;
+	}
+
+	// Start all voices on the silent block, so that they all have valid loop
+	// addresses and their end flags get set.
+	SPU_KON0 = VOICE_MASK & 0xffff;
+	SPU_KON1 = VOICE_MASK >> 16;
+
+	_ctrl |= SPU_CTRL_DAC_ENABLE;
+	SPU_CTRL  = _ctrl;
+	SPU_MVOLL = SPU_MAX_VOLUME;
+	SPU_MVOLR = SPU_MAX_VOLUME;
+}
+
+void startSPUUpload(uint32_t offset, const void *data, size_t length) {
+	assert(!(offset % 8) && !((uint32_t) data % 4));
+	assert((offset + length) <= SPU_RAM_SIZE);
+
+	size_t numChunks =
+		(length + SPU_DMA_BLOCK_SIZE - 1) / SPU_DMA_BLOCK_SIZE;
+
+	waitForSPUUpload();
+	_setTransferMode(SPU_CTRL_XFER_NONE);
+
+	SPU_TSA = offset / 8;
+	_setTransferMode(SPU_CTRL_XFER_DMA_WRITE);
+
+	DMA_MADR(DMA_SPU) = (uint32_t) data;
+	DMA_BCR (DMA_SPU) = DMA_CHUNK_SIZE | (numChunks << 16);
+	DMA_CHCR(DMA_SPU) = 0
+		| DMA_CHCR_WRITE
+		| DMA_CHCR_MODE_SLICE
+		| DMA_CHCR_ENABLE;
+}
+
+bool isSPUUploadDone(void) {
+	return !(DMA_CHCR(DMA_SPU) & DMA_CHCR_ENABLE);
+}
+
+void waitForSPUUpload(void) {
+	while (!isSPUUploadDone())
+		__asm__ volatile("");
+}
+
+uint16_t getSPUPitch(uint32_t sampleRate) {
+	uint32_t pitch = (sampleRate << 12) / 44100;
+
+	return (pitch > SPU_MAX_PITCH) ? SPU_MAX_PITCH : pitch;
+}
+
+void setSPUCDVolume(uint16_t left, uint16_t right) {
+	SPU_AVOLL = left;
+	SPU_AVOLR = right;
+
+	if (left || right)
+		_ctrl |= SPU_CTRL_I2SA_ENABLE;
+	else
+		_ctrl &= ~SPU_CTRL_I2SA_ENABLE;
+
+	SPU_CTRL = _ctrl;
+}
+
+uint32_t parseVAGHeader(const void *file, const void **data, size_t *length) {
+	const VAGHeader *header = (const VAGHeader *) file;
+
+	if (header->magic != VAG_MAGIC)
+		return 0;
+
+	*data   = &header[1];
+	*length = _swapEndian(header->dataLength);
+	return _swapEndian(header->sampleRate);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Low-level SPU driver. The first 4 KB of SPU RAM are used by the hardware as
+// capture buffers (CD audio and voices 1 and 3), followed by a single silent
+// looping ADPCM block (padded to a DMA block) all idle voices are pointed at;
+// everything from SPU_RAM_USER_START onwards is free for samples. Samples are
+// uploaded by DMA, in 64 byte blocks.
+
+#define SPU_NUM_VOICES     24
+#define SPU_RAM_SIZE       0x80000
+#define SPU_RAM_DUMMY      0x1000
+#define SPU_RAM_USER_START 0x1040
+#define SPU_DMA_BLOCK_SIZE 64
+#define SPU_MAX_VOLUME     0x3fff
+#define SPU_MAX_PITCH      0x3fff
+
+// Standard .vag file header, as generated by tools/convertAudio.py. All fields
+// are big endian.
+typedef struct {
+	uint32_t magic, version, _reserved;
+	uint32_t dataLength, sampleRate;
+	uint8_t  _reserved2[12];
+	char     name[16];
+} VAGHeader;
+
+#define VAG_MAGIC 0x70474156 // "VAGp"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Resets the SPU, silences all voices and enables the DMA channel.
+ * Requires installExceptionHandler() to have been called beforehand.
+ */
+void setupSPU(void);
+
+/**
+ * @brief Starts uploading the given data to SPU RAM and returns immediately.
+ * The length is rounded up to SPU_DMA_BLOCK_SIZE; the data must stay valid
+ * until isSPUUploadDone() returns true.
+ *
+ * @param offset Destination address in SPU RAM, must be a multiple of 8
+ * @param data Source data, must be 4-byte aligned
+ * @param length
+ */
+void startSPUUpload(uint32_t offset, const void *data, size_t length);
+bool isSPUUploadDone(void);
+void waitForSPUUpload(void);
+
+/**
+ * @brief Converts a sample rate in Hz into a value for SPU_CH_PITCH.
+ */
+uint16_t getSPUPitch(uint32_t sampleRate);
+
+/**
+ * @brief Sets the volume of the CD audio input (XA-ADPCM and CD-DA, mixed in
+ * by the SPU with no CPU involvement), enabling or disabling the input as
+ * needed.
+ *
+ * @param left 0 to SPU_MAX_VOLUME, 0 disables the input
+ * @param right
+ */
+void setSPUCDVolume(uint16_t left, uint16_t right);
+
+/**
+ * @brief Returns the sample rate stored in a .vag header and a pointer to the
+ * ADPCM data following it, or 0 if the header is not valid.
+ */
+uint32_t parseVAGHeader(const void *file, const void **data, size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
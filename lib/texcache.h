@@ -0,0 +1,205 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "gpu.h"
+#include "vram.h"
+#include "../ps1/gpucmd.h"
+
+#pragma once
+
+// VRAM texture cache, for when there are more textures than fit in vram at once.
+// - textures are registered up front as assets (image and palette stay in main ram,
+//   linked in or loaded from disc), which gives them an id
+// - DrawObject asks the cache for the id's TextureInfo while building the frame, a miss
+//   allocates room from the vram allocator and queues the upload
+// - when the allocator is out of room the least recently used texture gets evicted, but
+//   never one used this frame since the chain being built still points at it
+// - uploads go through the gpu queue, sendLinkedList waits for the queue to drain so
+//   they always land before the frame that needed them gets drawn
+#define TEXCACHE_MAX_ASSETS  128
+#define TEXCACHE_MAX_ENTRIES 48
+#define TEXCACHE_NONE        0 //id 0 means "not a cached texture"
+
+typedef struct {
+	const void *image;
+	const void *palette;
+	uint16_t   width, height; //texels
+	uint8_t    depth;
+	const char *tag; //shows up in VramDump, string literal or NULL
+} TexCacheAsset;
+
+typedef struct {
+	uint16_t    id; //TEXCACHE_NONE if the entry is unused
+	uint32_t    lastUsed; //frame this was last referenced
+	VramRect    image, clut; //clut.h = 0 for 16bpp
+	TextureInfo info;
+} TexCacheEntry;
+
+typedef struct {
+	uint16_t hits, misses, evictions;
+	uint32_t uploadBytes;
+} TexCacheStats;
+
+typedef struct {
+	TexCacheAsset assets[TEXCACHE_MAX_ASSETS];
+	TexCacheEntry entries[TEXCACHE_MAX_ENTRIES];
+	int8_t        resident[TEXCACHE_MAX_ASSETS + 1]; //id -> entry index, -1 if not in vram
+	int           numAssets;
+	uint32_t      frame;
+	TexCacheStats stats, lastStats; //this frame so far, and the whole of the previous one
+} TexCache;
+
+static TexCache texCache;
+
+static void TexCacheInit(void)
+{
+	texCache.numAssets = 0;
+	texCache.frame = 1; //so lastUsed = 0 is always older than the current frame
+	for (int i = 0; i < TEXCACHE_MAX_ENTRIES; i++){texCache.entries[i].id = TEXCACHE_NONE;}
+	for (int i = 0; i <= TEXCACHE_MAX_ASSETS; i++){texCache.resident[i] = -1;}
+	texCache.stats = (TexCacheStats) {0};
+	texCache.lastStats = (TexCacheStats) {0};
+}
+
+/// @brief register a texture, nothing gets uploaded until it's used
+/// @param palette - ignored for 16bpp
+/// @param width - in texels
+/// @param tag - for VramDump, string literal or NULL
+/// @return the texture's id, TEXCACHE_NONE if the asset table is full
+static uint16_t TexCacheAddAsset(
+	const void *image, const void *palette,
+	int width, int height, GP0ColorDepth depth, const char *tag
+)
+{
+	if (texCache.numAssets >= TEXCACHE_MAX_ASSETS){puts("texcache: too many assets"); return TEXCACHE_NONE;}
+	TexCacheAsset *asset = &texCache.assets[texCache.numAssets++];
+	asset->image = image;
+	asset->palette = palette;
+	asset->width = width;
+	asset->height = height;
+	asset->depth = depth;
+	asset->tag = tag;
+	return texCache.numAssets;
+}
+
+/// @brief call once at the start of each frame, before anything gets drawn
+static void TexCacheBeginFrame(void)
+{
+	texCache.frame++;
+	texCache.lastStats = texCache.stats;
+	texCache.stats = (TexCacheStats) {0};
+}
+
+/// @brief throw a texture out of vram
+static void TexCacheEvict(int index)
+{
+	TexCacheEntry *entry = &texCache.entries[index];
+	if (entry->id == TEXCACHE_NONE){return;}
+	VramFreeImage(&entry->image);
+	if (entry->clut.h){VramFreeClut(&entry->clut);}
+	texCache.resident[entry->id] = -1;
+	entry->id = TEXCACHE_NONE;
+	texCache.stats.evictions++;
+}
+
+/// @brief evict the least recently used texture that isn't needed this frame
+/// @return false if everything in the cache is in use
+static bool TexCacheEvictOldest(void)
+{
+	int oldest = -1;
+	for (int i = 0; i < TEXCACHE_MAX_ENTRIES; i++)
+	{
+		TexCacheEntry *entry = &texCache.entries[i];
+		if (entry->id == TEXCACHE_NONE || entry->lastUsed == texCache.frame){continue;}
+		if (oldest < 0 || entry->lastUsed < texCache.entries[oldest].lastUsed){oldest = i;}
+	}
+	if (oldest < 0){return false;}
+	TexCacheEvict(oldest);
+	return true;
+}
+
+/// @brief VramAllocImage without the complaining, running out is expected here
+static bool TexCacheAllocImage(VramRect *rect, const TexCacheAsset *asset)
+{
+	int w = VramTexelsToPixels(asset->width, asset->depth);
+	int reach = VramTexelsToPixels(256, asset->depth);
+	if (!VramFindSpot(rect, w, asset->height, reach, 1)){return false;}
+	VramRecord(rect, VRAM_ALLOC_IMAGE, asset->tag);
+	return true;
+}
+
+/// @brief get a texture into vram (evicting others if needed) and mark it used this frame
+/// @return where it is, NULL if it can't fit even after evicting everything unused
+static const TextureInfo *TexCacheUse(uint16_t id)
+{
+	if (id == TEXCACHE_NONE || id > texCache.numAssets){return 0;}
+
+	int index = texCache.resident[id];
+	if (index >= 0)
+	{
+		texCache.entries[index].lastUsed = texCache.frame;
+		texCache.stats.hits++;
+		return &texCache.entries[index].info;
+	}
+
+	texCache.stats.misses++;
+	const TexCacheAsset *asset = &texCache.assets[id - 1];
+	if (asset->width > 256 || asset->height > VRAM_PAGE_HEIGHT){return 0;}
+
+	//need an entry, then room in vram, evicting until both show up
+	for (index = 0; index < TEXCACHE_MAX_ENTRIES; index++)
+	{
+		if (texCache.entries[index].id == TEXCACHE_NONE){break;}
+	}
+	if (index == TEXCACHE_MAX_ENTRIES)
+	{
+		if (!TexCacheEvictOldest()){return 0;}
+		for (index = 0; texCache.entries[index].id != TEXCACHE_NONE; index++){}
+	}
+
+	TexCacheEntry *entry = &texCache.entries[index];
+	while (!TexCacheAllocImage(&entry->image, asset))
+	{
+		if (!TexCacheEvictOldest()){printf("texcache: no room for %s\n", asset->tag ? asset->tag : "texture"); return 0;}
+	}
+
+	int bytes = VramTexelsToPixels(asset->width, asset->depth) * asset->height * 2;
+	if (asset->depth == GP0_COLOR_16BPP)
+	{
+		entry->clut.h = 0;
+		queueTexture(&entry->info, asset->image, entry->image.x, entry->image.y, asset->width, asset->height);
+	}
+	else
+	{
+		int numColors = (asset->depth == GP0_COLOR_8BPP) ? 256 : 16;
+		//clut rows are small, but a new one needs vram like anything else
+		while (!VramAllocClut(&entry->clut, numColors))
+		{
+			if (!TexCacheEvictOldest()){VramFreeImage(&entry->image); return 0;}
+		}
+		queueIndexedTexture(
+			&entry->info, asset->image, asset->palette,
+			entry->image.x, entry->image.y, entry->clut.x, entry->clut.y,
+			asset->width, asset->height, asset->depth
+		);
+		bytes += numColors * 2;
+	}
+
+	entry->id = id;
+	entry->lastUsed = texCache.frame;
+	texCache.resident[id] = index;
+	texCache.stats.uploadBytes += bytes;
+	return &entry->info;
+}
+
+/// @brief print last frame's numbers and what's resident over serial
+static void TexCacheLog(void)
+{
+	const TexCacheStats *s = &texCache.lastStats;
+	int resident = 0;
+	for (int i = 0; i < TEXCACHE_MAX_ENTRIES; i++){if (texCache.entries[i].id != TEXCACHE_NONE){resident++;}}
+	printf(
+		"texcache: %d hits, %d misses, %d evictions, %d bytes uploaded, %d/%d resident\n",
+		s->hits, s->misses, s->evictions, (int) s->uploadBytes, resident, texCache.numAssets
+	);
+}
@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include "../ps1/registers.h"
+#include "../ps1/system.h"
+
+#pragma once
+
+// Root counter 2 is used as a free running timer for measuring how long things
+// take. Clocked at sysclk / 8 (~4.23 MHz, ~236ns per tick), it's only 16 bits
+// so it wraps every ~15.5ms. TimerElapsed handles a single wrap, so anything
+// being timed this way has to be shorter than that.
+// For anything longer, the overflow irq counts the wraps to give a 32 bit
+// timebase (ReadTimebase), which wraps every ~17 minutes instead.
+#define TIMER_TICKS_PER_SECOND (F_CPU / 8)
+#define TIMER_TICKS_TO_US(ticks) (((uint32_t) (ticks) * 8) / (F_CPU / 1000000))
+
+static volatile uint32_t timerOverflows = 0;
+
+static void TimerOverflowHandler(void *arg)
+{
+	timerOverflows++;
+}
+
+/// @brief start root counter 2 and the timebase, needs installExceptionHandler() first
+static void InitTimer(void)
+{
+	// no sync, count all the way up to 0xffff and wrap, clock source 2 (sysclk / 8),
+	// irq every time it wraps (repeat, pulse mode)
+	TIMER_CTRL(2) = TIMER_CTRL_PRESCALE | TIMER_CTRL_IRQ_ON_OVERFLOW | TIMER_CTRL_IRQ_REPEAT;
+	setIRQHandler(IRQ_TIMER2, &TimerOverflowHandler, 0);
+}
+
+static inline uint16_t ReadTimer(void)
+{
+	return TIMER_VALUE(2);
+}
+
+static inline uint16_t TimerElapsed(uint16_t start)
+{
+	return (uint16_t)(TIMER_VALUE(2) - start);
+}
+
+/// @brief 32 bit timestamp in timer ticks, ok to call from irq handlers too
+static uint32_t ReadTimebase(void)
+{
+	int state = enterCriticalSection();
+	uint32_t high = timerOverflows;
+	uint16_t low  = TIMER_VALUE(2);
+	//the counter wrapped but the irq hasn't been handled yet (we're in a critical
+	//section or another irq handler), account for it here. low being small means
+	//the wrap happened before we read it rather than right after.
+	if ((IRQ_STAT & (1 << IRQ_TIMER2)) && low < 0x8000){high++;}
+	exitCriticalSection(state);
+	return (high << 16) | low;
+}
@@ -0,0 +1,147 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../ps1/system.h"
+#include "timer.h"
+
+#pragma once
+
+// Binary trace events, for per frame telemetry without the cost of printf.
+// Each event is a fixed 16 byte record that goes into a ram ring buffer (cheap,
+// ok from irq handlers), TraceFlush() then pushes whole records out over SIO1
+// alongside the regular text logging. tools/decodeTrace.py picks the records
+// out of the stream and turns them into CSV or chrome://tracing / perfetto json.
+// - build with -DENABLE_TRACE, otherwise the TRACE_* macros compile to nothing
+// - at 115200 baud the serial port only moves ~190 bytes a frame at 60fps, so
+//   ~11 records per frame is the sustained budget. Bursts are fine (that's what
+//   the buffers are for), anything beyond that gets dropped and counted.
+//   Counters that rarely move should use TRACE_COUNTER_CHANGED, which only sends
+//   a record when the value is different from the last one sent
+//
+// record layout (little endian):
+//   0  uint8_t  sync      always TRACE_SYNC
+//   1  uint8_t  phase     TracePhase
+//   2  uint8_t  id        TraceId
+//   3  uint8_t  checksum  xor of the other 15 bytes
+//   4  uint32_t timestamp timer ticks (ReadTimebase, sysclk / 8)
+//   8  uint32_t arg0
+//   12 uint32_t arg1
+#define TRACE_SYNC           0xa5
+#define TRACE_BUFFER_RECORDS 256 //power of 2
+#define TRACE_MAX_IDS        32  //TraceId values have to stay below this
+
+typedef enum {
+	TRACE_PHASE_BEGIN   = 'B', //start of a span
+	TRACE_PHASE_END     = 'E', //end of the matching span
+	TRACE_PHASE_INSTANT = 'i', //single point in time
+	TRACE_PHASE_COUNTER = 'C'  //value over time, arg0 is the value
+} TracePhase;
+
+// event ids, the decoder reads the names straight out of this enum (--header),
+// keep the TRACE_ID_ prefix and add new ones at the end
+typedef enum {
+	TRACE_ID_FRAME      = 0,
+	TRACE_ID_UPDATE     = 1,
+	TRACE_ID_DRAW       = 2,
+	TRACE_ID_GPU_WAIT   = 3,
+	TRACE_ID_VSYNC_WAIT = 4,
+	TRACE_ID_SCRATCH    = 5,
+	TRACE_ID_DROPPED    = 6,
+	TRACE_ID_TEX_HITS   = 7,
+	TRACE_ID_TEX_MISSES = 8,
+	TRACE_ID_TEX_UPLOAD = 9,
+	TRACE_ID_ENTITIES   = 10
+} TraceId;
+
+typedef struct {
+	uint8_t  sync, phase, id, checksum;
+	uint32_t timestamp;
+	uint32_t arg0, arg1;
+} TraceRecord;
+
+static TraceRecord traceBuffer[TRACE_BUFFER_RECORDS];
+static volatile uint16_t traceHead = 0, traceTail = 0;
+static volatile uint32_t traceDropped = 0;
+static uint32_t traceCounterValues[TRACE_MAX_IDS];
+static uint32_t traceCounterSent = 0; //bit per id, set once a value for it is in the buffer
+
+/// @brief record an event, use the TRACE_* macros instead so it can be compiled out
+/// @return false if the buffer was full and the event got dropped
+static bool TraceEvent(TraceId id, TracePhase phase, uint32_t arg0, uint32_t arg1)
+{
+	int state = enterCriticalSection();
+	uint16_t head = traceHead;
+	uint16_t next = (head + 1) & (TRACE_BUFFER_RECORDS - 1);
+	if (next == traceTail)
+	{
+		traceDropped++;
+		exitCriticalSection(state);
+		return false;
+	}
+
+	TraceRecord *record = &traceBuffer[head];
+	record->sync      = TRACE_SYNC;
+	record->phase     = phase;
+	record->id        = id;
+	record->checksum  = 0;
+	record->timestamp = ReadTimebase();
+	record->arg0      = arg0;
+	record->arg1      = arg1;
+
+	uint8_t checksum = 0;
+	const uint8_t *bytes = (const uint8_t *) record;
+	for (int i = 0; i < (int) sizeof(TraceRecord); i++){checksum ^= bytes[i];}
+	record->checksum = checksum;
+
+	traceHead = next;
+	exitCriticalSection(state);
+	return true;
+}
+
+/// @brief record a counter, but only if it changed since the last time it was recorded
+static void TraceCounterChanged(TraceId id, uint32_t value)
+{
+	uint32_t bit = 1u << id;
+	if ((traceCounterSent & bit) && traceCounterValues[id] == value){return;}
+	if (!TraceEvent(id, TRACE_PHASE_COUNTER, value, 0)){return;} //try again next time
+	traceCounterValues[id] = value;
+	traceCounterSent |= bit;
+}
+
+/// @brief send as many whole records as fit in the serial tx buffer, call once per frame
+static void TraceFlush(void)
+{
+	//report drops as an event of their own so they show up in the trace
+	static uint32_t reportedDropped = 0;
+	if (traceDropped != reportedDropped)
+	{
+		reportedDropped = traceDropped;
+		TraceEvent(TRACE_ID_DROPPED, TRACE_PHASE_COUNTER, reportedDropped, getSerialDroppedBytes());
+	}
+
+	uint16_t tail = traceTail;
+	while (tail != traceHead && getSerialTXSpace() >= sizeof(TraceRecord))
+	{
+		_serialWrite(&traceBuffer[tail], sizeof(TraceRecord));
+		tail = (tail + 1) & (TRACE_BUFFER_RECORDS - 1);
+	}
+	traceTail = tail;
+}
+
+#ifdef ENABLE_TRACE
+#define TRACE_BEGIN(id)                  TraceEvent((id), TRACE_PHASE_BEGIN, 0, 0)
+#define TRACE_BEGIN_ARGS(id, arg0, arg1) TraceEvent((id), TRACE_PHASE_BEGIN, (arg0), (arg1))
+#define TRACE_END(id)                    TraceEvent((id), TRACE_PHASE_END, 0, 0)
+#define TRACE_INSTANT(id, arg0, arg1)    TraceEvent((id), TRACE_PHASE_INSTANT, (arg0), (arg1))
+#define TRACE_COUNTER(id, value)         TraceEvent((id), TRACE_PHASE_COUNTER, (value), 0)
+#define TRACE_COUNTER_CHANGED(id, value) TraceCounterChanged((id), (value))
+#define TRACE_FLUSH()                    TraceFlush()
+#else
+#define TRACE_BEGIN(id)                  ((void) 0)
+#define TRACE_BEGIN_ARGS(id, arg0, arg1) ((void) 0)
+#define TRACE_END(id)                    ((void) 0)
+#define TRACE_INSTANT(id, arg0, arg1)    ((void) 0)
+#define TRACE_COUNTER(id, value)         ((void) 0)
+#define TRACE_COUNTER_CHANGED(id, value) ((void) 0)
+#define TRACE_FLUSH()                    ((void) 0)
+#endif
@@ -0,0 +1,375 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "gpu.h"
+#include "../ps1/gpucmd.h"
+
+#pragma once
+
+// VRAM allocator. VRAM is 1024x512 16 bit pixels, the framebuffers take up
+// the top left corner and everything else is up for grabs. Free space is kept
+// as a list of rectangles (guillotine style, every allocation splits the free
+// rect it came from into up to 4 smaller ones around it).
+// - textures are placed so the GPU can actually address them from a single
+//   texture page: pages are 64 pixels wide and 256 lines tall, and a texture
+//   can only reach 64 (4bpp), 128 (8bpp) or 256 (16bpp) vram pixels to the
+//   right of its page's left edge, and can't cross the line 256 boundary
+// - palettes (cluts) need an x that's a multiple of 16, so they get packed
+//   into dedicated 256 pixel wide, 1 line tall rows, 16 entries at a time
+// - all sizes here are in vram pixels unless they say texels
+#define VRAM_WIDTH          1024
+#define VRAM_HEIGHT         512
+#define VRAM_PAGE_WIDTH     64
+#define VRAM_PAGE_HEIGHT    256
+#define VRAM_MAX_FREE_RECTS 64
+#define VRAM_MAX_ALLOCS     64
+#define VRAM_CLUT_ROW_WIDTH 256
+#define VRAM_MAX_CLUT_ROWS  16
+
+typedef struct {
+	int16_t x, y, w, h;
+} VramRect;
+
+typedef enum {
+	VRAM_ALLOC_RESERVED = 0,
+	VRAM_ALLOC_IMAGE    = 1,
+	VRAM_ALLOC_CLUT_ROW = 2
+} VramAllocKind;
+
+typedef struct {
+	VramRect   rect;
+	uint8_t    kind;
+	const char *tag; //shows up in VramDump, string literal or NULL
+} VramAlloc;
+
+typedef struct {
+	int16_t  x, y;
+	uint16_t used; //bit per 16 entry slot, 16 slots per row
+} VramClutRow;
+
+typedef struct {
+	VramRect    freeRects[VRAM_MAX_FREE_RECTS];
+	VramAlloc   allocs[VRAM_MAX_ALLOCS];
+	VramClutRow clutRows[VRAM_MAX_CLUT_ROWS];
+	int         numFree, numAllocs, numClutRows;
+	int         failed;
+} VramAllocator;
+
+static VramAllocator vram;
+
+/// @brief how many vram pixels a texture this many texels wide takes up
+static inline int VramTexelsToPixels(int width, GP0ColorDepth depth)
+{
+	if (depth == GP0_COLOR_4BPP){return (width + 3) / 4;}
+	if (depth == GP0_COLOR_8BPP){return (width + 1) / 2;}
+	return width;
+}
+
+static inline bool VramOverlaps(const VramRect *a, const VramRect *b)
+{
+	return a->x < b->x + b->w && b->x < a->x + a->w && a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+static void VramAddFree(int x, int y, int w, int h)
+{
+	if (w <= 0 || h <= 0){return;}
+	if (vram.numFree >= VRAM_MAX_FREE_RECTS){vram.failed++; return;} //lose the space rather than corrupt anything
+	vram.freeRects[vram.numFree++] = (VramRect) { x, y, w, h };
+}
+
+/// @brief cut a rect out of every free rect it overlaps
+static void VramCarve(const VramRect *used)
+{
+	for (int i = vram.numFree - 1; i >= 0; i--)
+	{
+		VramRect r = vram.freeRects[i];
+		if (!VramOverlaps(&r, used)){continue;}
+
+		//remove it (swap with the last one) and add back whatever is left around the used rect
+		vram.freeRects[i] = vram.freeRects[--vram.numFree];
+		int left = (used->x > r.x) ? used->x : r.x;
+		int right = (used->x + used->w < r.x + r.w) ? (used->x + used->w) : (r.x + r.w);
+		VramAddFree(r.x, r.y, left - r.x, r.h);                                    //left strip, full height
+		VramAddFree(right, r.y, r.x + r.w - right, r.h);                           //right strip, full height
+		VramAddFree(left, r.y, right - left, used->y - r.y);                       //above
+		VramAddFree(left, used->y + used->h, right - left, r.y + r.h - (used->y + used->h)); //below
+	}
+}
+
+/// @brief merge free rects that share a whole edge, keeps the list from filling up with slivers
+static void VramMergeFree(void)
+{
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		for (int i = 0; i < vram.numFree && !merged; i++)
+		{
+			for (int j = i + 1; j < vram.numFree && !merged; j++)
+			{
+				VramRect *a = &vram.freeRects[i], *b = &vram.freeRects[j];
+				if (a->y == b->y && a->h == b->h && (a->x + a->w == b->x || b->x + b->w == a->x))
+				{
+					if (b->x < a->x){a->x = b->x;}
+					a->w += b->w;
+					merged = true;
+				}
+				else if (a->x == b->x && a->w == b->w && (a->y + a->h == b->y || b->y + b->h == a->y))
+				{
+					if (b->y < a->y){a->y = b->y;}
+					a->h += b->h;
+					merged = true;
+				}
+				if (merged){vram.freeRects[j] = vram.freeRects[--vram.numFree];}
+			}
+		}
+	}
+}
+
+static void VramRecord(const VramRect *rect, VramAllocKind kind, const char *tag)
+{
+	if (vram.numAllocs >= VRAM_MAX_ALLOCS){return;} //still allocated, just not shown in the dump
+	vram.allocs[vram.numAllocs++] = (VramAlloc) { *rect, kind, tag };
+}
+
+/// @brief start over with everything free except the two framebuffers
+static void VramInit(int screenWidth, int screenHeight)
+{
+	vram.numFree = 0;
+	vram.numAllocs = 0;
+	vram.numClutRows = 0;
+	vram.failed = 0;
+	VramAddFree(0, 0, VRAM_WIDTH, VRAM_HEIGHT);
+
+	//double buffered side by side, see bufferX in main.c
+	VramRect framebuffers = { 0, 0, screenWidth * 2, screenHeight };
+	VramCarve(&framebuffers);
+	VramRecord(&framebuffers, VRAM_ALLOC_RESERVED, "framebuffers");
+}
+
+/// @brief find room for a w x h rect that doesn't reach further right than
+/// reach pixels from its page's left edge, and doesn't cross a 256 line boundary
+/// @param alignX - x has to be a multiple of this (1 for anything goes)
+static bool VramFindSpot(VramRect *out, int w, int h, int reach, int alignX)
+{
+	int best = -1, bestWaste = 0x7fffffff;
+	int bestX = 0, bestY = 0;
+
+	for (int i = 0; i < vram.numFree; i++)
+	{
+		const VramRect *r = &vram.freeRects[i];
+		if (r->w < w || r->h < h){continue;}
+
+		//try the rect's top left corner first, then bump to the next page/line boundary if that breaks a rule
+		int y = r->y;
+		if ((y % VRAM_PAGE_HEIGHT) + h > VRAM_PAGE_HEIGHT){y += VRAM_PAGE_HEIGHT - (y % VRAM_PAGE_HEIGHT);}
+		if (y + h > r->y + r->h){continue;}
+
+		int x = (r->x + alignX - 1) / alignX * alignX;
+		if ((x % VRAM_PAGE_WIDTH) + w > reach){x += VRAM_PAGE_WIDTH - (x % VRAM_PAGE_WIDTH);}
+		if (x + w > r->x + r->w){continue;}
+
+		//best short side fit, keeps the big free rects big
+		int wasteW = r->w - w, wasteH = r->h - h;
+		int waste = (wasteW < wasteH) ? wasteW : wasteH;
+		if (waste < bestWaste)
+		{
+			best = i;
+			bestWaste = waste;
+			bestX = x;
+			bestY = y;
+		}
+	}
+
+	if (best < 0){return false;}
+	*out = (VramRect) { bestX, bestY, w, h };
+	VramCarve(out);
+	return true;
+}
+
+/// @brief allocate space for a texture
+/// @param rect - where it ended up (in vram pixels)
+/// @param width - in texels
+/// @param height
+/// @param depth
+/// @param tag - for VramDump, string literal or NULL
+static bool VramAllocImage(VramRect *rect, int width, int height, GP0ColorDepth depth, const char *tag)
+{
+	int w = VramTexelsToPixels(width, depth);
+	//how far right of the page's edge the gpu can reach with 256 texels
+	int reach = VramTexelsToPixels(256, depth);
+	if (w > reach || height > VRAM_PAGE_HEIGHT || !VramFindSpot(rect, w, height, reach, 1))
+	{
+		printf("vram: no room for %s (%dx%d)\n", tag ? tag : "image", width, height);
+		vram.failed++;
+		return false;
+	}
+	VramRecord(rect, VRAM_ALLOC_IMAGE, tag);
+	return true;
+}
+
+/// @brief allocate a palette
+/// @param rect - where it ended up
+/// @param numColors - 16 or 256
+static bool VramAllocClut(VramRect *rect, int numColors)
+{
+	int slots = (numColors + 15) / 16;
+	uint16_t mask = (slots >= 16) ? 0xffff : (uint16_t) (((1 << slots) - 1));
+
+	//first fit in the existing rows
+	for (int i = 0; i < vram.numClutRows; i++)
+	{
+		VramClutRow *row = &vram.clutRows[i];
+		for (int s = 0; s + slots <= 16; s++)
+		{
+			if (row->used & (mask << s)){continue;}
+			row->used |= mask << s;
+			*rect = (VramRect) { row->x + s * 16, row->y, numColors, 1 };
+			return true;
+		}
+	}
+
+	//start a new row
+	VramRect rowRect;
+	if (vram.numClutRows >= VRAM_MAX_CLUT_ROWS || !VramFindSpot(&rowRect, VRAM_CLUT_ROW_WIDTH, 1, VRAM_WIDTH, 16))
+	{
+		puts("vram: no room for clut");
+		vram.failed++;
+		return false;
+	}
+	VramRecord(&rowRect, VRAM_ALLOC_CLUT_ROW, "clut row");
+	VramClutRow *row = &vram.clutRows[vram.numClutRows++];
+	row->x = rowRect.x;
+	row->y = rowRect.y;
+	row->used = mask;
+	*rect = (VramRect) { row->x, row->y, numColors, 1 };
+	return true;
+}
+
+/// @brief give an image's space back
+static void VramFreeImage(const VramRect *rect)
+{
+	for (int i = 0; i < vram.numAllocs; i++)
+	{
+		VramRect *r = &vram.allocs[i].rect;
+		if (r->x == rect->x && r->y == rect->y && r->w == rect->w && r->h == rect->h)
+		{
+			vram.allocs[i] = vram.allocs[--vram.numAllocs];
+			break;
+		}
+	}
+	VramAddFree(rect->x, rect->y, rect->w, rect->h);
+	VramMergeFree();
+}
+
+/// @brief give a palette's slots back, the row itself stays around for the next one
+static void VramFreeClut(const VramRect *rect)
+{
+	for (int i = 0; i < vram.numClutRows; i++)
+	{
+		VramClutRow *row = &vram.clutRows[i];
+		if (rect->y != row->y || rect->x < row->x || rect->x >= row->x + VRAM_CLUT_ROW_WIDTH){continue;}
+		int slots = (rect->w + 15) / 16;
+		uint16_t mask = (slots >= 16) ? 0xffff : (uint16_t) ((1 << slots) - 1);
+		row->used &= ~(mask << ((rect->x - row->x) / 16));
+		return;
+	}
+}
+
+/// @brief allocate room for a texture (and its palette, if indexed), upload it and fill in info
+/// @param palette - ignored for 16bpp
+/// @param width - in texels
+/// @param tag - for VramDump, string literal or NULL
+static bool VramUploadTexture(
+	TextureInfo *info, const void *image, const void *palette,
+	int width, int height, GP0ColorDepth depth, const char *tag
+)
+{
+	VramRect imageRect, clutRect;
+	if (!VramAllocImage(&imageRect, width, height, depth, tag)){return false;}
+	if (depth == GP0_COLOR_16BPP)
+	{
+		uploadTexture(info, image, imageRect.x, imageRect.y, width, height);
+		return true;
+	}
+	if (!VramAllocClut(&clutRect, (depth == GP0_COLOR_8BPP) ? 256 : 16))
+	{
+		VramFreeImage(&imageRect);
+		return false;
+	}
+	uploadIndexedTexture(info, image, palette, imageRect.x, imageRect.y, clutRect.x, clutRect.y, width, height, depth);
+	return true;
+}
+
+/// @brief allocate room for a palette on its own and upload it, for textures that share a
+/// page but not a palette. for a packAtlas.py atlas, upload each page with VramUploadTexture
+/// and its first palette, then the other palettes with this, and use the page's TextureInfo
+/// with the clut swapped for whichever palette an image uses
+/// @param numColors - 16 or 256
+/// @return value for TextureInfo.clut, 0 if there's no room left
+static uint16_t VramUploadPalette(const void *palette, int numColors)
+{
+	VramRect rect;
+	if (!VramAllocClut(&rect, numColors)){return 0;}
+	waitForGPUFence(queueVRAMData(palette, rect.x, rect.y, numColors, 1));
+	return gp0_clut(rect.x / 16, rect.y);
+}
+
+/// @brief print allocations, free space and a rough map over serial.
+/// map legend (each char is 16x16 pixels): F framebuffer, # image, c clut row,
+/// . free, - partly free, ' ' lost (not in any free rect or allocation, ie waste)
+static void VramDump(void)
+{
+	int usedArea = 0, freeArea = 0, slivers = 0, clutSlack = 0;
+	printf("vram: %d allocations, %d free rects, %d failures\n", vram.numAllocs, vram.numFree, vram.failed);
+	for (int i = 0; i < vram.numAllocs; i++)
+	{
+		const VramAlloc *a = &vram.allocs[i];
+		printf("  %4d,%3d %4dx%3d %s\n", a->rect.x, a->rect.y, a->rect.w, a->rect.h, a->tag ? a->tag : "?");
+		if (a->kind != VRAM_ALLOC_RESERVED){usedArea += a->rect.w * a->rect.h;}
+	}
+	for (int i = 0; i < vram.numClutRows; i++)
+	{
+		for (int s = 0; s < 16; s++){if (!(vram.clutRows[i].used & (1 << s))){clutSlack += 16;}}
+	}
+	for (int i = 0; i < vram.numFree; i++)
+	{
+		const VramRect *r = &vram.freeRects[i];
+		freeArea += r->w * r->h;
+		//too thin to fit even a 16x16 4bpp texture, count it as waste
+		if (r->w < 4 || r->h < 16){slivers += r->w * r->h;}
+	}
+	printf(
+		"  used %d px, free %d px (%d in unusable slivers), %d unused clut entries\n",
+		usedArea, freeArea, slivers, clutSlack
+	);
+
+	char line[VRAM_WIDTH / 16 + 1];
+	for (int cy = 0; cy < VRAM_HEIGHT / 16; cy++)
+	{
+		for (int cx = 0; cx < VRAM_WIDTH / 16; cx++)
+		{
+			VramRect cell = { cx * 16, cy * 16, 16, 16 };
+			char ch = ' ';
+			int freeCover = 0;
+			for (int i = 0; i < vram.numFree; i++)
+			{
+				const VramRect *r = &vram.freeRects[i];
+				if (!VramOverlaps(r, &cell)){continue;}
+				int w = ((r->x + r->w < cell.x + 16) ? (r->x + r->w) : (cell.x + 16)) - ((r->x > cell.x) ? r->x : cell.x);
+				int h = ((r->y + r->h < cell.y + 16) ? (r->y + r->h) : (cell.y + 16)) - ((r->y > cell.y) ? r->y : cell.y);
+				freeCover += w * h;
+			}
+			for (int i = 0; i < vram.numAllocs; i++)
+			{
+				if (!VramOverlaps(&vram.allocs[i].rect, &cell)){continue;}
+				ch = "F#c"[vram.allocs[i].kind];
+				break;
+			}
+			if (ch == ' ' && freeCover){ch = (freeCover >= 256) ? '.' : '-';}
+			line[cx] = ch;
+		}
+		line[VRAM_WIDTH / 16] = 0;
+		printf("  |%s|\n", line);
+	}
+}
@@ -0,0 +1,388 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <heap.h>
+#include "archive.h"
+#include "draw.h"
+#include "gpu.h"
+#include "obj.h"
+#include "vram.h"
+#include "../ps1/gpucmd.h"
+
+#pragma once
+
+// Streamed worlds. tools/buildWorld.py cuts a world up into a grid of square
+// cells, each with its own mesh, 4bpp texture and collision boxes, and packs
+// them all into one archive (see archive.h) along with a "world" entry that
+// maps grid positions to cell entries.
+// - only WORLD_NUM_SLOTS cells are ever resident, each in a fixed size slot
+//   with its own spot in vram for its texture, so memory use doesn't depend
+//   on how big the world is. slot buffers come off the heap the first time a
+//   world is opened (and are kept from then on, like the vram), so a game with
+//   no world doesn't pay for them
+// - WorldUpdate (once a frame) guesses where the player will be in
+//   WORLD_LOOKAHEAD_STEPS sim steps (see sim.h) from how they've been moving, and
+//   loads the cells around there in the background, one at a time, closest first.
+//   slots holding cells furthest from that spot get reused first
+// - world coordinates have to fit in an int16_t since that's what DrawObj
+//   uses, so 16x16 cells of 2048 units is about the limit
+#define WORLD_NUM_SLOTS        12
+#define WORLD_SLOT_SIZE        32768 //bytes, buildWorld.py checks every cell fits
+#define WORLD_MAX_CELLS        256
+#define WORLD_MAX_HEADER_SIZE  4096 //buffer size for the "world" entry, plenty for WORLD_MAX_CELLS
+#define WORLD_LOOKAHEAD_STEPS  45 //0.75s at 60 steps a second
+#define WORLD_MAGIC            0x444c5257 //"WRLD"
+#define CELL_MAGIC             0x4c4c4543 //"CELL"
+
+//each slot gets room for one 4bpp texture this big (and a palette) in vram
+//when the world is opened, see vram.h
+#define WORLD_MAX_TEXTURE_SIZE 128
+
+typedef struct {
+	int16_t minX, minY, minZ;
+	int16_t maxX, maxY, maxZ;
+} CellCollider;
+
+//everything is relative to the start of the cell's data, coordinates are
+//relative to the cell's corner
+typedef struct {
+	uint32_t magic;
+	uint16_t numVertices, numFaces, numTextCoords, numColliders;
+	uint16_t textureWidth, textureHeight; //0 = untextured
+	uint32_t vertices, textCoords, faces, colliders, texture, palette;
+} CellHeader;
+
+typedef struct {
+	uint32_t magic;
+	uint16_t cellSize, gridWidth, gridDepth, _padding;
+	int16_t  originX, originZ;
+	uint32_t cells[]; //archive entry name hash for each cell, row by row, 0 = empty
+} WorldHeader;
+
+typedef enum {
+	CELL_SLOT_FREE    = 0,
+	CELL_SLOT_LOADING = 1,
+	CELL_SLOT_READY   = 2
+} CellSlotState;
+
+typedef struct {
+	uint8_t          state;
+	int16_t          cellX, cellZ;
+	uint32_t         lastWanted; //update count when this cell was last in the wanted list
+	VramRect         vramImage, vramClut; //h = 0 if not allocated yet
+	const CellHeader *cell;
+	DrawObj          obj;
+	TextureInfo      texture;
+	uint32_t         uploadFence; //texture comes straight out of buffer, so keep both until this is done
+	uint32_t         *buffer; //WORLD_SLOT_SIZE bytes, allocated by WorldOpen
+} CellSlot;
+
+typedef struct {
+	bool        open;
+	Archive     archive;
+	WorldHeader *header; //allocated by WorldOpen, sized to fit
+	CellSlot    slots[WORLD_NUM_SLOTS];
+	ArchiveLoad load;
+	int         loadingSlot; //-1 if nothing is being loaded
+	uint32_t    updates;
+	int32_t     lastX, lastZ;
+	int32_t     velocityX, velocityZ; //units per sim step, 8.8 fixed point, smoothed
+	uint16_t    loadsDone, loadsFailed;
+} World;
+
+static World world = { .open = false, .loadingSlot = -1 };
+
+/// @brief load a world's table of contents and cell map, cells get loaded later by WorldUpdate
+/// @param path - archive on disc (needs the iso index, see iso.h)
+/// @return false if the archive or its "world" entry couldn't be loaded
+static bool WorldOpen(const char *path)
+{
+	world.open = false;
+	if (!openArchiveFile(&world.archive, path)){return false;}
+
+	const ArchiveEntry *entry = findArchiveEntry(&world.archive, "world");
+	if (!entry || getArchiveBufferSize(entry) > WORLD_MAX_HEADER_SIZE){return false;}
+	free(world.header);
+	world.header = (WorldHeader *) mallocTagged(getArchiveBufferSize(entry));
+	if (!world.header){puts("world: out of memory"); return false;}
+	if (!loadArchiveEntry(&world.archive, entry, world.header)){return false;}
+
+	if (world.header->magic != WORLD_MAGIC || world.header->gridWidth * world.header->gridDepth > WORLD_MAX_CELLS){return false;}
+
+	for (int i = 0; i < WORLD_NUM_SLOTS; i++)
+	{
+		CellSlot *slot = &world.slots[i];
+		slot->state = CELL_SLOT_FREE;
+		//slots keep their buffer and vram for good, so opening another world doesn't leak any
+		if (!slot->buffer && !(slot->buffer = (uint32_t *) mallocTagged(WORLD_SLOT_SIZE))){puts("world: out of memory"); return false;}
+		if (!slot->vramImage.h && !VramAllocImage(&slot->vramImage, WORLD_MAX_TEXTURE_SIZE, WORLD_MAX_TEXTURE_SIZE, GP0_COLOR_4BPP, "world slot")){return false;}
+		if (!slot->vramClut.h && !VramAllocClut(&slot->vramClut, 16)){return false;}
+	}
+	world.loadingSlot = -1;
+	world.updates     = 0;
+	world.velocityX   = 0;
+	world.velocityZ   = 0;
+	world.open        = true;
+	printf(
+		"world: %dx%d cells of %d, %d slots\n",
+		world.header->gridWidth, world.header->gridDepth, world.header->cellSize, WORLD_NUM_SLOTS
+	);
+	return true;
+}
+
+/// @brief which cell a world position is in, can be outside the grid
+static void WorldCellAt(int32_t x, int32_t z, int *cellX, int *cellZ)
+{
+	int32_t size = world.header->cellSize;
+	int32_t dx = x - world.header->originX, dz = z - world.header->originZ;
+	//round towards negative infinity so positions left of the origin aren't lumped into cell 0
+	*cellX = (dx >= 0) ? (dx / size) : -((size - 1 - dx) / size);
+	*cellZ = (dz >= 0) ? (dz / size) : -((size - 1 - dz) / size);
+}
+
+static uint32_t WorldCellHash(int cellX, int cellZ)
+{
+	if (cellX < 0 || cellZ < 0 || cellX >= world.header->gridWidth || cellZ >= world.header->gridDepth){return 0;}
+	return world.header->cells[cellZ * world.header->gridWidth + cellX];
+}
+
+static CellSlot *WorldFindSlot(int cellX, int cellZ)
+{
+	for (int i = 0; i < WORLD_NUM_SLOTS; i++)
+	{
+		CellSlot *slot = &world.slots[i];
+		if (slot->state != CELL_SLOT_FREE && slot->cellX == cellX && slot->cellZ == cellZ){return slot;}
+	}
+	return 0;
+}
+
+/// @brief point the cell's data at the slot it got loaded into and put its texture in the slot's vram
+static bool WorldSetupSlot(int index)
+{
+	CellSlot *slot = &world.slots[index];
+	const CellHeader *cell = (const CellHeader *) slot->buffer;
+	const uint8_t *base = (const uint8_t *) slot->buffer;
+	if (cell->magic != CELL_MAGIC){return false;}
+
+	int16_t x = world.header->originX + slot->cellX * world.header->cellSize;
+	int16_t z = world.header->originZ + slot->cellZ * world.header->cellSize;
+	slot->cell = cell;
+	slot->obj = CreateDrawObj(
+		x,0,z, 0,0,0,
+		cell->numFaces, (const Face *) &base[cell->faces],
+		cell->numVertices, (const GTEVector16 *) &base[cell->vertices]
+	);
+
+	if (cell->textureWidth)
+	{
+		if (cell->textureWidth > WORLD_MAX_TEXTURE_SIZE || cell->textureHeight > WORLD_MAX_TEXTURE_SIZE){return false;}
+		slot->uploadFence = queueIndexedTexture(
+			&slot->texture,
+			&base[cell->texture],
+			&base[cell->palette],
+			slot->vramImage.x,
+			slot->vramImage.y,
+			slot->vramClut.x,
+			slot->vramClut.y,
+			cell->textureWidth,
+			cell->textureHeight,
+			GP0_COLOR_4BPP
+		);
+		//uvs come relative to the cell's texture, AddTri wants them relative to the texture page.
+		//the buffer is ours so just fix them up in place
+		TextCoord *coords = (TextCoord *) &base[cell->textCoords];
+		for (int i = 0; i < cell->numTextCoords; i++)
+		{
+			coords[i].u += slot->texture.u;
+			coords[i].v += slot->texture.v;
+		}
+		slot->obj.isTextured = true;
+		slot->obj.textinfo = &slot->texture;
+		slot->obj.textCoords = coords;
+	}
+	return true;
+}
+
+/// @brief finish off the load in flight, if any
+static void WorldPollLoad(void)
+{
+	if (world.loadingSlot < 0){return;}
+
+	ArchiveLoadStatus status = updateArchiveLoad(&world.load);
+	if (status == ARCHIVE_LOAD_BUSY){return;}
+
+	CellSlot *slot = &world.slots[world.loadingSlot];
+	if (status == ARCHIVE_LOAD_DONE && WorldSetupSlot(world.loadingSlot))
+	{
+		slot->state = CELL_SLOT_READY;
+		world.loadsDone++;
+	}
+	else
+	{
+		printf("world: failed to load cell %d,%d\n", slot->cellX, slot->cellZ);
+		slot->state = CELL_SLOT_FREE;
+		world.loadsFailed++;
+	}
+	world.loadingSlot = -1;
+}
+
+/// @brief call once a frame with the player's position, keeps the cells around them (and
+/// where they're headed) loaded
+/// @param steps - sim steps run this frame (SimBeginFrame), so the prediction doesn't depend on the frame rate
+static void WorldUpdate(int32_t x, int32_t z, int steps)
+{
+	if (!world.open){return;}
+	world.updates++;
+
+	//smoothed velocity, so a single step of input doesn't throw the prediction around. the
+	//movement is spread evenly over the frame's steps and smoothed once per step
+	if (world.updates > 1 && steps > 0)
+	{
+		int32_t stepX = ((x - world.lastX) << 8) / steps;
+		int32_t stepZ = ((z - world.lastZ) << 8) / steps;
+		for (int i = 0; i < steps; i++)
+		{
+			world.velocityX += (stepX - world.velocityX) >> 2;
+			world.velocityZ += (stepZ - world.velocityZ) >> 2;
+		}
+	}
+	world.lastX = x;
+	world.lastZ = z;
+
+	WorldPollLoad();
+
+	//never look ahead more than a cell, past that the guess isn't worth evicting anything for
+	int32_t cellSize = world.header->cellSize;
+	int32_t aheadX = (world.velocityX * WORLD_LOOKAHEAD_STEPS) >> 8;
+	int32_t aheadZ = (world.velocityZ * WORLD_LOOKAHEAD_STEPS) >> 8;
+	if (aheadX > cellSize){aheadX = cellSize;}
+	if (aheadX < -cellSize){aheadX = -cellSize;}
+	if (aheadZ > cellSize){aheadZ = cellSize;}
+	if (aheadZ < -cellSize){aheadZ = -cellSize;}
+	int32_t predictX = x + aheadX, predictZ = z + aheadZ;
+
+	//wanted cells: the 3x3 around the player and the 3x3 around the predicted spot, the
+	//player's own cell first, then the rest closest to the predicted spot first
+	int curX, curZ, preX, preZ;
+	WorldCellAt(x, z, &curX, &curZ);
+	WorldCellAt(predictX, predictZ, &preX, &preZ);
+
+	int16_t wantedX[18], wantedZ[18];
+	int32_t wantedDist[18];
+	int numWanted = 0;
+	for (int i = 0; i < 18; i++)
+	{
+		int cx = ((i < 9) ? curX : preX) + (i % 3) - 1;
+		int cz = ((i < 9) ? curZ : preZ) + ((i % 9) / 3) - 1;
+		if (!WorldCellHash(cx, cz)){continue;}
+
+		bool duplicate = false;
+		for (int j = 0; j < numWanted; j++){if (wantedX[j] == cx && wantedZ[j] == cz){duplicate = true;}}
+		if (duplicate){continue;}
+
+		int32_t dx = (world.header->originX + cx * cellSize + cellSize / 2 - predictX) >> 4;
+		int32_t dz = (world.header->originZ + cz * cellSize + cellSize / 2 - predictZ) >> 4;
+		int32_t dist = (cx == curX && cz == curZ) ? -1 : (dx * dx + dz * dz);
+
+		//insertion sort, it's at most 18 entries
+		int j = numWanted++;
+		for (; j > 0 && wantedDist[j - 1] > dist; j--)
+		{
+			wantedX[j] = wantedX[j - 1];
+			wantedZ[j] = wantedZ[j - 1];
+			wantedDist[j] = wantedDist[j - 1];
+		}
+		wantedX[j] = cx;
+		wantedZ[j] = cz;
+		wantedDist[j] = dist;
+	}
+	if (numWanted > WORLD_NUM_SLOTS){numWanted = WORLD_NUM_SLOTS;}
+
+	//mark what's still wanted, and find the first wanted cell that isn't loaded yet
+	int missing = -1;
+	for (int i = 0; i < numWanted; i++)
+	{
+		CellSlot *slot = WorldFindSlot(wantedX[i], wantedZ[i]);
+		if (slot){slot->lastWanted = world.updates;}
+		else if (missing < 0){missing = i;}
+	}
+	if (missing < 0 || world.loadingSlot >= 0){return;}
+
+	//pick a slot: a free one, or else the unwanted one that was wanted longest ago
+	int victim = -1;
+	for (int i = 0; i < WORLD_NUM_SLOTS; i++)
+	{
+		CellSlot *slot = &world.slots[i];
+		if (slot->state == CELL_SLOT_FREE){victim = i; break;}
+		if (slot->lastWanted == world.updates){continue;}
+		if (!isGPUFenceDone(slot->uploadFence)){continue;}
+		if (victim < 0 || slot->lastWanted < world.slots[victim].lastWanted){victim = i;}
+	}
+	if (victim < 0){return;}
+
+	const ArchiveEntry *entry = 0;
+	uint32_t hash = WorldCellHash(wantedX[missing], wantedZ[missing]);
+	for (int i = 0; i < (int) world.archive.header.numEntries; i++)
+	{
+		if (world.archive.entries[i].hash == hash){entry = &world.archive.entries[i]; break;}
+	}
+	if (!entry || getArchiveBufferSize(entry) > WORLD_SLOT_SIZE){return;}
+
+	CellSlot *slot = &world.slots[victim];
+	slot->state      = CELL_SLOT_LOADING;
+	slot->cellX      = wantedX[missing];
+	slot->cellZ      = wantedZ[missing];
+	slot->lastWanted = world.updates;
+	if (!startArchiveLoad(&world.load, &world.archive, entry, slot->buffer))
+	{
+		slot->state = CELL_SLOT_FREE; //cd queue is full or music is playing, try again next frame
+		return;
+	}
+	world.loadingSlot = victim;
+}
+
+/// @brief draw every loaded cell
+static void WorldDraw(DMAChain *chain, const Camera *camera)
+{
+	if (!world.open){return;}
+	for (int i = 0; i < WORLD_NUM_SLOTS; i++)
+	{
+		CellSlot *slot = &world.slots[i];
+		if (slot->state == CELL_SLOT_READY && isGPUFenceDone(slot->uploadFence)){DrawObject(chain, &slot->obj, camera);}
+	}
+}
+
+/// @brief check a point against the collision boxes of the cell it's in
+/// @return true if the point is inside a box, false if not (or the cell isn't loaded)
+static bool WorldBlocked(int32_t x, int32_t y, int32_t z)
+{
+	if (!world.open){return false;}
+	int cellX, cellZ;
+	WorldCellAt(x, z, &cellX, &cellZ);
+	CellSlot *slot = WorldFindSlot(cellX, cellZ);
+	if (!slot || slot->state != CELL_SLOT_READY){return false;}
+
+	const CellCollider *boxes = (const CellCollider *) &((const uint8_t *) slot->buffer)[slot->cell->colliders];
+	x -= slot->obj.x;
+	z -= slot->obj.z;
+	for (int i = 0; i < slot->cell->numColliders; i++)
+	{
+		const CellCollider *box = &boxes[i];
+		if (x >= box->minX && x <= box->maxX && y >= box->minY && y <= box->maxY && z >= box->minZ && z <= box->maxZ){return true;}
+	}
+	return false;
+}
+
+/// @brief print what's in each slot over serial
+static void WorldLog(void)
+{
+	if (!world.open){return;}
+	printf("world: %d loaded, %d failed\n", world.loadsDone, world.loadsFailed);
+	for (int i = 0; i < WORLD_NUM_SLOTS; i++)
+	{
+		const CellSlot *slot = &world.slots[i];
+		static const char *const states[] = { "free", "loading", "ready" };
+		printf("  slot %2d: %-7s %d,%d\n", i, states[slot->state], slot->cellX, slot->cellZ);
+	}
+}
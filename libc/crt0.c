@@ -14,6 +14,7 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -30,12 +31,96 @@ extern const Function _preinitArrayStart[], _preinitArrayEnd[];
 extern const Function _initArrayStart[],    _initArrayEnd[];
 extern const Function _finiArrayStart[],    _finiArrayEnd[];
 
-/* Heap API (used by malloc) */
+/* Memory layout */
+
+// The stack is given a fixed-size region at the top of RAM and the heap is
+// only allowed to grow up to its bottom. Both can be overridden by defining
+// them globally (e.g. -DSTACK_SIZE=0x10000). The bottommost STACK_GUARD_SIZE
+// bytes of the stack region are never expected to be touched, so finding them
+// overwritten means the stack has overflowed (or is about to).
+#ifndef STACK_SIZE
+#define STACK_SIZE 0x8000
+#endif
+#ifndef STACK_GUARD_SIZE
+#define STACK_GUARD_SIZE 256
+#endif
+
+#define STACK_CANARY 0x5354414b // "KATS"
+#define KSEG0_BASE   0x80000000
+#define KSEG1_BASE   0xa0000000
+#define RAM_SIZE_2MB 0x200000
+#define RAM_SIZE_8MB 0x800000
 
 #define ALIGN(x, n) (((x) + ((n) - 1)) & ~((n) - 1))
 
+static uintptr_t _ramEnd, _stackTop, _stackBottom;
+
+static size_t _detectRAMSize(void) {
+	// Retail consoles only have 2 MB of RAM, which the BIOS configures the
+	// DRAM controller to mirror across an 8 MB window. Dev kits and most
+	// emulators (if configured to do so) have 8 MB instead. We can tell them
+	// apart by writing to a location in the first 2 MB and checking whether
+	// the same value shows up 2 MB above it. The uncached KSEG1 mirror is used
+	// so the writes actually hit RAM rather than sitting in the cache.
+	static uint32_t probe;
+
+	uintptr_t address         = ((uintptr_t) &probe) & 0x1fffffff;
+	volatile uint32_t *low    = (volatile uint32_t *) (KSEG1_BASE | address);
+	volatile uint32_t *mirror =
+		(volatile uint32_t *) (KSEG1_BASE | (address + RAM_SIZE_2MB));
+
+	// Check twice with different values to rule out the location 2 MB up
+	// happening to contain the first value already.
+	*low = 0x12345678;
+	if (*mirror != 0x12345678)
+		return RAM_SIZE_8MB;
+
+	*low = 0x87654321;
+	if (*mirror != 0x87654321)
+		return RAM_SIZE_8MB;
+
+	return RAM_SIZE_2MB;
+}
+
+static inline __attribute__((always_inline)) void _fillStackCanary(uintptr_t bottom, uintptr_t top) {
+	for (uint32_t *ptr = (uint32_t *) bottom; ptr < (uint32_t *) top; ptr++)
+		*ptr = STACK_CANARY;
+}
+
+size_t getRAMSize(void) {
+	return _ramEnd - KSEG0_BASE;
+}
+
+size_t getStackSize(void) {
+	return _stackTop - _stackBottom;
+}
+
+size_t getStackPeakUsage(void) {
+	// Find the lowest word that no longer holds the canary value. Everything
+	// above it has been used by a stack frame at some point.
+	const uint32_t *ptr = (const uint32_t *) _stackBottom;
+
+	while ((ptr < (const uint32_t *) _stackTop) && (*ptr == STACK_CANARY))
+		ptr++;
+
+	return _stackTop - (uintptr_t) ptr;
+}
+
+int checkStackGuard(void) {
+	const uint32_t *ptr = (const uint32_t *) _stackBottom;
+
+	for (int i = STACK_GUARD_SIZE / 4; i; i--, ptr++) {
+		if (*ptr != STACK_CANARY)
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Heap API (used by malloc) */
+
 static uintptr_t _heapEnd   = (uintptr_t) _bssEnd;
-static uintptr_t _heapLimit = 0x80200000; // TODO: add a way to change this
+static uintptr_t _heapLimit = KSEG0_BASE + RAM_SIZE_2MB - STACK_SIZE;
 
 void *sbrk(ptrdiff_t incr) {
 	uintptr_t currentEnd = _heapEnd;
@@ -48,9 +133,29 @@ void *sbrk(ptrdiff_t incr) {
 	return (void *) currentEnd;
 }
 
+void *getHeapLimit(void) {
+	return (void *) _heapLimit;
+}
+
+int setHeapLimit(void *limit) {
+	// The limit can be lowered (e.g. to reserve the top of RAM for something
+	// else) but never raised into the stack, nor below the current heap top.
+	uintptr_t _limit = (uintptr_t) limit;
+
+	if ((_limit > _stackBottom) || (_limit < _heapEnd))
+		return 0;
+
+	_heapLimit = _limit;
+	return 1;
+}
+
 /* Program entry point */
 
 int main(int argc, const char **argv);
+int _callOnStack(
+	int (*func)(int, const char **), int argc, const char **argv,
+	void *stackTop
+);
 
 int _start(int argc, const char **argv) {
 	// Set $gp to point to the middle of the .sdata/.sbss sections, ensuring
@@ -61,6 +166,31 @@ int _start(int argc, const char **argv) {
 	// Set all uninitialized variables to zero by clearing the BSS section.
 	__builtin_memset(_bssStart, 0, _bssEnd - _bssStart);
 
+	// Figure out how much RAM we have and reserve a region for the stack at
+	// the top of it, then let the heap use everything in between. With 2 MB
+	// the stack is left where the BIOS put it (right below the end of RAM);
+	// with 8 MB it is moved to the end of the extra RAM so the heap can grow
+	// past the 2 MB mark. The unused part of the stack is filled with a canary
+	// value in order to measure how deep it actually gets.
+	uintptr_t currentSP;
+	__asm__ volatile("move %0, $sp\n" : "=r"(currentSP));
+
+	_ramEnd = KSEG0_BASE + _detectRAMSize();
+	bool moveStack = (_ramEnd > (KSEG0_BASE + RAM_SIZE_2MB));
+
+	if (moveStack) {
+		_stackTop    = _ramEnd - 16;
+		_stackBottom = _stackTop - STACK_SIZE;
+		_fillStackCanary(_stackBottom, _stackTop);
+	} else {
+		_stackTop    = ALIGN(currentSP, 16);
+		_stackBottom = _stackTop - STACK_SIZE;
+		// Leave some room for this function's own locals.
+		_fillStackCanary(_stackBottom, currentSP - 64);
+	}
+
+	_heapLimit = _stackBottom;
+
 	// Invoke all global constructors if any, then main() and finally all global
 	// destructors.
 	for (const Function *ctor = _preinitArrayStart; ctor < _preinitArrayEnd; ctor++)
@@ -68,7 +198,9 @@ int _start(int argc, const char **argv) {
 	for (const Function *ctor = _initArrayStart; ctor < _initArrayEnd; ctor++)
 		(*ctor)();
 
-	int returnValue = main(argc, argv);
+	int returnValue = moveStack
+		? _callOnStack(&main, argc, argv, (void *) _stackTop)
+		: main(argc, argv);
 
 	for (const Function *dtor = _finiArrayStart; dtor < _finiArrayEnd; dtor++)
 		(*dtor)();
@@ -0,0 +1,113 @@
+/*
+ * ps1-bare-metal - (C) 2023 spicyjpeg
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+// Define HEAP_TAGS globally (i.e. pass -DHEAP_TAGS to the compiler, as the
+// allocator is built as a separate translation unit) to have each block record
+// the file and line it was allocated from. This costs 8 extra bytes per block.
+#define _HEAP_STR2(x) #x
+#define _HEAP_STR(x)  _HEAP_STR2(x)
+
+#ifdef HEAP_TAGS
+#define mallocTagged(size) \
+	_mallocTagged(size, __FILE__ ":" _HEAP_STR(__LINE__))
+#else
+#define mallocTagged(size) malloc(size)
+#endif
+
+typedef struct {
+	size_t     liveBytes;      // Bytes currently allocated (excluding headers)
+	size_t     peakBytes;      // Highest value liveBytes has ever reached
+	size_t     blockCount;     // Number of currently allocated blocks
+	size_t     heapBytes;      // Bytes between the heap's start and its top
+	size_t     freeBytes;      // Bytes in gaps between allocated blocks
+	size_t     largestFreeGap; // Largest allocation possible without sbrk()
+	const char *peakTag;       // Allocation that set peakBytes (HEAP_TAGS only)
+} HeapStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Same as malloc(), but records the given string (which must be a
+ * string literal or otherwise never freed) in the block's header if the
+ * allocator was built with HEAP_TAGS defined. Use the mallocTagged() macro
+ * rather than calling this directly.
+ */
+void *_mallocTagged(size_t size, const char *tag);
+
+/**
+ * @brief Fills in the provided structure with the heap's current usage
+ * counters. Walks the block list, so avoid calling it every frame on a heap
+ * with lots of blocks.
+ */
+void getHeapStats(HeapStats *stats);
+
+/**
+ * @brief Prints a summary of the heap's usage and fragmentation, followed by a
+ * map of all allocated blocks and gaps, to the serial port.
+ */
+void dumpHeap(void);
+
+/**
+ * @brief Returns the amount of main RAM detected at boot (2 MB on retail
+ * consoles, 8 MB on dev kits and emulators configured to emulate them).
+ */
+size_t getRAMSize(void);
+
+/**
+ * @brief Returns the address the heap is not allowed to grow past. By default
+ * this is the bottom of the region reserved for the stack.
+ */
+void *getHeapLimit(void);
+
+/**
+ * @brief Lowers the heap limit, e.g. to reserve the top of RAM for a buffer
+ * managed manually. The limit cannot be raised into the stack's reserved
+ * region nor set below the heap's current top.
+ *
+ * @param limit
+ * @return 1 if the new limit was applied, 0 otherwise
+ */
+int setHeapLimit(void *limit);
+
+/**
+ * @brief Returns the size of the region reserved for the stack (STACK_SIZE).
+ */
+size_t getStackSize(void);
+
+/**
+ * @brief Returns the deepest the stack has been since boot, in bytes, by
+ * scanning for the first overwritten word of the canary pattern written to it
+ * at startup.
+ */
+size_t getStackPeakUsage(void);
+
+/**
+ * @brief Checks whether the guard area at the bottom of the stack's region is
+ * still intact.
+ *
+ * @return 1 if the guard is intact, 0 if the stack has overflowed into it
+ */
+int checkStackGuard(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -17,12 +17,13 @@
  * https://github.com/grumpycoders/pcsx-redux/blob/main/src/mips/psyqo/src/alloc.c
  */
 
+#include <heap.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #define _align(x, n) (((x) + ((n) - 1)) & ~((n) - 1))
-#define _updateHeapUsage(incr)
 
 /* Internal state */
 
@@ -31,11 +32,48 @@ typedef struct _Block {
 
 	void   *ptr;
 	size_t size;
+
+#ifdef HEAP_TAGS
+	// Kept at 8 bytes so the payload following the header stays aligned.
+	const char *tag;
+	uint32_t   _padding;
+#endif
 } Block;
 
 static void  *_mallocStart;
 static Block *_mallocHead, *_mallocTail;
 
+/* Usage telemetry */
+
+// All counters are in payload bytes (i.e. Block.size, not including headers)
+// so that allocating and freeing the same block always cancels out.
+static size_t     _heapLiveBytes, _heapPeakBytes, _heapBlockCount;
+static const char *_heapPeakTag;
+
+static void _updateHeapUsage(ptrdiff_t incr, const char *tag) {
+	_heapLiveBytes += incr;
+
+	if (_heapLiveBytes > _heapPeakBytes) {
+		_heapPeakBytes = _heapLiveBytes;
+		_heapPeakTag   = tag;
+	}
+}
+
+static inline void _initBlock(
+	Block *block, Block *prev, Block *next, size_t _size, const char *tag
+) {
+	block->ptr  = (void *) &block[1];
+	block->size = _size - sizeof(Block);
+	block->prev = prev;
+	block->next = next;
+#ifdef HEAP_TAGS
+	block->tag  = tag;
+#endif
+
+	_heapBlockCount++;
+	_updateHeapUsage(block->size, tag);
+}
+
 /* Allocator implementation */
 
 static Block *_findBlock(Block *head, size_t size) {
@@ -54,7 +92,7 @@ static Block *_findBlock(Block *head, size_t size) {
 	return prev;
 }
 
-void *malloc(size_t size) {
+void *_mallocTagged(size_t size, const char *tag) {
 	if (!size)
 		return 0;
 
@@ -70,17 +108,11 @@ void *malloc(size_t size) {
 		if (!new)
 			return 0;
 
-		void *ptr = (void *) &new[1];
-		new->ptr  = ptr;
-		new->size = _size - sizeof(Block);
-		new->prev = 0;
-		new->next = 0;
+		_initBlock(new, 0, 0, _size, tag);
 
 		_mallocHead = new;
 		_mallocTail = new;
-
-		_updateHeapUsage(size);
-		return ptr;
+		return new->ptr;
 	}
 
 	// We *may* have the bottom of our heap that has shifted, because of a free.
@@ -89,17 +121,11 @@ void *malloc(size_t size) {
 	if (((uintptr_t) _mallocStart + _size) < ((uintptr_t) _mallocHead)) {
 		Block *new = (Block *) _mallocStart;
 
-		void *ptr = (void *) &new[1];
-		new->ptr  = ptr;
-		new->size = _size - sizeof(Block);
-		new->prev = 0;
-		new->next = _mallocHead;
+		_initBlock(new, 0, _mallocHead, _size, tag);
 
 		_mallocHead->prev = new;
 		_mallocHead       = new;
-
-		_updateHeapUsage(size);
-		return ptr;
+		return new->ptr;
 	}
 
 	// No luck at the beginning of the heap, let's walk the heap to find a fit.
@@ -107,17 +133,11 @@ void *malloc(size_t size) {
 	if (prev) {
 		Block *new = (Block *) ((uintptr_t) prev->ptr + prev->size);
 
-		void *ptr = (void *)((uintptr_t) new + sizeof(Block));
-		new->ptr  = ptr;
-		new->size = _size - sizeof(Block);
-		new->prev = prev;
-		new->next = prev->next;
+		_initBlock(new, prev, prev->next, _size, tag);
 
 		(new->next)->prev = new;
 		prev->next        = new;
-
-		_updateHeapUsage(size);
-		return ptr;
+		return new->ptr;
 	}
 
 	// Time to extend the size of the heap.
@@ -125,17 +145,15 @@ void *malloc(size_t size) {
 	if (!new)
 		return 0;
 
-	void *ptr = (void *) &new[1];
-	new->ptr  = ptr;
-	new->size = _size - sizeof(Block);
-	new->prev = _mallocTail;
-	new->next = 0;
+	_initBlock(new, _mallocTail, 0, _size, tag);
 
 	_mallocTail->next = new;
 	_mallocTail       = new;
+	return new->ptr;
+}
 
-	_updateHeapUsage(size);
-	return ptr;
+void *malloc(size_t size) {
+	return _mallocTagged(size, 0);
 }
 
 void *calloc(size_t num, size_t size) {
@@ -150,40 +168,47 @@ void *realloc(void *ptr, size_t size) {
 	if (!ptr)
 		return malloc(size);
 
-	size_t _size = _align(size + sizeof(Block), 8);
-	Block  *prev = (Block *) ((uintptr_t) ptr - sizeof(Block));
+	size_t _size   = _align(size + sizeof(Block), 8);
+	size_t newSize = _size - sizeof(Block);
+	Block  *prev   = (Block *) ((uintptr_t) ptr - sizeof(Block));
+
+#ifdef HEAP_TAGS
+	const char *tag = prev->tag;
+#else
+	const char *tag = 0;
+#endif
 
 	// New memory block shorter?
-	if (prev->size >= _size) {
-		_updateHeapUsage(size - prev->size);
-		prev->size = _size;
+	if (prev->size >= newSize) {
+		_updateHeapUsage(newSize - prev->size, tag);
+		prev->size = newSize;
 
 		if (!prev->next)
-			sbrk((ptr - sbrk(0)) + _size);
+			sbrk((ptr - sbrk(0)) + newSize);
 
 		return ptr;
 	}
 
 	// New memory block larger; is it the last one?
 	if (!prev->next) {
-		void *new = sbrk(_size - prev->size);
+		void *new = sbrk(newSize - prev->size);
 		if (!new)
 			return 0;
 
-		_updateHeapUsage(size - prev->size);
-		prev->size = _size;
+		_updateHeapUsage(newSize - prev->size, tag);
+		prev->size = newSize;
 		return ptr;
 	}
 
 	// Do we have free memory after it?
-	if (((prev->next)->ptr - ptr) > _size) {
-		_updateHeapUsage(size - prev->size);
-		prev->size = _size;
+	if (((uintptr_t) prev->next - (uintptr_t) ptr) >= newSize) {
+		_updateHeapUsage(newSize - prev->size, tag);
+		prev->size = newSize;
 		return ptr;
 	}
 
 	// No luck.
-	void *new = malloc(size);
+	void *new = _mallocTagged(size, tag);
 	if (!new)
 		return 0;
 
@@ -198,9 +223,10 @@ void free(void *ptr) {
 
 	// First block; bumping head ahead.
 	if (ptr == _mallocHead->ptr) {
-		size_t size = _mallocHead->size;
-		size       += (uintptr_t) _mallocHead->ptr - (uintptr_t) _mallocHead;
-		_mallocHead = _mallocHead->next;
+		size_t payload = _mallocHead->size;
+		size_t size    = payload;
+		size          += (uintptr_t) _mallocHead->ptr - (uintptr_t) _mallocHead;
+		_mallocHead    = _mallocHead->next;
 
 		if (_mallocHead) {
 			_mallocHead->prev = 0;
@@ -209,7 +235,8 @@ void free(void *ptr) {
 			sbrk(-size);
 		}
 
-		_updateHeapUsage(-(_mallocHead->size));
+		_heapBlockCount--;
+		_updateHeapUsage(-payload, 0);
 		return;
 	}
 
@@ -233,6 +260,97 @@ void free(void *ptr) {
 		sbrk(-size);
 	}
 
-	_updateHeapUsage(-(cur->size));
+	_heapBlockCount--;
+	_updateHeapUsage(-(cur->size), 0);
 	(cur->prev)->next = cur->next;
 }
+
+/* Telemetry API */
+
+void getHeapStats(HeapStats *stats) {
+	stats->liveBytes      = _heapLiveBytes;
+	stats->peakBytes      = _heapPeakBytes;
+	stats->blockCount     = _heapBlockCount;
+	stats->heapBytes      = 0;
+	stats->freeBytes      = 0;
+	stats->largestFreeGap = 0;
+	stats->peakTag        = _heapPeakTag;
+
+	if (!_mallocStart)
+		return;
+
+	stats->heapBytes = (uintptr_t) sbrk(0) - (uintptr_t) _mallocStart;
+
+	// Gaps can only exist in front of the first block (left behind by freeing
+	// it) and between blocks, as freeing the last block always shrinks the
+	// heap.
+	uintptr_t bottom = (uintptr_t) _mallocStart;
+
+	for (Block *cur = _mallocHead; cur; cur = cur->next) {
+		size_t gap = (uintptr_t) cur - bottom;
+
+		stats->freeBytes += gap;
+		if (gap > stats->largestFreeGap)
+			stats->largestFreeGap = gap;
+
+		bottom = (uintptr_t) cur->ptr + cur->size;
+	}
+}
+
+void dumpHeap(void) {
+	HeapStats stats;
+	getHeapStats(&stats);
+
+	// Fragmentation is expressed as the percentage of free (gap) memory that
+	// could not be handed out as a single allocation.
+	int fragmentation = 0;
+
+	if (stats.freeBytes)
+		fragmentation =
+			100 - (int) ((stats.largestFreeGap * 100) / stats.freeBytes);
+
+	printf(
+		"heap: %d live, %d peak, %d blocks, %d total, %d free in gaps "
+		"(largest %d, %d%% fragmented)\n",
+		stats.liveBytes,
+		stats.peakBytes,
+		stats.blockCount,
+		stats.heapBytes,
+		stats.freeBytes,
+		stats.largestFreeGap,
+		fragmentation
+	);
+	if (stats.peakTag)
+		printf("heap: peak reached by %s\n", stats.peakTag);
+
+	uintptr_t bottom = (uintptr_t) _mallocStart;
+
+	for (Block *cur = _mallocHead; cur; cur = cur->next) {
+		if ((uintptr_t) cur > bottom)
+			printf("  %08x %8d free\n", bottom, (uintptr_t) cur - bottom);
+
+#ifdef HEAP_TAGS
+		const char *tag = cur->tag ? cur->tag : "?";
+#else
+		const char *tag = "";
+#endif
+
+		printf("  %08x %8d used %s\n", (uintptr_t) cur, cur->size, tag);
+		bottom = (uintptr_t) cur->ptr + cur->size;
+	}
+
+	if (_mallocStart)
+		printf("  %08x          top\n", (uintptr_t) sbrk(0));
+
+	printf(
+		"  %08x          limit (%d KB RAM)\n",
+		(uintptr_t) getHeapLimit(),
+		getRAMSize() / 1024
+	);
+	printf(
+		"stack: %d peak / %d reserved%s\n",
+		getStackPeakUsage(),
+		getStackSize(),
+		checkStackGuard() ? "" : " (OVERFLOWED)"
+	);
+}
@@ -14,11 +14,32 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include "../ps1/registers.h"
+#include "../ps1/system.h"
 
 /* Serial port stdin/stdout */
 
+// Once enableSerialBuffering() is called, output is copied into a ring buffer
+// and sent from the SIO1 TX interrupt rather than by busy-waiting for each
+// byte, so printing only costs a memory copy. When the buffer is full, further
+// output is dropped (and counted) instead of stalling the caller. Must be a
+// power of 2.
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 4096
+#endif
+
+#define TX_BUFFER_MASK (SERIAL_TX_BUFFER_SIZE - 1)
+
+static volatile uint8_t  _txBuffer[SERIAL_TX_BUFFER_SIZE];
+static volatile uint16_t _txHead = 0, _txTail = 0;
+static volatile uint32_t _txDropped = 0;
+static bool              _txBuffered = false;
+
 void initSerialIO(int baud) {
 	SIO_CTRL(1) = SIO_CTRL_RESET;
 
@@ -33,7 +54,7 @@ void initSerialIO(int baud) {
 		| SIO_CTRL_RTS;
 }
 
-void _putchar(char ch) {
+static void _putcharSync(char ch) {
 	// The serial interface will buffer but not send any data if the CTS input
 	// is not asserted, so we are going to abort if CTS is not set to avoid
 	// waiting forever.
@@ -46,6 +67,108 @@ void _putchar(char ch) {
 		SIO_DATA(1) = ch;
 }
 
+// Moves as many bytes as the SIO1 TX FIFO can currently take out of the ring
+// buffer. Must be called with interrupts disabled.
+static bool _drainTXBuffer(void) {
+	uint16_t tail = _txTail;
+
+	while ((tail != _txHead) && (SIO_STAT(1) & SIO_STAT_TX_NOT_FULL)) {
+		SIO_DATA(1) = _txBuffer[tail];
+		tail        = (tail + 1) & TX_BUFFER_MASK;
+	}
+
+	_txTail = tail;
+	return (tail == _txHead);
+}
+
+static void _serialTXHandler(void *arg) {
+	// Stop asking for TX interrupts once there is nothing left to send, as the
+	// IRQ is raised for as long as the FIFO is not full.
+	if (_drainTXBuffer())
+		SIO_CTRL(1) &= ~SIO_CTRL_TX_IRQ_ENABLE;
+
+	SIO_CTRL(1) |= SIO_CTRL_ACKNOWLEDGE;
+}
+
+void enableSerialBuffering(void) {
+	_txHead     = 0;
+	_txTail     = 0;
+	_txBuffered = true;
+
+	setIRQHandler(IRQ_SIO1, &_serialTXHandler, 0);
+}
+
+void flushSerialIO(void) {
+	if (!_txBuffered)
+		return;
+
+	int state = enterCriticalSection();
+
+	while (!_drainTXBuffer()) {
+		// Give up and throw away whatever is left if the other end is not
+		// listening, as the FIFO would never empty otherwise.
+		if (!(SIO_STAT(1) & SIO_STAT_CTS)) {
+			_txDropped += (_txHead - _txTail) & TX_BUFFER_MASK;
+			_txTail     = _txHead;
+			break;
+		}
+	}
+
+	SIO_CTRL(1) &= ~SIO_CTRL_TX_IRQ_ENABLE;
+	exitCriticalSection(state);
+}
+
+uint32_t getSerialDroppedBytes(void) {
+	return _txDropped;
+}
+
+size_t getSerialTXSpace(void) {
+	// Unbuffered output never drops anything (it blocks instead).
+	if (!_txBuffered)
+		return SERIAL_TX_BUFFER_SIZE - 1;
+
+	return (_txTail - _txHead - 1) & TX_BUFFER_MASK;
+}
+
+size_t _serialWrite(const void *data, size_t length) {
+	const char *ptr = (const char *) data;
+
+	if (!_txBuffered) {
+		for (size_t i = length; i; i--)
+			_putcharSync(*(ptr++));
+
+		return length;
+	}
+
+	int      state = enterCriticalSection();
+	uint16_t head  = _txHead;
+	size_t   space = (_txTail - head - 1) & TX_BUFFER_MASK;
+	size_t   count = (length < space) ? length : space;
+
+	for (size_t i = count; i; i--) {
+		_txBuffer[head] = *(ptr++);
+		head            = (head + 1) & TX_BUFFER_MASK;
+	}
+
+	_txHead     = head;
+	_txDropped += length - count;
+
+	// Kick off the transfer right away rather than waiting for the IRQ, then
+	// let the IRQ take care of the rest (if any).
+	if (!_drainTXBuffer())
+		SIO_CTRL(1) |= SIO_CTRL_TX_IRQ_ENABLE;
+
+	exitCriticalSection(state);
+	return count;
+}
+
+void _putchar(char ch) {
+	if (_txBuffered)
+		_serialWrite(&ch, 1);
+	else
+		_putcharSync(ch);
+}
+
 int _getchar(void) {
 	while (!(SIO_STAT(1) & SIO_STAT_RX_NOT_EMPTY))
 		__asm__ volatile("");
@@ -54,13 +177,11 @@ int _getchar(void) {
 }
 
 int _puts(const char *str) {
-	int length = 1;
-
-	for (; *str; str++, length++)
-		_putchar(*str);
+	size_t length = strlen(str);
 
+	_serialWrite(str, length);
 	_putchar('\n');
-	return length;
+	return length + 1;
 }
 
 /* Abort functions */
@@ -68,6 +189,7 @@ int _puts(const char *str) {
 void _assertAbort(const char *file, int line, const char *expr) {
 #ifndef NDEBUG
 	printf("%s:%d: assert(%s)\n", file, line, expr);
+	flushSerialIO();
 #endif
 
 	for (;;)
@@ -77,6 +199,7 @@ void _assertAbort(const char *file, int line, const char *expr) {
 void abort(void) {
 #ifndef NDEBUG
 	puts("abort()");
+	flushSerialIO();
 #endif
 
 	for (;;)
@@ -86,6 +209,7 @@ void abort(void) {
 void __cxa_pure_virtual(void) {
 #ifndef NDEBUG
 	puts("__cxa_pure_virtual()");
+	flushSerialIO();
 #endif
 
 	for (;;)
@@ -0,0 +1,47 @@
+# ps1-bare-metal - (C) 2023 spicyjpeg
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+
+.set noreorder
+
+# int _callOnStack(
+#     int (*func)(int, const char **), int argc, const char **argv,
+#     void *stackTop
+# );
+#
+# Calls func(argc, argv) with the stack pointer moved to the given address, then
+# switches back to the original stack once it returns. Used by _start() to move
+# the stack to the top of RAM when more than 2 MB are available. The old stack
+# pointer and return address are saved right below the new stack's top, along
+# with the 16 bytes of argument space the ABI requires callers to reserve.
+
+.section .text._callOnStack, "ax", @progbits
+.global _callOnStack
+.type _callOnStack, @function
+
+_callOnStack:
+	addiu $a3, -24
+	sw    $ra, 0x10($a3)
+	sw    $sp, 0x14($a3)
+	move  $sp, $a3
+
+	move  $t0, $a0
+	move  $a0, $a1
+	jalr  $t0
+	move  $a1, $a2
+
+	lw    $ra, 0x10($sp)
+	lw    $sp, 0x14($sp)
+
+	jr    $ra
+	nop
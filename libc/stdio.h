@@ -16,6 +16,9 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 // Include printf() from the third-party library.
 #include "../vendor/printf.h"
 
@@ -36,6 +39,44 @@ extern "C" {
  */
 void initSerialIO(int baud);
 
+/**
+ * @brief Switches serial output from busy-waiting on each byte to copying it
+ * into a ring buffer (SERIAL_TX_BUFFER_SIZE bytes), which is then sent from the
+ * SIO1 TX interrupt. Requires installExceptionHandler() to have been called.
+ * Output that does not fit in the buffer is dropped rather than blocking; see
+ * getSerialDroppedBytes().
+ */
+void enableSerialBuffering(void);
+
+/**
+ * @brief Blocks until all buffered serial output has been sent. Safe to call
+ * with interrupts disabled (e.g. before hanging in an error handler).
+ */
+void flushSerialIO(void);
+
+/**
+ * @brief Returns the number of bytes of serial output dropped so far due to
+ * the TX buffer being full.
+ */
+uint32_t getSerialDroppedBytes(void);
+
+/**
+ * @brief Returns how many bytes can currently be written to the serial port
+ * without any of them being dropped. Useful to avoid splitting up binary data.
+ */
+size_t getSerialTXSpace(void);
+
+/**
+ * @brief Writes raw bytes to the serial port, going through the TX buffer if
+ * enabled.
+ *
+ * @param data
+ * @param length
+ * @return Number of bytes actually written (less than length if some were
+ * dropped)
+ */
+size_t _serialWrite(const void *data, size_t length);
+
 void _putchar(char ch);
 int _getchar(void);
 int _puts(const char *str);
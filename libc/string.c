@@ -20,6 +20,26 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* Word-at-a-time helpers */
+
+// Most functions below process 4 bytes at a time once the pointer they read
+// from has been aligned. Accesses through this packed struct are compiled into
+// lwl/lwr (or swl/swr) pairs, which handle the other pointer being misaligned
+// without falling back to byte loads.
+typedef struct __attribute__((packed)) {
+	uint32_t value;
+} UnalignedWord;
+
+#define _WORD_ALIGNED(ptr) (!(((uintptr_t) (ptr)) & 3))
+#define _loadUnaligned(ptr) (((const UnalignedWord *) (ptr))->value)
+#define _storeUnaligned(ptr, word) (((UnalignedWord *) (ptr))->value = (word))
+
+// Evaluates to non-zero if any of the 4 bytes in the word is zero. Bytes above
+// the first zero byte may be flagged incorrectly, so the exact position must be
+// found by checking each byte.
+#define _hasZeroByte(word) \
+	(((word) - 0x01010101) & ~(word) & 0x80808080)
+
 /* Character manipulation */
 
 int isprint(int ch) {
@@ -107,13 +127,31 @@ void *memmove(void *dest, const void *src, size_t count) {
 	if ((_dest >= &_src[count]) || (&_dest[count] <= _src))
 		return memcpy(dest, src, count);
 
+	// The destination is aligned first, as unaligned stores are more expensive
+	// than unaligned loads. Each word is read in full before being written, so
+	// overlapping by less than 4 bytes is still handled correctly.
 	if (_dest < _src) { // Copy forwards
+		for (; count && !_WORD_ALIGNED(_dest); count--)
+			*(_dest++) = *(_src++);
+
+		for (; count >= 4; count -= 4, _dest += 4, _src += 4)
+			*((uint32_t *) _dest) = _loadUnaligned(_src);
+
 		for (; count; count--)
 			*(_dest++) = *(_src++);
 	} else { // Copy backwards
 		_src  += count;
 		_dest += count;
 
+		for (; count && !_WORD_ALIGNED(_dest); count--)
+			*(--_dest) = *(--_src);
+
+		for (; count >= 4; count -= 4) {
+			_dest -= 4;
+			_src  -= 4;
+			*((uint32_t *) _dest) = _loadUnaligned(_src);
+		}
+
 		for (; count; count--)
 			*(--_dest) = *(--_src);
 	}
@@ -125,6 +163,20 @@ int memcmp(const void *lhs, const void *rhs, size_t count) {
 	const uint8_t *_lhs = (const uint8_t *) lhs;
 	const uint8_t *_rhs = (const uint8_t *) rhs;
 
+	for (; count && !_WORD_ALIGNED(_lhs); count--) {
+		uint8_t a = *(_lhs++), b = *(_rhs++);
+
+		if (a != b)
+			return ((int) a) - ((int) b);
+	}
+
+	// Skip over identical words, then let the byte loop below find which byte
+	// in the mismatching word (if any) differs.
+	for (; count >= 4; count -= 4, _lhs += 4, _rhs += 4) {
+		if (*((const uint32_t *) _lhs) != _loadUnaligned(_rhs))
+			break;
+	}
+
 	for (; count; count--) {
 		uint8_t a = *(_lhs++), b = *(_rhs++);
 
@@ -137,9 +189,26 @@ int memcmp(const void *lhs, const void *rhs, size_t count) {
 
 void *memchr(const void *ptr, int ch, size_t count) {
 	const uint8_t *_ptr = (const uint8_t *) ptr;
+	uint8_t       _ch   = (uint8_t) ch;
+
+	for (; count && !_WORD_ALIGNED(_ptr); count--, _ptr++) {
+		if (*_ptr == _ch)
+			return (void *) _ptr;
+	}
+
+	// XORing each word with the character repeated 4 times turns any matching
+	// byte into a zero byte.
+	uint32_t pattern = _ch * 0x01010101;
+
+	for (; count >= 4; count -= 4, _ptr += 4) {
+		uint32_t word = *((const uint32_t *) _ptr) ^ pattern;
+
+		if (_hasZeroByte(word))
+			break;
+	}
 
 	for (; count; count--, _ptr++) {
-		if (*_ptr == ch)
+		if (*_ptr == _ch)
 			return (void *) _ptr;
 	}
 
@@ -151,10 +220,25 @@ void *memchr(const void *ptr, int ch, size_t count) {
 char *strcpy(char *restrict dest, const char *restrict src) {
 	char *_dest = dest;
 
-	while (*src)
-		*(_dest++) = *(src++);
+	for (; !_WORD_ALIGNED(src); src++, _dest++) {
+		if (!(*_dest = *src))
+			return dest;
+	}
+
+	// Reading a whole aligned word past the terminator is safe, as it can't
+	// cross into a different (possibly unmapped) memory region.
+	for (;; src += 4, _dest += 4) {
+		uint32_t word = *((const uint32_t *) src);
+
+		if (_hasZeroByte(word))
+			break;
+
+		_storeUnaligned(_dest, word);
+	}
+
+	while ((*(_dest++) = *(src++)))
+		;
 
-	*_dest = 0;
 	return dest;
 }
 
@@ -240,12 +324,20 @@ char *strstr(const char *str, const char *substr) {
 }
 
 size_t strlen(const char *str) {
-	size_t length = 0;
+	const char *ptr = str;
 
-	for (; *str; str++)
-		length++;
+	for (; !_WORD_ALIGNED(ptr); ptr++) {
+		if (!*ptr)
+			return ptr - str;
+	}
 
-	return length;
+	while (!_hasZeroByte(*((const uint32_t *) ptr)))
+		ptr += 4;
+
+	while (*ptr)
+		ptr++;
+
+	return ptr - str;
 }
 
 // Non-standard, used internally
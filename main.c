@@ -9,93 +9,150 @@
 #include "lib/trig.h"
 #include "lib/obj.h"
 #include "lib/draw.h"
+#include "lib/entity.h"
 #include "lib/pad.h"
 #include "lib/setup.h"
 #include "lib/font.h"
+#include "lib/scratch.h"
+#include "lib/benchmark.h"
+#include "lib/trace.h"
+#include "lib/replay.h"
+#include "lib/memcard.h"
+#include "lib/world.h"
+#include "lib/sim.h"
 
 
 int main(int argc, const char **argv) 
 {
 	//set up gpu and gte and serial and controller and everything
 	GeneralSetup();
+#ifdef RUN_BENCHMARKS
+	RunStringBenchmarks();
+	RunDecompressBenchmarks();
+	RunMDECBenchmark();
+#endif
+#ifdef RUN_MEMCARD_TEST
+	MemcardSelfTest(0);
+#endif
+	//record/play back input so profiling runs are repeatable, see replay.h
+	ReplayInit();
 	//create dma chains/buffers
-	DMAChain dmaChains[2];
+	// - static, these are ~70KB each and would blow way past the reserved stack (see STACK_SIZE in crt0.c)
+	static DMAChain dmaChains[2];
 	bool     usingSecondFrame = false;
 
 	//create draw stuff
 	// - camera
 	Camera camera = {0};
 	camera.pitch = -128;
-	// - create drawable ground object
-	DrawObj groundObj = CreateDrawObj(
-		0,0,0, 0,0,0, 
-		NUM_LEVEL_FACES, levelFaces, 
-		NUM_LEVEL_VERTICES, levelVertices
-	);
-	// - create drawable player object
-	DrawObj playerObj = CreateDrawObj(
-		0,0,128, 0,0,0, 
-		NUM_PLAYER_FACES, playerFaces, 
-		NUM_PLAYER_VERTICES, playerVertices
-	);
-	playerObj.isTextured = true;
-	playerObj.textinfo = &playerTextInfo;
-	playerObj.textCoords = playerTextCoords; //this guy is an array so already pointer
+	// - meshes, shared by every entity that uses them
+	static EntityMesh groundMesh, playerMesh;
+	EntityMeshInit(&groundMesh, NUM_LEVEL_FACES, levelFaces, NUM_LEVEL_VERTICES, levelVertices, NULL);
+	EntityMeshInit(&playerMesh, NUM_PLAYER_FACES, playerFaces, NUM_PLAYER_VERTICES, playerVertices, playerTextCoords);
+	// - entities, see entity.h
+	EntityArenaInit();
+	PoolHandle player = EntitySpawn(&playerMesh, 0,0,128);
+	EntitySetTexture(player, &playerTextInfo, TEXCACHE_NONE);
+	// - streamed world, if there's one on the disc, otherwise just the built in level
+	bool streamWorld = WorldOpen("WORLD.PAK");
+	if (!streamWorld)
+	{
+		PoolHandle ground = EntitySpawn(&groundMesh, 0,0,0);
+		entities.flags[EntityIndex(ground)] |= ENTITY_NO_CULL; //the camera is always standing on it
+	}
+	// - music, only without a streamed world since the drive can't load cells while it plays
+	if (!streamWorld){MusicPlay("MUSIC.XA", 0, true);}
 
 	while(true)
 	{
+		//game logic runs in fixed steps, as many as are due since last frame (see sim.h)
+		int steps = SimBeginFrame();
+		TRACE_BEGIN_ARGS(TRACE_ID_FRAME, steps, 0);
 		//prep for next frame
 		int bufferX = usingSecondFrame ? SCREEN_WIDTH : 0;
 		int bufferY = 0;
 
 		DMAChain *chain  = &dmaChains[usingSecondFrame];
+		FrameScratchBegin(usingSecondFrame); //per frame scratch memory follows the chain
 		usingSecondFrame = !usingSecondFrame;
 
 		GPU_GP1 = gp1_fbOffset(bufferX, bufferY);
 
 		clearOrderingTable(chain->orderingTable, ORDERING_TABLE_SIZE);
 		chain->nextPacket = chain->data;
+		TexCacheBeginFrame();
 
-		//gather user input
-		PlayerInput in = GetControllerInput(PLAYER_ONE);
-		// - player
-		if(in.up){playerObj.z+=4;}
-		if(in.down){playerObj.z-=4;}
-		if(in.right){playerObj.x+=4;}
-		if(in.left){playerObj.x-=4;}
-		// - cam
-		if(in.L1){camera.orbit_yaw-=8;}
-		if(in.R1){camera.orbit_yaw+=8;}
-		if(in.L2){camera.pitch+=8;}
-		if(in.R2){camera.pitch-=8;}
+		int p = EntityIndex(player);
+		int16_t *playerX = &entities.x[p], *playerY = &entities.y[p], *playerZ = &entities.z[p];
+		TRACE_BEGIN(TRACE_ID_UPDATE); //one span for all the steps, a pair per step would blow the trace budget
+		for (int step = 0; step < steps; step++)
+		{
+			//gather user input, once per step so replays stay in sync with the game
+			PlayerInput in = ReplayInput(PLAYER_ONE);
+			// - player
+			int16_t oldX = *playerX, oldZ = *playerZ;
+			if(in.held & BTN_UP){*playerZ+=4;}
+			if(in.held & BTN_DOWN){*playerZ-=4;}
+			if(in.held & BTN_RIGHT){*playerX+=4;}
+			if(in.held & BTN_LEFT){*playerX-=4;}
+			// - slide along walls, try each axis on its own so hitting one doesn't stop the other
+			if(WorldBlocked(*playerX, *playerY, oldZ)){*playerX = oldX;}
+			if(WorldBlocked(*playerX, *playerY, *playerZ)){*playerZ = oldZ;}
+			// - cam
+			if(in.held & BTN_L1){camera.orbit_yaw-=8;}
+			if(in.held & BTN_R1){camera.orbit_yaw+=8;}
+			if(in.held & BTN_L2){camera.pitch+=8;}
+			if(in.held & BTN_R2){camera.pitch-=8;}
+		}
+		TRACE_END(TRACE_ID_UPDATE);
+		//keep the cells around the player (and where they're headed) loaded
+		WorldUpdate(*playerX, *playerZ, steps);
 		//set camera
 		int16_t rise = isin(camera.orbit_yaw);
 		int16_t run = icos(camera.orbit_yaw);
 		//fixed point math, bit shift after multiply
 		// - 12 bits because 2048 = PI 
 		// - and 1 on unit circle is 4096
-		camera.x = playerObj.x + ((run * CAMERA_DIST_RADIUS) >> 12); 
-		camera.z = playerObj.z - ((rise * CAMERA_DIST_RADIUS) >> 12);
-		camera.y = playerObj.y - (200);   // some height, y is inverted?
+		camera.x = *playerX + ((run * CAMERA_DIST_RADIUS) >> 12); 
+		camera.z = *playerZ - ((rise * CAMERA_DIST_RADIUS) >> 12);
+		camera.y = *playerY - (200);   // some height, y is inverted?
 		//set the camera yaw to point at the player
-		int16_t dx = playerObj.x - camera.x;
-		int16_t dz = playerObj.z - camera.z;
+		int16_t dx = *playerX - camera.x;
+		int16_t dz = *playerZ - camera.z;
 		camera.yaw = atan2(dx,dz);
 
+		TRACE_BEGIN(TRACE_ID_DRAW);
 		//font test
 		printString(chain, &font, 16, 16, "hello world!\n");
 		//*(chain->nextPacket) = gp0_endTag(0);
-		//will be a loop in the future over each object in the display arena
-			//draw the character
-			DrawObject(chain, &playerObj, &camera);
-			//draw the ground
-			DrawObject(chain, &groundObj, &camera);
+		//everything in the entity arena that's in view, sorted by texture
+		EntityBuildDrawList(&camera);
+		EntityDrawList(chain, &camera);
+		if(streamWorld){WorldDraw(chain, &camera);}
 		//finish it up
 		FinishDraw(chain, bufferX, bufferY);
+		TRACE_END(TRACE_ID_DRAW);
+		//these barely move from frame to frame, only send them when they do (trace budget)
+		TRACE_COUNTER_CHANGED(TRACE_ID_SCRATCH, FrameScratchHighWater());
+		TRACE_COUNTER_CHANGED(TRACE_ID_TEX_HITS, texCache.stats.hits);
+		TRACE_COUNTER_CHANGED(TRACE_ID_TEX_MISSES, texCache.stats.misses);
+		TRACE_COUNTER_CHANGED(TRACE_ID_TEX_UPLOAD, texCache.stats.uploadBytes);
+		TRACE_COUNTER_CHANGED(TRACE_ID_ENTITIES, entities.drawCount);
 		
+		TRACE_BEGIN(TRACE_ID_GPU_WAIT);
 		waitForGP0Ready();
-		waitForVSync();
+		TRACE_END(TRACE_ID_GPU_WAIT);
+		TRACE_BEGIN(TRACE_ID_VSYNC_WAIT);
+		SimWaitVSync();
+		TRACE_END(TRACE_ID_VSYNC_WAIT);
+		//poll the controllers in the background while the next frame gets going, the
+		//results show up in GetControllerInput next frame
+		PadStartPoll();
+		//key on/off for everything played this frame goes out together
+		SoundUpdate();
 		sendLinkedList(&(chain->orderingTable)[ORDERING_TABLE_SIZE - 1]);
+		TRACE_END(TRACE_ID_FRAME);
+		TRACE_FLUSH();
 	}
 	return 0;
 }
@@ -0,0 +1,4 @@
+#!/bin/sh
+# linux version of play.bat, serial output goes to the terminal and build/log.txt
+cd "$(dirname "$0")" || exit 1
+pcsx-redux -run -stdout -logfile build/log.txt -exe build/game.psexe
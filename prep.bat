@@ -27,12 +27,44 @@ REM generate player texture and palette .S
 python tools\linkData.py playerTexture assets\dat\char_01_t.dat
 python tools\linkData.py playerPalette assets\dat\char_01_p.dat
 
+REM or pack textures into shared pages instead (fewer texpage switches), remapping the mesh uvs to match
+REM python tools\packAtlas.py -H lib\atlas.h assets\dat player=assets\png\char01.png,assets\dat\player_vert_text.dat
+
+REM images with too many colors can be reduced with -q (median cut) or -d (also dithered)
+REM python tools\convertImage.py -b 4 -d assets\png\photo.png assets\dat\photo_t.dat assets\dat\photo_p.dat
+REM or convert several at once sharing as few palettes as possible (ids go in the header)
+REM python tools\shareCluts.py -b 4 -H lib\cluts.h assets\dat assets\png\char01.png assets\png\font.png
+
+REM full screen backgrounds and cutscenes for the mdec (lib/mdec.h), several images make a sequence
+REM python tools\encodeMDEC.py -s 4 assets\dat\title.mdc assets\png\title.png
+
 REM generate font data files
 python tools\convertImage.py -b 4 assets\png\font.png assets\dat\fontTexture.dat assets\dat\fontPalette.dat
 REM generate font and palette .S
 python tools\linkData.py fontTexture assets\dat\fontTexture.dat
 python tools\linkData.py fontPalette assets\dat\fontPalette.dat
 
+REM input replay for -DREPLAY_PLAYBACK builds (pull the recording out of a serial log first)
+REM python tools\convertReplay.py build\log.txt assets\dat\replay.rpl
+REM python tools\linkData.py replayData assets\dat\replay.rpl
+
+REM prebuilt file index for a fixed disc layout, pass isoIndexData to useISOIndex() instead of calling buildISOIndex()
+REM python tools\buildIsoIndex.py build\game.bin assets\dat\isoIndex.dat
+REM python tools\linkData.py isoIndexData assets\dat\isoIndex.dat
+
+REM once assets are loaded from disc, bundle the .dat files into one compressed archive (see lib/archive.h) instead of linking each one
+REM python tools\packArchive.py assets\dat\data.pak assets\dat\*.dat
+
+REM streamed world (lib/world.h), goes on the disc as WORLD.PAK
+REM python tools\buildWorld.py -c 2048 -s 16 -t assets\png\world.png assets\obj\world.obj assets\dat\world.pak
+
+REM sound effects (lib/sound.h), pass the linked data to SoundLoad
+REM python tools\convertAudio.py -r 22050 assets\wav\jump.wav assets\dat\jump.vag
+REM python tools\linkData.py jumpSound assets\dat\jump.vag
+
+REM music (lib/sound.h), one channel per .wav, goes on the disc as MUSIC.XA (as an xa file, 2336 byte sectors)
+REM python tools\buildXA.py assets\dat\music.xa assets\wav\calm.wav assets\wav\battle.wav
+
 
 
 REM addBinaryFile(example06_fonts fontTexture "${PROJECT_BINARY_DIR}/example06/fontTexture.dat")
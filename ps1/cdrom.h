@@ -40,8 +40,8 @@ typedef enum {
 typedef enum {
 	CDROM_XA_CI_STEREO              = 1 << 0,
 	CDROM_XA_CI_SAMPLE_RATE_BITMASK = 1 << 2,
-	CDROM_XA_CI_SAMPLE_RATE_18900   = 0 << 2,
-	CDROM_XA_CI_SAMPLE_RATE_37800   = 1 << 2,
+	CDROM_XA_CI_SAMPLE_RATE_37800   = 0 << 2,
+	CDROM_XA_CI_SAMPLE_RATE_18900   = 1 << 2,
 	CDROM_XA_CI_BITS_BITMASK        = 1 << 4,
 	CDROM_XA_CI_BITS_4              = 0 << 4,
 	CDROM_XA_CI_BITS_8              = 1 << 4,
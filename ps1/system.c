@@ -0,0 +1,191 @@
+/*
+ * ps1-bare-metal - (C) 2023-2025 spicyjpeg
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "cop0.h"
+#include "registers.h"
+#include "system.h"
+
+#define NUM_IRQ_CHANNELS 11
+#define NUM_DMA_CHANNELS 7
+
+#define EXCEPTION_VECTOR 0x80000080
+
+typedef struct {
+	ArgFunction func;
+	void        *arg;
+} Handler;
+
+extern const uint32_t _exceptionVector[4];
+
+static Handler  _irqHandlers[NUM_IRQ_CHANNELS];
+static Handler  _dmaHandlers[NUM_DMA_CHANNELS];
+static uint32_t _irqCounts[NUM_IRQ_CHANNELS];
+
+/* Interrupt dispatching */
+
+static void _dmaIRQHandler(void *arg) {
+	uint32_t dicr = DMA_DICR;
+	uint32_t done = (dicr & DMA_DICR_CH_STAT_BITMASK) >> 24;
+
+	// Writing 1 to a channel's status bit clears it; the bus error flag and
+	// master IRQ flag are write-to-clear/read-only as well, so leave them out.
+	DMA_DICR = (dicr & (DMA_DICR_CH_MODE_BITMASK | DMA_DICR_CH_ENABLE_BITMASK
+		| DMA_DICR_IRQ_ENABLE)) | (done << 24);
+
+	for (int i = 0; i < NUM_DMA_CHANNELS; i++, done >>= 1) {
+		Handler *handler = &_dmaHandlers[i];
+
+		if ((done & 1) && handler->func)
+			handler->func(handler->arg);
+	}
+}
+
+static void _fatalException(uint32_t cause, uint32_t epc) {
+	// Interrupts are disabled at this point, so anything still buffered has
+	// to be pushed out manually.
+	flushSerialIO();
+	printf(
+		"exception %d at %08x (cause %08x, badvaddr %08x)\n",
+		(cause & COP0_CAUSE_EXC_BITMASK) >> 2, epc, cause,
+		cop0_getReg(COP0_BADVADDR)
+	);
+	flushSerialIO();
+
+	for (;;)
+		__asm__ volatile("");
+}
+
+uint32_t _handleException(uint32_t cause, uint32_t epc) {
+	if ((cause & COP0_CAUSE_EXC_BITMASK) != COP0_CAUSE_EXC_INT)
+		_fatalException(cause, epc);
+
+	// If the interrupt arrived while a GTE command was about to be executed,
+	// the command has actually already been executed by the GTE despite EPC
+	// still pointing to it. Returning to EPC would run the command twice, so
+	// skip over it. GTE commands are the only instructions with bits 25-31 set
+	// to 0100101 (COP2 with the CO bit set).
+	if (!(cause & COP0_CAUSE_BD)) {
+		uint32_t instruction = *((const uint32_t *) epc);
+
+		if ((instruction >> 25) == 0x25)
+			epc += 4;
+	}
+
+	uint32_t pending = IRQ_STAT & IRQ_MASK;
+
+	for (int i = 0; pending; i++, pending >>= 1) {
+		if (!(pending & 1))
+			continue;
+
+		Handler *handler = &_irqHandlers[i];
+
+		_irqCounts[i]++;
+		if (handler->func)
+			handler->func(handler->arg);
+
+		// Acknowledge the IRQ only after the handler has had a chance to clear
+		// the source's own flag, otherwise level-triggered sources such as the
+		// SIO ports would immediately raise it again.
+		IRQ_STAT = ~(1 << i);
+	}
+
+	return epc;
+}
+
+/* Public API */
+
+void installExceptionHandler(void) {
+	cop0_disableInterrupts();
+
+	IRQ_MASK = 0;
+	IRQ_STAT = 0;
+	DMA_DICR = DMA_DICR_CH_STAT_BITMASK;
+
+	volatile uint32_t *vector = (volatile uint32_t *) EXCEPTION_VECTOR;
+
+	for (int i = 0; i < 4; i++)
+		vector[i] = _exceptionVector[i];
+
+	flushCache();
+
+	// Unmask hardware interrupts (the IRQ controller is wired to COP0 IRQ 2)
+	// and enable interrupts.
+	cop0_setReg(COP0_CAUSE, 0);
+	cop0_setReg(
+		COP0_STATUS,
+		(cop0_getReg(COP0_STATUS) & ~COP0_STATUS_BEV)
+			| COP0_STATUS_Im2
+			| COP0_STATUS_IEc
+	);
+}
+
+void setIRQHandler(IRQChannel channel, ArgFunction func, void *arg) {
+	int state = enterCriticalSection();
+
+	_irqHandlers[channel].func = func;
+	_irqHandlers[channel].arg  = arg;
+
+	if (func) {
+		IRQ_MASK |= 1 << channel;
+	} else {
+		IRQ_MASK &= ~(1 << channel);
+		IRQ_STAT  = ~(1 << channel);
+	}
+
+	exitCriticalSection(state);
+}
+
+void setDMAHandler(DMAChannel channel, ArgFunction func, void *arg) {
+	int state = enterCriticalSection();
+
+	_dmaHandlers[channel].func = func;
+	_dmaHandlers[channel].arg  = arg;
+
+	// Avoid writing back any status bits that are currently set, as that would
+	// clear them.
+	uint32_t dicr = DMA_DICR
+		& (DMA_DICR_CH_MODE_BITMASK | DMA_DICR_CH_ENABLE_BITMASK);
+
+	if (func)
+		dicr |= DMA_DICR_CH_ENABLE(channel);
+	else
+		dicr &= ~DMA_DICR_CH_ENABLE(channel);
+
+	if (dicr & DMA_DICR_CH_ENABLE_BITMASK) {
+		DMA_DICR = dicr | DMA_DICR_IRQ_ENABLE;
+		setIRQHandler(IRQ_DMA, &_dmaIRQHandler, 0);
+	} else {
+		DMA_DICR = dicr;
+		setIRQHandler(IRQ_DMA, 0, 0);
+	}
+
+	exitCriticalSection(state);
+}
+
+int enterCriticalSection(void) {
+	return cop0_disableInterrupts() ? 1 : 0;
+}
+
+void exitCriticalSection(int state) {
+	if (state)
+		cop0_enableInterrupts();
+}
+
+uint32_t getIRQCount(IRQChannel channel) {
+	return _irqCounts[channel];
+}
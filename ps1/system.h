@@ -16,6 +16,11 @@
 
 #pragma once
 
+#include <stdint.h>
+#include "registers.h"
+
+typedef void (*ArgFunction)(void *arg);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -26,6 +31,66 @@ extern "C" {
  */
 void flushCache(void);
 
+/**
+ * @brief Replaces the BIOS's exception handler with a minimal one that
+ * dispatches interrupts to the callbacks registered through setIRQHandler() and
+ * setDMAHandler(), then enables interrupts. Note that BIOS functions relying on
+ * the BIOS's own handler (events, threads, the BIOS's controller and memory
+ * card drivers) will no longer work after calling this.
+ *
+ * IRQ channels without a handler are left masked, so code polling IRQ_STAT for
+ * them (such as waitForVSync()) keeps working as before.
+ */
+void installExceptionHandler(void);
+
+/**
+ * @brief Registers a callback to be invoked from the exception handler when
+ * the given IRQ is raised, and unmasks it. Passing a null function masks the
+ * IRQ again. The callback runs with interrupts disabled and must acknowledge
+ * the interrupt at the source (e.g. SIO_CTRL_ACKNOWLEDGE) if required; IRQ_STAT
+ * is acknowledged by the dispatcher after the callback returns.
+ *
+ * @param channel
+ * @param func
+ * @param arg Passed as-is to the callback
+ */
+void setIRQHandler(IRQChannel channel, ArgFunction func, void *arg);
+
+/**
+ * @brief Registers a callback to be invoked when a DMA channel finishes a
+ * transfer, and enables the DMA completion IRQ for that channel. Passing a null
+ * function disables it again.
+ *
+ * @param channel
+ * @param func
+ * @param arg Passed as-is to the callback
+ */
+void setDMAHandler(DMAChannel channel, ArgFunction func, void *arg);
+
+/**
+ * @brief Disables interrupts and returns whether they were enabled
+ * beforehand. Pair with exitCriticalSection() to protect data shared with IRQ
+ * callbacks; nesting is supported.
+ */
+int enterCriticalSection(void);
+
+/**
+ * @brief Re-enables interrupts if the state returned by the matching
+ * enterCriticalSection() call says they were enabled.
+ *
+ * @param state
+ */
+void exitCriticalSection(int state);
+
+/**
+ * @brief Returns the number of times each IRQ channel has fired since
+ * installExceptionHandler() was called. Useful to check that a driver is
+ * actually receiving its interrupts.
+ *
+ * @param channel
+ */
+uint32_t getIRQCount(IRQChannel channel);
+
 #ifdef __cplusplus
 }
 #endif
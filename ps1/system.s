@@ -0,0 +1,133 @@
+# ps1-bare-metal - (C) 2023-2025 spicyjpeg
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+
+.set noreorder
+.set noat
+
+# The CPU jumps to 0x80000080 whenever an exception (including interrupts)
+# occurs. There are only 32 bytes available there before the next vector, so
+# installExceptionHandler() copies the small stub below to that address and the
+# stub in turn jumps to the actual handler. As the program never runs in user
+# mode and never moves the stack pointer to anything invalid, the handler can
+# simply save the interrupted code's registers on its stack. Only the registers
+# a C function is allowed to clobber need to be saved, as _handleException()
+# will take care of preserving the others.
+
+.set COP0_CAUSE, $13
+.set COP0_EPC,   $14
+
+# Offsets within the stack frame. The first 16 bytes are reserved for the
+# argument save area required by the MIPS ABI.
+.set FRAME_AT,   0x10
+.set FRAME_V0,   0x14
+.set FRAME_V1,   0x18
+.set FRAME_A0,   0x1c
+.set FRAME_A1,   0x20
+.set FRAME_A2,   0x24
+.set FRAME_A3,   0x28
+.set FRAME_T0,   0x2c
+.set FRAME_T1,   0x30
+.set FRAME_T2,   0x34
+.set FRAME_T3,   0x38
+.set FRAME_T4,   0x3c
+.set FRAME_T5,   0x40
+.set FRAME_T6,   0x44
+.set FRAME_T7,   0x48
+.set FRAME_T8,   0x4c
+.set FRAME_T9,   0x50
+.set FRAME_RA,   0x54
+.set FRAME_HI,   0x58
+.set FRAME_LO,   0x5c
+.set FRAME_SIZE, 0x60
+
+.section .text._exceptionVector, "ax", @progbits
+.global _exceptionVector
+.type _exceptionVector, @function
+
+_exceptionVector:
+	lui   $k0, %hi(_exceptionHandler)
+	addiu $k0, %lo(_exceptionHandler)
+	jr    $k0
+	nop
+
+.section .text._exceptionHandler, "ax", @progbits
+.type _exceptionHandler, @function
+
+_exceptionHandler:
+	addiu $sp, -FRAME_SIZE
+
+	sw    $at, FRAME_AT($sp)
+	sw    $v0, FRAME_V0($sp)
+	sw    $v1, FRAME_V1($sp)
+	sw    $a0, FRAME_A0($sp)
+	sw    $a1, FRAME_A1($sp)
+	sw    $a2, FRAME_A2($sp)
+	sw    $a3, FRAME_A3($sp)
+	sw    $t0, FRAME_T0($sp)
+	sw    $t1, FRAME_T1($sp)
+	sw    $t2, FRAME_T2($sp)
+	sw    $t3, FRAME_T3($sp)
+	sw    $t4, FRAME_T4($sp)
+	sw    $t5, FRAME_T5($sp)
+	sw    $t6, FRAME_T6($sp)
+	sw    $t7, FRAME_T7($sp)
+	sw    $t8, FRAME_T8($sp)
+	sw    $t9, FRAME_T9($sp)
+	sw    $ra, FRAME_RA($sp)
+
+	mfhi  $t0
+	mflo  $t1
+	sw    $t0, FRAME_HI($sp)
+	sw    $t1, FRAME_LO($sp)
+
+	# epc = _handleException(cause, epc);
+	mfc0  $a0, COP0_CAUSE
+	mfc0  $a1, COP0_EPC
+	jal   _handleException
+	nop
+
+	# Keep the return address in $k0, which is reserved for use by exception
+	# handlers and thus not going to be touched by anything else.
+	move  $k0, $v0
+
+	lw    $t0, FRAME_HI($sp)
+	lw    $t1, FRAME_LO($sp)
+	nop
+	mthi  $t0
+	mtlo  $t1
+
+	lw    $at, FRAME_AT($sp)
+	lw    $v0, FRAME_V0($sp)
+	lw    $v1, FRAME_V1($sp)
+	lw    $a0, FRAME_A0($sp)
+	lw    $a1, FRAME_A1($sp)
+	lw    $a2, FRAME_A2($sp)
+	lw    $a3, FRAME_A3($sp)
+	lw    $t0, FRAME_T0($sp)
+	lw    $t1, FRAME_T1($sp)
+	lw    $t2, FRAME_T2($sp)
+	lw    $t3, FRAME_T3($sp)
+	lw    $t4, FRAME_T4($sp)
+	lw    $t5, FRAME_T5($sp)
+	lw    $t6, FRAME_T6($sp)
+	lw    $t7, FRAME_T7($sp)
+	lw    $t8, FRAME_T8($sp)
+	lw    $t9, FRAME_T9($sp)
+	lw    $ra, FRAME_RA($sp)
+
+	# Return to the interrupted code, restoring the previous interrupt enable
+	# and privilege state in the branch delay slot.
+	addiu $sp, FRAME_SIZE
+	jr    $k0
+	rfe
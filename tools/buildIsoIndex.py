@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""ISO9660 file index builder
+
+Walks the directories of a finished disc image (either a plain .iso with 2048
+byte sectors or a raw .bin with 2352 byte sectors) and generates the same hash
+table lib/iso.c builds at boot. The output can be linked into the executable
+with linkData.py and passed to useISOIndex(), skipping the directory scan
+entirely when the disc layout is fixed. It can also be used to just list the
+files on a disc along with their hashes, or to check for hash collisions.
+"""
+
+__version__ = "0.1.0"
+
+import struct
+from argparse import ArgumentParser, FileType, Namespace
+from typing   import BinaryIO, Iterator
+
+## Disc image access
+
+SECTOR_SIZE:     int = 2048
+RAW_SECTOR_SIZE: int = 2352
+RAW_DATA_OFFSET: int = 24 # Mode 2 form 1: sync (12), header (4), subheader (8)
+
+PVD_LBA: int = 16
+
+class DiscImage:
+	def __init__(self, file: BinaryIO):
+		self.file: BinaryIO = file
+
+		file.seek(0, 2)
+		size: int = file.tell()
+
+		# Raw images are detected by their size and the sync pattern at the
+		# beginning of each sector.
+		file.seek(0)
+		sync: bytes = file.read(12)
+
+		if (
+			not (size % RAW_SECTOR_SIZE) and
+			(sync == b"\x00" + b"\xff" * 10 + b"\x00")
+		):
+			self.sectorSize: int = RAW_SECTOR_SIZE
+			self.dataOffset: int = RAW_DATA_OFFSET
+		else:
+			self.sectorSize: int = SECTOR_SIZE
+			self.dataOffset: int = 0
+
+	def read(self, lba: int, length: int = SECTOR_SIZE) -> bytes:
+		data: bytearray = bytearray()
+
+		while len(data) < length:
+			self.file.seek(lba * self.sectorSize + self.dataOffset)
+			sector: bytes = self.file.read(SECTOR_SIZE)
+
+			if len(sector) < SECTOR_SIZE:
+				raise RuntimeError(f"sector {lba} is past the end of the image")
+
+			data.extend(sector)
+			lba += 1
+
+		return bytes(data[0:length])
+
+## Directory parsing
+
+DIR_RECORD_STRUCT: struct.Struct = struct.Struct("< 2B I 4x I 4x 7x B 6x B")
+DIR_FLAG_DIRECTORY: int = 1 << 1
+
+def iterateFiles(
+	disc: DiscImage, lba: int, size: int, path: str = ""
+) -> Iterator[tuple[str, int, int]]:
+	data: bytes = disc.read(lba, size)
+
+	for offset in range(0, len(data), SECTOR_SIZE):
+		sector: bytes = data[offset:offset + SECTOR_SIZE]
+		pos:    int   = 0
+
+		while pos < len(sector) and sector[pos]:
+			length, _, entryLBA, entrySize, flags, nameLength = \
+				DIR_RECORD_STRUCT.unpack_from(sector, pos)
+			name: bytes = sector[pos + 33:pos + 33 + nameLength]
+			pos        += length
+
+			if name in ( b"\x00", b"\x01" ):
+				continue
+
+			name: str = name.decode("ascii").split(";")[0]
+
+			if flags & DIR_FLAG_DIRECTORY:
+				yield from iterateFiles(
+					disc, entryLBA, entrySize, f"{path}{name}/"
+				)
+			else:
+				yield f"{path}{name}", entryLBA, entrySize
+
+def readRootDirectory(disc: DiscImage) -> tuple[int, int]:
+	pvd: bytes = disc.read(PVD_LBA)
+
+	if pvd[0:6] != b"\x01CD001":
+		raise RuntimeError("no primary volume descriptor found")
+
+	_, _, lba, size, _, _ = DIR_RECORD_STRUCT.unpack_from(pvd, 156)
+	return lba, size
+
+## Index generation
+
+ISO_INDEX_MAGIC:    int = 0x584f5349
+ISO_INDEX_CAPACITY: int = 256
+
+HEADER_STRUCT: struct.Struct = struct.Struct("< 4I")
+ENTRY_STRUCT:  struct.Struct = struct.Struct("< 3I")
+
+def hashPath(path: str) -> int:
+	# Must match hashISOPath() in lib/iso.c.
+	value: int = 0x811c9dc5
+
+	for char in path.lstrip("/\\").split(";")[0].upper().replace("\\", "/"):
+		value = ((value ^ ord(char)) * 0x01000193) & 0xffffffff
+
+	return value or 1
+
+def buildIndex(
+	files: list[tuple[str, int, int]], capacity: int
+) -> bytearray:
+	if len(files) > capacity:
+		raise RuntimeError(
+			f"disc has {len(files)} files, index only fits {capacity}"
+		)
+
+	table:  list[tuple[int, int, int] | None] = [ None ] * capacity
+	hashes: dict[int, str]                   = {}
+
+	for path, lba, size in files:
+		value: int = hashPath(path)
+
+		if value in hashes:
+			raise RuntimeError(
+				f"hash collision between {hashes[value]} and {path} "
+				f"({value:#010x}), rename one of them"
+			)
+
+		hashes[value] = path
+
+		# Same linear probing as the runtime.
+		for i in range(capacity):
+			slot: int = (value + i) & (capacity - 1)
+
+			if table[slot] is None:
+				table[slot] = value, lba, size
+				break
+
+	data: bytearray = bytearray(
+		HEADER_STRUCT.pack(ISO_INDEX_MAGIC, capacity, len(files), 0)
+	)
+
+	for entry in table:
+		data.extend(ENTRY_STRUCT.pack(*(entry or ( 0, 0, 0 ))))
+
+	return data
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Generates a prebuilt file index for lib/iso.c from a PS1 disc "
+			"image.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+
+	group = parser.add_argument_group("Index options")
+	group.add_argument(
+		"-c", "--capacity",
+		type    = int,
+		default = ISO_INDEX_CAPACITY,
+		help    = \
+			"Number of slots in the table, must match ISO_INDEX_CAPACITY "
+			f"(default {ISO_INDEX_CAPACITY})",
+		metavar = "slots"
+	)
+	group.add_argument(
+		"-l", "--list",
+		action = "store_true",
+		help   = "Print all files found, along with their hashes, LBAs and sizes"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"input",
+		type = FileType("rb"),
+		help = "Path to disc image (.iso or raw .bin)"
+	)
+	group.add_argument(
+		"output",
+		type  = FileType("wb"),
+		nargs = "?",
+		help  = "Path to index file to generate"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	if args.capacity & (args.capacity - 1):
+		parser.error("capacity must be a power of 2")
+
+	with args.input as file:
+		disc: DiscImage = DiscImage(file)
+
+		try:
+			files: list[tuple[str, int, int]] = \
+				list(iterateFiles(disc, *readRootDirectory(disc)))
+			data:  bytearray                  = buildIndex(files, args.capacity)
+		except (RuntimeError, UnicodeDecodeError) as err:
+			parser.error(str(err))
+
+	if args.list:
+		for path, lba, size in files:
+			print(f"{hashPath(path):08x} {lba:6d} {size:9d} {path}")
+
+	if args.output:
+		with args.output as file:
+			file.write(data)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,428 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""PlayStation 1 streamed world builder
+
+Splits a large .obj world mesh into a grid of square cells and packs them into
+an archive (see packArchive.py) for lib/world.h to stream in around the player.
+Each face goes to the cell its centroid is in, and each cell gets its own copy
+of the vertices it uses (relative to the cell's corner), its own copy of the
+world's texture if any and the collision boxes overlapping it. Objects or
+groups whose name starts with "col" are not drawn; their bounding boxes are
+used as collision boxes instead.
+"""
+
+__version__ = "0.1.0"
+
+import random, struct
+from argparse import ArgumentParser, FileType, Namespace
+from typing   import TextIO
+
+from PIL         import Image
+from packArchive import Entry, buildArchive, hashName
+from convertImage import convertIndexedImage, quantizeImage
+
+## Mesh parsing
+
+Vector = tuple[int, int, int]
+
+class Mesh:
+	def __init__(self):
+		self.vertices:   list[Vector]           = []
+		self.textCoords: list[tuple[float, float]] = []
+		# Triangles as (vertex indices, texture coordinate indices)
+		self.faces:      list[tuple[list[int], list[int]]] = []
+		self.colliders:  list[tuple[Vector, Vector]] = []
+
+def parseOBJ(file: TextIO, scale: float) -> Mesh:
+	mesh:      Mesh      = Mesh()
+	collision: bool      = False
+	colliding: list[int] = []
+
+	def _closeCollider():
+		if colliding:
+			points: list[Vector] = [ mesh.vertices[index] for index in colliding ]
+
+			mesh.colliders.append((
+				tuple(min(axis) for axis in zip(*points)),
+				tuple(max(axis) for axis in zip(*points))
+			))
+			colliding.clear()
+
+	for line in file:
+		fields: list[str] = line.split()
+
+		if not fields:
+			continue
+
+		# Same coordinate conversion as convertObject.py.
+		if fields[0] == "v":
+			mesh.vertices.append(tuple(
+				int(float(value) * -scale) for value in fields[1:4]
+			))
+		elif fields[0] == "vt":
+			mesh.textCoords.append(( float(fields[1]), float(fields[2]) ))
+		elif fields[0] in ( "o", "g" ):
+			_closeCollider()
+			collision = (len(fields) > 1) and fields[1].lower().startswith("col")
+		elif fields[0] == "f":
+			# Indices can be v, v/vt, v/vt/vn or v//vn, and negative indices are
+			# relative to the end of the list.
+			vertices:   list[int] = []
+			textCoords: list[int] = []
+
+			for corner in fields[1:]:
+				indices: list[str] = corner.split("/")
+				index:   int       = int(indices[0])
+
+				vertices.append(
+					(index - 1) if (index > 0) else (len(mesh.vertices) + index)
+				)
+
+				if (len(indices) > 1) and indices[1]:
+					index = int(indices[1])
+
+					textCoords.append(
+						(index - 1) if (index > 0)
+						else (len(mesh.textCoords) + index)
+					)
+				else:
+					textCoords.append(0)
+
+			if collision:
+				colliding.extend(vertices)
+				continue
+
+			# Triangulate polygons as fans.
+			for i in range(1, len(vertices) - 1):
+				mesh.faces.append((
+					[ vertices[0], vertices[i], vertices[i + 1] ],
+					[ textCoords[0], textCoords[i], textCoords[i + 1] ]
+				))
+
+	_closeCollider()
+	return mesh
+
+## Cell generation
+
+CELL_MAGIC:  int = 0x4c4c4543 # "CELL"
+WORLD_MAGIC: int = 0x444c5257 # "WRLD"
+
+CELL_HEADER_STRUCT:  struct.Struct = struct.Struct("< I 4H 2H 6I")
+WORLD_HEADER_STRUCT: struct.Struct = struct.Struct("< I 4H 2h")
+VERTEX_STRUCT:       struct.Struct = struct.Struct("< 4h")
+TEXT_COORD_STRUCT:   struct.Struct = struct.Struct("< 2B")
+FACE_STRUCT:         struct.Struct = struct.Struct("< 6H I")
+COLLIDER_STRUCT:     struct.Struct = struct.Struct("< 6h")
+
+WORLD_MAX_CELLS:        int = 256
+WORLD_SLOT_SIZE:        int = 32768
+WORLD_MAX_TEXTURE_SIZE: int = 128
+
+def _align(data: bytearray, alignment: int = 4):
+	data.extend(bytes(-len(data) % alignment))
+
+def _clamp16(value: int) -> int:
+	return min(max(value, -0x8000), 0x7fff)
+
+def buildCell(
+	mesh:      Mesh,
+	faces:     list[int],
+	colliders: list[int],
+	cornerX:   int,
+	cornerZ:   int,
+	texture:   tuple[bytes, bytes, int, int] | None,
+	seed:      int
+) -> bytes:
+	vertexMap:    dict[int, int] = {}
+	textCoordMap: dict[int, int] = {}
+
+	def _remap(mapping: dict[int, int], index: int) -> int:
+		return mapping.setdefault(index, len(mapping))
+
+	cellFaces: list[tuple[list[int], list[int]]] = []
+
+	for index in faces:
+		vertices, textCoords = mesh.faces[index]
+
+		cellFaces.append((
+			[ _remap(vertexMap, vertex) for vertex in vertices ],
+			[ _remap(textCoordMap, coord) for coord in textCoords ]
+				if texture else [ 0, 0, 0 ]
+		))
+
+	if len(vertexMap) > 0xffff or len(cellFaces) > 0xffff:
+		raise RuntimeError(
+			f"cell at {cornerX},{cornerZ} has too many vertices or faces"
+		)
+
+	data:    bytearray = bytearray(CELL_HEADER_STRUCT.size)
+	offsets: list[int] = []
+
+	offsets.append(len(data))
+	for index in vertexMap:
+		x, y, z = mesh.vertices[index]
+		data.extend(VERTEX_STRUCT.pack(
+			_clamp16(x - cornerX), _clamp16(y), _clamp16(z - cornerZ), 0
+		))
+
+	offsets.append(len(data))
+	if texture:
+		_, _, width, height = texture
+
+		for index in textCoordMap:
+			u, v = mesh.textCoords[index] if mesh.textCoords else ( 0, 0 )
+			data.extend(TEXT_COORD_STRUCT.pack(
+				min(max(int(u * width), 0), width - 1),
+				min(max(int((1 - v) * height), 0), height - 1)
+			))
+	_align(data)
+
+	# Same random colors as convertObject.py, but reproducible so unchanged
+	# cells pack identically.
+	rng: random.Random = random.Random(seed)
+
+	offsets.append(len(data))
+	for vertices, textCoords in cellFaces:
+		data.extend(FACE_STRUCT.pack(
+			*vertices, *textCoords, rng.randrange(0x600000)
+		))
+
+	offsets.append(len(data))
+	for index in colliders:
+		low, high = mesh.colliders[index]
+		data.extend(COLLIDER_STRUCT.pack(
+			_clamp16(low[0] - cornerX), _clamp16(low[1]),
+			_clamp16(low[2] - cornerZ), _clamp16(high[0] - cornerX),
+			_clamp16(high[1]), _clamp16(high[2] - cornerZ)
+		))
+
+	width, height = 0, 0
+
+	if texture:
+		image, palette, width, height = texture
+
+		offsets.append(len(data))
+		data.extend(image)
+		_align(data)
+		offsets.append(len(data))
+		data.extend(palette)
+		_align(data)
+	else:
+		offsets.extend(( 0, 0 ))
+
+	data[0:CELL_HEADER_STRUCT.size] = CELL_HEADER_STRUCT.pack(
+		CELL_MAGIC,
+		len(vertexMap),
+		len(cellFaces),
+		len(textCoordMap) if texture else 0,
+		len(colliders),
+		width,
+		height,
+		*offsets
+	)
+
+	return bytes(data)
+
+def buildWorld(
+	mesh:     Mesh,
+	cellSize: int,
+	texture:  tuple[bytes, bytes, int, int] | None
+) -> list[Entry]:
+	if not mesh.faces:
+		raise RuntimeError("mesh has no faces")
+
+	# Align the grid's origin to a multiple of the cell size, so cells don't
+	# move around when the world's bounds change.
+	xs: list[int] = [ vertex[0] for vertex in mesh.vertices ]
+	zs: list[int] = [ vertex[2] for vertex in mesh.vertices ]
+
+	originX: int = (min(xs) // cellSize) * cellSize
+	originZ: int = (min(zs) // cellSize) * cellSize
+	width:   int = (max(xs) - originX) // cellSize + 1
+	depth:   int = (max(zs) - originZ) // cellSize + 1
+
+	if (width * depth) > WORLD_MAX_CELLS:
+		raise RuntimeError(
+			f"world is {width}x{depth} cells, only {WORLD_MAX_CELLS} are "
+			"allowed (increase the cell size)"
+		)
+	if (
+		(originX < -0x8000) or ((originX + width  * cellSize) > 0x8000) or
+		(originZ < -0x8000) or ((originZ + depth * cellSize) > 0x8000)
+	):
+		raise RuntimeError("world does not fit in 16-bit coordinates")
+
+	cellFaces:     dict[tuple[int, int], list[int]] = {}
+	cellColliders: dict[tuple[int, int], list[int]] = {}
+
+	for index, ( vertices, _ ) in enumerate(mesh.faces):
+		x: int = sum(mesh.vertices[vertex][0] for vertex in vertices) // 3
+		z: int = sum(mesh.vertices[vertex][2] for vertex in vertices) // 3
+
+		cellFaces.setdefault((
+			(x - originX) // cellSize,
+			(z - originZ) // cellSize
+		), []).append(index)
+
+	for index, ( low, high ) in enumerate(mesh.colliders):
+		for cellZ in range(
+			max((low[2] - originZ) // cellSize, 0),
+			min((high[2] - originZ) // cellSize + 1, depth)
+		):
+			for cellX in range(
+				max((low[0] - originX) // cellSize, 0),
+				min((high[0] - originX) // cellSize + 1, width)
+			):
+				cellColliders.setdefault(( cellX, cellZ ), []).append(index)
+
+	entries: list[Entry] = []
+	cells:   list[int]   = [ 0 ] * (width * depth)
+
+	for cellZ in range(depth):
+		for cellX in range(width):
+			key: tuple[int, int] = cellX, cellZ
+
+			if (key not in cellFaces) and (key not in cellColliders):
+				continue
+
+			name: str   = f"cell_{cellX}_{cellZ}"
+			entry: Entry = Entry(name, buildCell(
+				mesh,
+				cellFaces.get(key, []),
+				cellColliders.get(key, []),
+				originX + cellX * cellSize,
+				originZ + cellZ * cellSize,
+				texture,
+				cellZ * width + cellX
+			))
+
+			if (entry.size + entry.margin) > WORLD_SLOT_SIZE:
+				raise RuntimeError(
+					f"{name} needs {entry.size + entry.margin} bytes, slots "
+					f"are {WORLD_SLOT_SIZE} (decrease the cell size)"
+				)
+
+			entries.append(entry)
+			cells[cellZ * width + cellX] = entry.hash
+
+	header: bytearray = bytearray(WORLD_HEADER_STRUCT.pack(
+		WORLD_MAGIC, cellSize, width, depth, 0, originX, originZ
+	))
+	header.extend(struct.pack(f"< {len(cells)}I", *cells))
+
+	# Keep the world entry first so its sector is right after the table of
+	# contents, then cells in row order so neighbors are close on the disc.
+	return [ Entry("world", bytes(header)) ] + entries
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Splits an .obj world mesh into streamable cells and packs them "
+			"into an archive for lib/world.h.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+	group.add_argument(
+		"-q", "--quiet",
+		action = "store_true",
+		help   = "Do not print a summary of each cell"
+	)
+
+	group = parser.add_argument_group("Conversion options")
+	group.add_argument(
+		"-c", "--cell-size",
+		type    = int,
+		default = 2048,
+		help    = "Size of each cell in world units (default 2048)",
+		metavar = "units"
+	)
+	group.add_argument(
+		"-s", "--scale",
+		type    = float,
+		default = 1.0,
+		help    = \
+			"Scale factor to apply to vertex coordinates, same as "
+			"convertObject.py's (default 1)",
+		metavar = "factor"
+	)
+	group.add_argument(
+		"-t", "--texture",
+		type    = Image.open,
+		help    = \
+			f"Texture to give each cell (16 colors, at most "
+			f"{WORLD_MAX_TEXTURE_SIZE}x{WORLD_MAX_TEXTURE_SIZE})",
+		metavar = "file"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"input",
+		type = FileType("rt"),
+		help = "Path to .obj world mesh"
+	)
+	group.add_argument(
+		"output",
+		type = FileType("wb"),
+		help = "Path to archive file to generate"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	if args.cell_size <= 0 or args.cell_size > 0x7fff:
+		parser.error("cell size must be between 1 and 32767")
+
+	texture: tuple[bytes, bytes, int, int] | None = None
+
+	try:
+		if args.texture:
+			width, height = args.texture.size
+
+			if (
+				(width > WORLD_MAX_TEXTURE_SIZE) or
+				(height > WORLD_MAX_TEXTURE_SIZE) or (width % 16)
+			):
+				raise RuntimeError(
+					f"texture must be at most {WORLD_MAX_TEXTURE_SIZE}x"
+					f"{WORLD_MAX_TEXTURE_SIZE}, with a width multiple of 16"
+				)
+
+			image, palette = convertIndexedImage(
+				quantizeImage(args.texture, 16)
+			)
+			texture        = image.tobytes(), palette.tobytes(), width, height
+
+		with args.input as file:
+			mesh: Mesh = parseOBJ(file, args.scale)
+
+		entries: list[Entry] = buildWorld(mesh, args.cell_size, texture)
+		data:    bytearray   = buildArchive(entries)
+	except RuntimeError as err:
+		parser.error(str(err))
+
+	if not args.quiet:
+		for entry in entries:
+			print(
+				f"{entry.name:12s} {entry.size:6d} -> "
+				f"{len(entry.packedData):6d} (+{entry.margin})"
+			)
+
+		print(f"total: {len(data)} bytes, {len(entries) - 1} cells")
+
+	with args.output as file:
+		file.write(data)
+
+if __name__ == "__main__":
+	main()
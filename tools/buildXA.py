@@ -0,0 +1,295 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""PlayStation 1 XA-ADPCM interleaver
+
+Encodes one or more .wav files into XA-ADPCM audio and interleaves them as
+channels of a single .xa file (2336 bytes per sector, i.e. the subheader, data
+and EDC of each mode 2 sector), ready to be placed on the disc image as an XA
+file. The CD drive decodes the channel selected by lib/cd.c on its own while
+reading the file at double speed, so playback costs no RAM and no CPU time;
+all channels share the same format and are read at the same time, which allows
+switching between them seamlessly.
+
+At double speed the drive reads 150 sectors per second, so the format decides
+how many channels fit: 8 for 37800 Hz stereo, 16 for 18900 Hz stereo or 37800
+Hz mono, 32 for 18900 Hz mono. Unused channels are filled with silence, shorter
+tracks are padded with silence to the length of the longest one, and the file
+ends with one data sector per channel carrying the end of file flag, which the
+driver uses to stop or loop. Requires NumPy to be installed.
+"""
+
+__version__ = "0.1.0"
+
+import wave
+from argparse import ArgumentParser, FileType, Namespace
+from math     import ceil, log2
+
+import numpy as np
+from numpy.typing import NDArray
+from convertAudio import FILTERS, encodeBlockWith, readWAV, resample
+
+## XA-ADPCM encoding
+
+SAMPLES_PER_UNIT:  int = 28
+UNITS_PER_GROUP:   int = 8
+GROUPS_PER_SECTOR: int = 18
+GROUP_SIZE:        int = 128
+DATA_SIZE:         int = 2324
+SECTOR_SIZE:       int = 2336
+
+SECTORS_PER_SECOND: int = 150
+SAMPLES_PER_SECTOR: int = SAMPLES_PER_UNIT * UNITS_PER_GROUP * GROUPS_PER_SECTOR
+
+# XA only supports the first 4 of the SPU's prediction filters.
+NUM_FILTERS: int = 4
+
+SM_END_OF_RECORD: int = 1 << 0
+SM_TYPE_AUDIO:    int = 1 << 2
+SM_TYPE_DATA:     int = 1 << 3
+SM_FORM2:         int = 1 << 5
+SM_REAL_TIME:     int = 1 << 6
+SM_END_OF_FILE:   int = 1 << 7
+
+CI_STEREO:     int = 1 << 0
+CI_RATE_18900: int = 1 << 2 # Cleared for 37800 Hz
+
+class UnitEncoder:
+	def __init__(self):
+		# Each channel (left/right) keeps its own decoder history.
+		self.s1: int = 0
+		self.s2: int = 0
+
+	def encode(self, samples: list[int]) -> tuple[int, list[int]]:
+		best: tuple | None = None
+
+		for filter in range(NUM_FILTERS):
+			# Estimate the shift from the largest residual left by the filter
+			# over the original samples, then only try shifts around it rather
+			# than all 13.
+			k0, k1             = FILTERS[filter]
+			history: list[int] = [ self.s2, self.s1, *samples ]
+			peak:    int       = 0
+
+			for i in range(SAMPLES_PER_UNIT):
+				predicted = (history[i + 1] * k0 + history[i] * k1 + 32) >> 6
+				peak      = max(peak, abs(history[i + 2] - predicted))
+
+			shift: int = 12 - max(0, ceil(log2(max(peak, 1) / 7)))
+
+			for candidate in range(max(0, shift - 1), min(12, shift + 1) + 1):
+				result = encodeBlockWith(
+					samples,
+					filter,
+					candidate,
+					self.s1,
+					self.s2
+				)
+
+				if (best is None) or (result[0] < best[0]):
+					best = ( result[0], filter, candidate, *result[1:] )
+
+		_, filter, shift, nibbles, self.s1, self.s2 = best
+		return (filter << 4) | shift, nibbles
+
+def encodeSector(
+	samples:  NDArray[np.int16],
+	encoders: list[UnitEncoder]
+) -> bytes:
+	# Stereo units alternate between left and right, mono units simply follow
+	# each other.
+	numChannels: int = len(encoders)
+	units:       list[tuple[int, list[int]]] = []
+
+	for index in range(UNITS_PER_GROUP * GROUPS_PER_SECTOR):
+		channel: int = index % numChannels
+		offset:  int = (index // numChannels) * SAMPLES_PER_UNIT
+		unit:    list[int] = \
+			samples[offset:offset + SAMPLES_PER_UNIT, channel].tolist()
+
+		units.append(encoders[channel].encode(unit))
+
+	data: bytearray = bytearray()
+
+	for group in range(GROUPS_PER_SECTOR):
+		groupUnits: list[tuple[int, list[int]]] = \
+			units[group * UNITS_PER_GROUP:(group + 1) * UNITS_PER_GROUP]
+		headers:    list[int] = [ header for header, _ in groupUnits ]
+
+		# The 8 unit headers are stored with redundant copies of each half.
+		data += bytes(headers[0:4] + headers + headers[4:8])
+
+		for i in range(SAMPLES_PER_UNIT):
+			data += bytes(
+				groupUnits[j][1][i] | (groupUnits[j + 1][1][i] << 4)
+				for j in range(0, UNITS_PER_GROUP, 2)
+			)
+
+	return bytes(data)
+
+## Sector generation
+
+def buildSector(
+	file:       int,
+	channel:    int,
+	submode:    int,
+	codingInfo: int,
+	data:       bytes
+) -> bytes:
+	subheader: bytes = bytes(( file, channel, submode, codingInfo ))
+
+	# The EDC is optional for form 2 sectors and left blank.
+	return (subheader * 2 + data).ljust(SECTOR_SIZE, b"\0")
+
+def buildXA(
+	tracks:     list[NDArray[np.int16]],
+	sampleRate: int,
+	stereo:     bool,
+	file:       int
+) -> bytes:
+	numChannels: int = 2 if stereo else 1
+	stride:      int = (SECTORS_PER_SECOND * SAMPLES_PER_SECTOR) \
+		// (sampleRate * numChannels)
+
+	if len(tracks) > stride:
+		raise RuntimeError(
+			f"too many tracks for this format ({len(tracks)}, max {stride})"
+		)
+
+	perSector:  int = SAMPLES_PER_SECTOR // numChannels
+	numSectors: int = max(-(-len(track) // perSector) for track in tracks)
+	codingInfo: int = \
+		(CI_STEREO if stereo else 0) | (CI_RATE_18900 if sampleRate == 18900 else 0)
+
+	encoders: list[list[UnitEncoder]] = [
+		[ UnitEncoder() for _ in range(numChannels) ] for _ in tracks
+	]
+	silence:  bytes = bytes(GROUPS_PER_SECTOR * GROUP_SIZE)
+	output:   bytearray = bytearray()
+
+	for index in range(numSectors):
+		for channel in range(stride):
+			submode: int   = SM_TYPE_AUDIO | SM_FORM2 | SM_REAL_TIME
+			data:    bytes = silence
+
+			if channel < len(tracks):
+				chunk: NDArray[np.int16] = \
+					tracks[channel][index * perSector:(index + 1) * perSector]
+
+				if len(chunk):
+					chunk = np.pad(chunk, (( 0, perSector - len(chunk) ), ( 0, 0 )))
+					data  = encodeSector(chunk, encoders[channel])
+			if index == (numSectors - 1):
+				submode |= SM_END_OF_RECORD
+
+			output += buildSector(file, channel, submode, codingInfo, data)
+
+	# End markers, one per channel so that whichever channel is selected sees
+	# one (data sectors are not filtered out, but the driver checks the channel
+	# number).
+	for channel in range(stride):
+		output += buildSector(
+			file,
+			channel,
+			SM_TYPE_DATA | SM_FORM2 | SM_REAL_TIME | SM_END_OF_FILE,
+			0,
+			b""
+		)
+
+	return bytes(output)
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Encodes .wav files into an interleaved XA-ADPCM file, one channel "
+			"per input file.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+
+	group = parser.add_argument_group("Conversion options")
+	group.add_argument(
+		"-r", "--rate",
+		type    = int,
+		choices = ( 18900, 37800 ),
+		default = 37800,
+		help    = "Sample rate in Hz (default 37800)",
+		metavar = "hz"
+	)
+	group.add_argument(
+		"-m", "--mono",
+		action = "store_true",
+		help   = "Mix tracks down to mono (allows twice as many channels)"
+	)
+	group.add_argument(
+		"-f", "--file",
+		type    = int,
+		default = 1,
+		help    = "File number to store in subheaders (default 1)",
+		metavar = "number"
+	)
+	group.add_argument(
+		"-g", "--gain",
+		type    = float,
+		default = 1.0,
+		help    = "Multiply samples by the given value (default 1.0)",
+		metavar = "gain"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"output",
+		type = FileType("wb"),
+		help = "Path to .xa file to generate"
+	)
+	group.add_argument(
+		"input",
+		type  = FileType("rb"),
+		nargs = "+",
+		help  = "Paths to input .wav files, in channel order"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	tracks: list[NDArray[np.int16]] = []
+
+	for inputFile in args.input:
+		try:
+			with inputFile as file:
+				samples, sampleRate = readWAV(file, not args.mono)
+		except (wave.Error, EOFError, RuntimeError) as err:
+			parser.error(f"{inputFile.name}: {err}")
+
+		if samples.ndim == 1:
+			samples = samples.reshape(( -1, 1 ))
+		if sampleRate != args.rate:
+			samples = np.stack(
+				[ resample(channel, sampleRate, args.rate) for channel in samples.T ],
+				1
+			)
+
+		samples = np.clip(np.round(samples * args.gain), -0x8000, 0x7fff)
+		tracks.append(samples.astype("<h"))
+
+	try:
+		data: bytes = buildXA(tracks, args.rate, not args.mono, args.file)
+	except RuntimeError as err:
+		parser.error(str(err))
+
+	with args.output as file:
+		file.write(data)
+
+if __name__ == "__main__":
+	main()
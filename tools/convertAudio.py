@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""PlayStation 1 audio converter
+
+Converts a .wav file into a .vag file (SPU ADPCM data with the standard 48 byte
+header), ready to be uploaded to SPU RAM by lib/sound.h. Stereo files are mixed
+down to mono, and the audio can optionally be resampled to a lower rate to save
+space. Each 16 byte ADPCM block holds 28 samples; the encoder tries every
+filter and shift combination on each block and keeps the one with the smallest
+error. Requires NumPy to be installed.
+"""
+
+__version__ = "0.1.0"
+
+import struct, wave
+from argparse import ArgumentParser, FileType, Namespace
+
+import numpy as np
+from numpy.typing import NDArray
+
+## ADPCM encoding
+
+SAMPLES_PER_BLOCK: int = 28
+BLOCK_SIZE:        int = 16
+DMA_BLOCK_SIZE:    int = 64
+
+# Prediction filter coefficients (in 1/64 units) supported by the SPU.
+FILTERS: list[tuple[int, int]] = [
+	(   0,   0 ),
+	(  60,   0 ),
+	( 115, -52 ),
+	(  98, -55 ),
+	( 122, -60 )
+]
+
+FLAG_LOOP_END:    int = 1 << 0
+FLAG_LOOP_REPEAT: int = 1 << 1
+FLAG_LOOP_START:  int = 1 << 2
+
+def encodeBlockWith(
+	samples: list[int],
+	filter:  int,
+	shift:   int,
+	s1:      int,
+	s2:      int
+) -> tuple[int, list[int], int, int]:
+	k0, k1          = FILTERS[filter]
+	error:   int       = 0
+	nibbles: list[int] = []
+
+	for sample in samples:
+		predicted: int = (s1 * k0 + s2 * k1 + 32) >> 6
+		residual:  int = sample - predicted
+
+		# The SPU decodes each nibble as (nibble << 12) >> shift, so round to
+		# the nearest multiple of that step while keeping 4 bits.
+		step:   int = 1 << (12 - shift)
+		nibble: int = (residual + (step >> 1)) // step
+		nibble      = max(-8, min(7, nibble))
+
+		decoded: int = max(-0x8000, min(0x7fff, nibble * step + predicted))
+		error       += (sample - decoded) ** 2
+		s1, s2       = decoded, s1
+
+		nibbles.append(nibble & 15)
+
+	return error, nibbles, s1, s2
+
+def encodeADPCM(
+	samples:   NDArray[np.int16],
+	loopStart: int | None = None
+) -> bytes:
+	numBlocks: int = max(1, -(-len(samples) // SAMPLES_PER_BLOCK))
+	padded:    list[int] = \
+		samples.tolist() + [ 0 ] * (numBlocks * SAMPLES_PER_BLOCK - len(samples))
+
+	output: bytearray = bytearray()
+	s1:     int       = 0
+	s2:     int       = 0
+
+	for index in range(numBlocks):
+		block: list[int] = padded[
+			index * SAMPLES_PER_BLOCK:(index + 1) * SAMPLES_PER_BLOCK
+		]
+		best: tuple | None = None
+
+		for filter in range(len(FILTERS)):
+			for shift in range(13):
+				result = encodeBlockWith(block, filter, shift, s1, s2)
+
+				if (best is None) or (result[0] < best[0]):
+					best = ( result[0], filter, shift, *result[1:] )
+
+		_, filter, shift, nibbles, s1, s2 = best
+
+		flags: int = 0
+
+		if (loopStart is not None) and (index == loopStart // SAMPLES_PER_BLOCK):
+			flags |= FLAG_LOOP_START
+		if index == (numBlocks - 1):
+			flags |= FLAG_LOOP_END
+
+			if loopStart is not None:
+				flags |= FLAG_LOOP_REPEAT
+
+		output += bytes(( (filter << 4) | shift, flags ))
+		output += bytes(
+			nibbles[i] | (nibbles[i + 1] << 4)
+			for i in range(0, SAMPLES_PER_BLOCK, 2)
+		)
+
+	# Pad to a whole number of DMA blocks (the padding is never played, as the
+	# last block above has the end flag set).
+	output += bytes(-len(output) % DMA_BLOCK_SIZE)
+	return bytes(output)
+
+## Input handling
+
+def readWAV(file, stereo: bool = False) -> tuple[NDArray[np.float64], int]:
+	with wave.open(file, "rb") as wav:
+		numChannels: int   = wav.getnchannels()
+		sampleWidth: int   = wav.getsampwidth()
+		sampleRate:  int   = wav.getframerate()
+		data:        bytes = wav.readframes(wav.getnframes())
+
+	if sampleWidth == 1:
+		samples = (np.frombuffer(data, "B").astype("f8") - 128) * 256
+	elif sampleWidth == 2:
+		samples = np.frombuffer(data, "<h").astype("f8")
+	else:
+		raise RuntimeError(
+			f"unsupported sample width ({sampleWidth * 8} bits, must be 8 or "
+			f"16)"
+		)
+
+	samples = samples.reshape(( -1, numChannels ))
+
+	# Mix down to mono, or make sure there are exactly two channels.
+	if not stereo:
+		return samples.mean(1), sampleRate
+	if numChannels == 1:
+		return np.repeat(samples, 2, 1), sampleRate
+
+	return samples[:, 0:2], sampleRate
+
+def resample(
+	samples:  NDArray[np.float64],
+	fromRate: int,
+	toRate:   int
+) -> NDArray[np.float64]:
+	length: int = int(len(samples) * toRate / fromRate)
+
+	return np.interp(
+		np.arange(length) * fromRate / toRate,
+		np.arange(len(samples)),
+		samples
+	)
+
+def buildVAG(data: bytes, sampleRate: int, name: str) -> bytes:
+	# The header is big endian, unlike everything else on the PS1.
+	return struct.pack(
+		"> 4s 2I 2I 12x 16s",
+		b"VAGp",
+		0x20,
+		0,
+		len(data),
+		sampleRate,
+		name.encode("ascii", "replace")
+	) + data
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Converts a .wav file into a .vag file (PS1 SPU ADPCM data).",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+
+	group = parser.add_argument_group("Conversion options")
+	group.add_argument(
+		"-r", "--rate",
+		type    = int,
+		help    = \
+			"Resample to the given rate in Hz (default keep the file's rate, "
+			"the SPU plays anything up to 176400 Hz)",
+		metavar = "hz"
+	)
+	group.add_argument(
+		"-l", "--loop",
+		type    = int,
+		help    = \
+			"Loop back to the given sample (rounded down to a multiple of 28) "
+			"after the end, until the sound is stopped",
+		metavar = "sample"
+	)
+	group.add_argument(
+		"-g", "--gain",
+		type    = float,
+		default = 1.0,
+		help    = "Multiply samples by the given value (default 1.0)",
+		metavar = "gain"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"input",
+		type = FileType("rb"),
+		help = "Path to input .wav file"
+	)
+	group.add_argument(
+		"output",
+		type = FileType("wb"),
+		help = "Path to .vag file to generate"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	try:
+		with args.input as file:
+			samples, sampleRate = readWAV(file)
+	except (wave.Error, EOFError, RuntimeError) as err:
+		parser.error(str(err))
+
+	if args.rate:
+		samples    = resample(samples, sampleRate, args.rate)
+		sampleRate = args.rate
+	if args.loop is not None and not (0 <= args.loop < len(samples)):
+		parser.error("loop point is past the end of the sound")
+
+	samples = np.clip(np.round(samples * args.gain), -0x8000, 0x7fff)
+	data    = encodeADPCM(samples.astype("<h"), args.loop)
+
+	with args.output as file:
+		file.write(buildVAG(data, sampleRate, args.input.name.split("/")[-1]))
+
+if __name__ == "__main__":
+	main()
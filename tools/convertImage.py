@@ -5,10 +5,12 @@
 
 A simple script to convert image files into either raw 16bpp RGB data as
 expected by the PS1's GPU, or 4bpp or 8bpp indexed color data plus a separate
-16bpp color palette. Requires PIL/Pillow and NumPy to be installed.
+16bpp color palette. Images with more colors than the chosen depth allows can
+optionally be reduced (median cut, with or without ordered dithering).
+Requires PIL/Pillow and NumPy to be installed.
 """
 
-__version__ = "0.2.1"
+__version__ = "0.3.0"
 __author__  = "spicyjpeg"
 
 from argparse import ArgumentParser, FileType, Namespace
@@ -21,34 +23,42 @@ from PIL          import Image
 
 # Pillow's built-in quantize() method will use different algorithms, some of
 # which are broken, depending on whether the input image has an alpha channel.
-# As a workaround, all images are "quantized" (with no dithering - images with
-# more colors than allowed are rejected) manually instead. This conversion is
-# performed on indexed color images as well in order to normalize their
-# palettes.
-def quantizeImage(imageObj: Image.Image, numColors: int) -> Image.Image:
+# As a workaround, all images are quantized manually instead. This conversion
+# is performed on indexed color images as well in order to normalize their
+# palettes. Images with more colors than allowed are rejected unless reduce is
+# set, in which case they go through reduceColors() below.
+def quantizeImage(
+	imageObj:  Image.Image,
+	numColors: int,
+	reduce:    bool = False,
+	dither:    bool = False
+) -> Image.Image:
 	#if imageObj.mode == "P":
 		#return imageObj
 	if imageObj.mode not in ( "RGB", "RGBA" ):
 		imageObj = imageObj.convert("RGBA")
 
 	image: NDArray[np.uint8] = np.asarray(imageObj, "B")
-	clut, image              = np.unique(
+	clut, indices            = np.unique(
 		image.reshape(( -1, image.shape[2] )),
 		return_inverse = True,
 		axis           = 0
 	)
 
 	if clut.shape[0] > numColors:
-		raise RuntimeError(
-			f"source image contains {clut.shape[0]} unique colors (must be "
-			f"{numColors} or less)"
-		)
+		if not reduce:
+			raise RuntimeError(
+				f"source image contains {clut.shape[0]} unique colors (must "
+				f"be {numColors} or less, or pass -q to reduce them)"
+			)
 
-	image = image.astype("B").reshape((
+		return reduceColors(imageObj, numColors, dither)
+
+	indices = indices.astype("B").reshape((
 		imageObj.height,
 		imageObj.width
 	))
-	newObj: Image.Image = Image.fromarray(image, "P")
+	newObj: Image.Image = Image.fromarray(indices, "P")
 
 	newObj.putpalette(clut.tobytes(), imageObj.mode)
 	return newObj
@@ -66,6 +76,167 @@ def getImagePalette(imageObj: Image.Image) -> NDArray[np.uint8]:
 
 	return clut
 
+## Color reduction
+
+# 4x4 Bayer matrix, scaled to the -0.5 to 0.5 range.
+BAYER_MATRIX: NDArray[np.float32] = (np.array([
+	[  0,  8,  2, 10 ],
+	[ 12,  4, 14,  6 ],
+	[  3, 11,  1,  9 ],
+	[ 15,  7, 13,  5 ]
+], "f") + 0.5) / 16 - 0.5
+
+def normalizeColors(image: NDArray[np.uint8]) -> NDArray[np.uint8]:
+	"""
+	Throws away what the GPU can't tell apart anyway, so it doesn't waste
+	palette entries: RGB is rounded to 5 bits per channel and alpha is snapped
+	to the three levels to16bpp() distinguishes (transparent, semitransparent,
+	solid). Fully transparent pixels all become the same color.
+	"""
+
+	image          = image.copy()
+	image[..., :3] = \
+		(((image[..., :3].astype("<H") * 31 + 127) // 255) * 255 + 15) // 31
+
+	alpha: NDArray[np.uint8] = image[..., 3].copy()
+	image[..., 3]            = np.where(
+		alpha >= UPPER_ALPHA_BOUND,
+		0xff,
+		np.where(alpha >= LOWER_ALPHA_BOUND, 0x80, 0)
+	)
+	image[alpha < LOWER_ALPHA_BOUND] = 0
+
+	return image
+
+def medianCut(
+	colors:    NDArray[np.uint8],
+	counts:    NDArray[np.int64],
+	numColors: int
+) -> NDArray[np.uint8]:
+	"""
+	Classic median cut: keeps splitting the box (set of colors) with the
+	widest channel range, weighted by how many pixels fall into it, at the
+	pixel-weighted median of that channel. Each box then becomes a palette
+	entry, the pixel-weighted average of its colors.
+	"""
+
+	values: NDArray[np.int32]       = colors.astype("<i4")
+	boxes:  list[NDArray[np.int64]] = [ np.arange(colors.shape[0]) ]
+
+	while len(boxes) < numColors:
+		best:      int = -1
+		bestScore: int = 0
+
+		for index, box in enumerate(boxes):
+			if box.shape[0] < 2:
+				continue
+
+			spread: int = int((values[box].max(0) - values[box].min(0)).max())
+			score:  int = spread * int(counts[box].sum())
+
+			if score > bestScore:
+				best, bestScore = index, score
+
+		if best < 0:
+			break
+
+		box:     NDArray[np.int64] = boxes[best]
+		channel: int               = \
+			int((values[box].max(0) - values[box].min(0)).argmax())
+		box                        = \
+			box[np.argsort(values[box, channel], kind = "stable")]
+
+		weights: NDArray[np.int64] = np.cumsum(counts[box])
+		split:   int               = int(np.searchsorted(weights, weights[-1] / 2))
+		split                      = min(max(split, 1), box.shape[0] - 1)
+
+		boxes[best] = box[:split]
+		boxes.append(box[split:])
+
+	palette: NDArray[np.uint8] = np.array([
+		np.round(
+			(values[box] * counts[box, None]).sum(0) / counts[box].sum()
+		) for box in boxes
+	], "B")
+
+	# Averaging may have mixed semitransparent and solid colors if a box
+	# contained both, so snap alpha again.
+	return normalizeColors(palette.reshape(( 1, -1, 4 ))).reshape(( -1, 4 ))
+
+def mapToPalette(
+	pixels:  NDArray[np.float32],
+	palette: NDArray[np.uint8]
+) -> NDArray[np.int64]:
+	targets: NDArray[np.float32] = palette.astype("f")
+	indices: NDArray[np.int64]   = np.empty(pixels.shape[0], "<i8")
+
+	# Done in chunks to keep the pixels x colors distance matrix small.
+	for offset in range(0, pixels.shape[0], 4096):
+		chunk:     NDArray[np.float32] = pixels[offset:offset + 4096]
+		distances: NDArray[np.float32] = \
+			((chunk[:, None, :] - targets[None, :, :]) ** 2).sum(2)
+
+		indices[offset:offset + 4096] = distances.argmin(1)
+
+	return indices
+
+def reduceColors(
+	imageObj:  Image.Image,
+	numColors: int,
+	dither:    bool = False
+) -> Image.Image:
+	image: NDArray[np.uint8] = \
+		normalizeColors(np.asarray(imageObj.convert("RGBA"), "B"))
+	pixels: NDArray[np.uint8] = image.reshape(( -1, 4 ))
+
+	transparent: NDArray[np.bool_] = (pixels[:, 3] == 0)
+	colors, counts                 = np.unique(
+		pixels[~transparent],
+		return_counts = True,
+		axis          = 0
+	)
+
+	# Transparency gets a reserved entry (index 0) so it never gets averaged
+	# with anything, nor picked for a visible pixel.
+	reserved:  int = 1 if transparent.any() else 0
+	available: int = numColors - reserved
+
+	if colors.shape[0] <= available:
+		palette: NDArray[np.uint8] = colors
+	else:
+		palette: NDArray[np.uint8] = medianCut(colors, counts, available)
+
+	values: NDArray[np.float32] = pixels[~transparent].astype("f")
+
+	if dither:
+		# Offset each pixel by a threshold from the tiled Bayer matrix before
+		# picking the nearest color. The offset is roughly half the average
+		# distance between palette entries.
+		offsets: NDArray[np.float32] = np.tile(
+			BAYER_MATRIX,
+			(
+				(imageObj.height + 3) // 4,
+				(imageObj.width  + 3) // 4
+			)
+		)[:imageObj.height, :imageObj.width].reshape(-1)
+		strength: float = 128 / (palette.shape[0] ** (1 / 3))
+
+		values[:, :3] += offsets[~transparent, None] * strength
+
+	indices: NDArray[np.int64] = np.zeros(pixels.shape[0], "<i8")
+	indices[~transparent]      = mapToPalette(values, palette) + reserved
+
+	if reserved:
+		palette = np.r_[ np.zeros(( 1, 4 ), "B"), palette ]
+
+	newObj: Image.Image = Image.fromarray(
+		indices.astype("B").reshape(( imageObj.height, imageObj.width )),
+		"P"
+	)
+
+	newObj.putpalette(palette.tobytes(), "RGBA")
+	return newObj
+
 ## Image data conversion
 
 LOWER_ALPHA_BOUND: int =  32
@@ -131,25 +302,32 @@ def convertIndexedImage(
 			np.zeros(( 1, padAmount ), "<H")
 		]
 
-	image: NDArray[np.uint8] = np.asarray(imageObj, "B")
+	image: NDArray[np.uint8] = \
+		packIndexedData(np.asarray(imageObj, "B"), numColors <= 16)
+
+	return image, clut
 
+def packIndexedData(
+	image:  NDArray[np.uint8],
+	is4bpp: bool
+) -> NDArray[np.uint8]:
 	if image.shape[1] % 2:
 		image = np.c_[
 			image,
-			np.zeros(( imageObj.height, 1 ), "B")
+			np.zeros(( image.shape[0], 1 ), "B")
 		]
 
 	# Pack two pixels into each byte for 4bpp images.
-	if numColors <= 16:
+	if is4bpp:
 		image = image[:, 0::2] | (image[:, 1::2] << 4)
 
 		if image.shape[1] % 2:
 			image = np.c_[
 				image,
-				np.zeros(( imageObj.height, 1 ), "B")
+				np.zeros(( image.shape[0], 1 ), "B")
 			]
 
-	return image, clut
+	return image
 
 ## Main
 
@@ -194,6 +372,20 @@ def createParser() -> ArgumentParser:
 			"pixels in the image (useful when drawing the image with blending "
 			"disabled)"
 	)
+	group.add_argument(
+		"-q", "--quantize",
+		action = "store_true",
+		help   = \
+			"Reduce the image's colors (median cut) if it has more than the "
+			"chosen depth allows, instead of rejecting it"
+	)
+	group.add_argument(
+		"-d", "--dither",
+		action = "store_true",
+		help   = \
+			"Use ordered (4x4 Bayer) dithering when reducing colors, implies "
+			"-q"
+	)
 
 	group = parser.add_argument_group("File paths")
 	group.add_argument(
@@ -227,7 +419,12 @@ def main():
 			parser.error("path to palette data must be specified")
 
 		try:
-			image: Image.Image = quantizeImage(args.input, 2 ** args.bpp)
+			image: Image.Image = quantizeImage(
+				args.input,
+				2 ** args.bpp,
+				args.quantize or args.dither,
+				args.dither
+			)
 		except RuntimeError as err:
 			parser.error(err.args[0])
 
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""PlayStation 1 input replay extractor
+
+Pulls an input recording dumped by lib/replay.h (between the "REPLAY BEGIN" and
+"REPLAY END" markers) out of a captured serial log, such as the one play.bat
+writes to build/log.txt or the output of tail.bat redirected to a file, and
+saves it as a .rpl file. The .rpl file can then be linked into a playback build
+with linkData.py (as replayData) or loaded over replayBuffer from the debugger.
+"""
+
+__version__ = "0.1.0"
+
+import re, struct
+from argparse import ArgumentParser, FileType, Namespace
+
+## Recording parsing
+
+REPLAY_MAGIC:   int = 0x594c5052
+REPLAY_VERSION: int = 1
+
+HEADER_STRUCT: struct.Struct = struct.Struct("< I 2H 2I")
+FRAME_STRUCT:  struct.Struct = struct.Struct("< H 2B 4h")
+
+BUTTON_NAMES: list[str] = [
+	"select", "l3", "r3", "start", "up", "right", "down", "left",
+	"l2", "r2", "l1", "r1", "triangle", "circle", "cross", "square"
+]
+
+def extractRecordings(log: str) -> list[bytes]:
+	recordings: list[bytes] = []
+
+	for match in re.finditer(
+		r"REPLAY BEGIN (\d+)\r?\n(.*?)REPLAY END",
+		log,
+		re.DOTALL
+	):
+		length: int   = int(match.group(1))
+		data:   bytes = bytes.fromhex("".join(match.group(2).split()))
+
+		if len(data) != length:
+			raise RuntimeError(
+				f"recording {len(recordings)} is {len(data)} bytes long, "
+				f"expected {length} (serial output dropped or truncated?)"
+			)
+
+		recordings.append(data)
+
+	return recordings
+
+def validateRecording(data: bytes) -> int:
+	magic, version, mode, numFrames, _ = HEADER_STRUCT.unpack_from(data, 0)
+
+	if magic != REPLAY_MAGIC:
+		raise RuntimeError(f"invalid magic {magic:#010x}")
+	if version != REPLAY_VERSION:
+		raise RuntimeError(f"unsupported version {version}")
+
+	expected: int = HEADER_STRUCT.size + numFrames * FRAME_STRUCT.size
+
+	if len(data) != expected:
+		raise RuntimeError(
+			f"header says {numFrames} frames ({expected} bytes), got "
+			f"{len(data)} bytes"
+		)
+
+	return numFrames
+
+def printRecording(data: bytes, numFrames: int):
+	print("frame,held,left_x,left_y,right_x,right_y")
+
+	for index in range(numFrames):
+		held, _, _, lx, ly, rx, ry = FRAME_STRUCT.unpack_from(
+			data,
+			HEADER_STRUCT.size + index * FRAME_STRUCT.size
+		)
+		buttons: str = "+".join(
+			name for bit, name in enumerate(BUTTON_NAMES) if held & (1 << bit)
+		)
+
+		print(f"{index},{buttons},{lx},{ly},{rx},{ry}")
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Extracts an input recording from a captured PS1 serial log and "
+			"saves it as a .rpl file.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+
+	group = parser.add_argument_group("Conversion options")
+	group.add_argument(
+		"-n", "--index",
+		type    = int,
+		default = -1,
+		help    = \
+			"Extract the recording with the given index if the log contains "
+			"more than one (default last one)",
+		metavar = "index"
+	)
+	group.add_argument(
+		"-p", "--print",
+		action = "store_true",
+		help   = "Print the recording's frames as CSV to stdout"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"input",
+		type = FileType("rt", errors = "replace"),
+		help = "Path to captured serial log"
+	)
+	group.add_argument(
+		"output",
+		type  = FileType("wb"),
+		nargs = "?",
+		help  = "Path to .rpl file to generate"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	with args.input as file:
+		log: str = file.read()
+
+	try:
+		recordings: list[bytes] = extractRecordings(log)
+
+		if not recordings:
+			raise RuntimeError("no recordings found in log")
+
+		data:      bytes = recordings[args.index]
+		numFrames: int   = validateRecording(data)
+	except (RuntimeError, IndexError) as err:
+		parser.error(str(err))
+
+	if args.print:
+		printRecording(data, numFrames)
+
+	if args.output:
+		with args.output as file:
+			file.write(data)
+
+if __name__ == "__main__":
+	main()
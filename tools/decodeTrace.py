@@ -0,0 +1,300 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""PlayStation 1 binary trace decoder
+
+Extracts the 16-byte trace records emitted by lib/trace.h from a serial output
+stream, either read live from pcsx-redux's SIO1 TCP server (the same one
+tail.bat connects to) or from a previously captured log file, and converts them
+into CSV or Chrome trace event JSON (loadable in chrome://tracing or Perfetto).
+Any regular text output interleaved with the records is passed through to
+stderr.
+"""
+
+__version__ = "0.1.0"
+
+import json, re, socket, struct, sys
+from argparse    import ArgumentParser, FileType, Namespace
+from dataclasses import dataclass
+from typing      import BinaryIO, Iterator, TextIO
+
+## Record parsing
+
+RECORD_SYNC:   int        = 0xa5
+RECORD_SIZE:   int        = 16
+RECORD_STRUCT: struct.Struct = struct.Struct("< 4B 3I")
+
+VALID_PHASES: frozenset[int] = frozenset(b"BEiC")
+
+# Root counter 2 runs at the system clock divided by 8.
+TICKS_PER_SECOND: float = 33868800 / 8
+
+@dataclass
+class TraceRecord:
+	phase:     str
+	id:        int
+	timestamp: int
+	arg0:      int
+	arg1:      int
+
+class TraceStreamParser:
+	def __init__(self, textOutput: TextIO | None = None):
+		self.buffer:     bytearray   = bytearray()
+		self.textOutput: TextIO|None = textOutput
+
+		self._lastTimestamp: int = 0
+		self._wrapOffset:    int = 0
+
+		self.numRecords: int = 0
+		self.numSkipped: int = 0
+
+	def _isRecord(self, offset: int) -> bool:
+		if self.buffer[offset] != RECORD_SYNC:
+			return False
+		if self.buffer[offset + 1] not in VALID_PHASES:
+			return False
+
+		# The checksum byte is the XOR of the other 15 bytes, so XORing all 16
+		# together must yield zero.
+		checksum: int = 0
+
+		for byte in self.buffer[offset:offset + RECORD_SIZE]:
+			checksum ^= byte
+
+		return not checksum
+
+	def _unwrap(self, timestamp: int) -> int:
+		# The console's timebase is 32 bits wide and wraps every ~17 minutes.
+		if timestamp < self._lastTimestamp and \
+			(self._lastTimestamp - timestamp) > (1 << 31):
+			self._wrapOffset += 1 << 32
+
+		self._lastTimestamp = timestamp
+		return timestamp + self._wrapOffset
+
+	def feed(self, data: bytes) -> Iterator[TraceRecord]:
+		self.buffer.extend(data)
+
+		offset: int = 0
+		text:   bytearray = bytearray()
+
+		while offset < len(self.buffer):
+			if self.buffer[offset] == RECORD_SYNC:
+				# Wait for more data if the record might not be complete yet.
+				if (offset + RECORD_SIZE) > len(self.buffer):
+					break
+
+				if self._isRecord(offset):
+					_, phase, id, _, timestamp, arg0, arg1 = \
+						RECORD_STRUCT.unpack_from(self.buffer, offset)
+
+					self.numRecords += 1
+					offset          += RECORD_SIZE
+
+					yield TraceRecord(
+						chr(phase), id, self._unwrap(timestamp), arg0, arg1
+					)
+					continue
+
+				self.numSkipped += 1
+
+			text.append(self.buffer[offset])
+			offset += 1
+
+		del self.buffer[:offset]
+
+		if self.textOutput and text:
+			self.textOutput.write(text.decode("ascii", "replace"))
+			self.textOutput.flush()
+
+## Input and output
+
+def readSocket(address: str) -> Iterator[bytes]:
+	host, _, port = address.rpartition(":")
+
+	with socket.create_connection(( host or "localhost", int(port) )) as sock:
+		while True:
+			data: bytes = sock.recv(4096)
+
+			if not data:
+				break
+
+			yield data
+
+def readFile(file: BinaryIO) -> Iterator[bytes]:
+	with file:
+		while data := file.read(4096):
+			yield data
+
+def parseHeader(path: str) -> dict[int, str]:
+	# Pull the event names out of the TraceId enum in lib/trace.h (or any other
+	# header using the same TRACE_ID_ naming convention). Only the enum's body
+	# is looked at, as the IDs are also used elsewhere in the header.
+	names: dict[int, str] = {}
+	value: int            = 0
+
+	with open(path, "rt") as file:
+		body = re.search(
+			r"typedef\s+enum\s*{([^}]*)}\s*TraceId\s*;",
+			file.read()
+		)
+
+	if body is None:
+		return names
+
+	for match in re.finditer(
+		r"\bTRACE_ID_(\w+)\s*(?:=\s*(0x[0-9a-fA-F]+|\d+))?\s*(?:,|$)",
+		re.sub(r"//.*|/\*.*?\*/", "", body.group(1), flags = re.S).strip()
+	):
+		if match.group(2) is not None:
+			value = int(match.group(2), 0)
+
+		names[value] = match.group(1).lower()
+		value       += 1
+
+	return names
+
+def toMicroseconds(ticks: int) -> float:
+	return (ticks * 1e6) / TICKS_PER_SECOND
+
+def writeCSVHeader(output: TextIO):
+	output.write("time_us,phase,id,name,arg0,arg1\n")
+
+def writeCSVRecord(output: TextIO, record: TraceRecord, names: dict[int, str]):
+	output.write(
+		f"{toMicroseconds(record.timestamp):.3f},{record.phase},{record.id},"
+		f"{names.get(record.id, '')},{record.arg0},{record.arg1}\n"
+	)
+	output.flush()
+
+def toChromeEvent(record: TraceRecord, names: dict[int, str]) -> dict:
+	name: str  = names.get(record.id, f"event{record.id}")
+	event: dict = {
+		"name": name,
+		"ph":   record.phase,
+		"ts":   toMicroseconds(record.timestamp),
+		"pid":  0,
+		"tid":  0
+	}
+
+	if record.phase == "C":
+		event["args"] = { name: record.arg0 }
+	elif record.phase == "i":
+		event["s"]    = "t"
+		event["args"] = { "arg0": record.arg0, "arg1": record.arg1 }
+	elif record.arg0 or record.arg1:
+		event["args"] = { "arg0": record.arg0, "arg1": record.arg1 }
+
+	return event
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Decodes binary trace records from a PS1 serial output stream into "
+			"CSV or Chrome trace event JSON.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+
+	group = parser.add_argument_group("Decoding options")
+	group.add_argument(
+		"-f", "--format",
+		type    = str,
+		choices = ( "csv", "json" ),
+		default = "csv",
+		help    = \
+			"Output CSV (streamed as records arrive) or Chrome trace event JSON "
+			"(written once the input ends or Ctrl+C is pressed), default CSV"
+	)
+	group.add_argument(
+		"-H", "--header",
+		type    = str,
+		default = "lib/trace.h",
+		help    = \
+			"Path to header to read event names from (default lib/trace.h)",
+		metavar = "path"
+	)
+	group.add_argument(
+		"-q", "--quiet",
+		action = "store_true",
+		help   = "Do not echo regular text output to stderr"
+	)
+
+	group = parser.add_argument_group("File paths")
+	source = group.add_mutually_exclusive_group(required = True)
+	source.add_argument(
+		"-c", "--connect",
+		type    = str,
+		nargs   = "?",
+		const   = "localhost:3001",
+		help    = \
+			"Read from a TCP server, such as pcsx-redux's SIO1 server (default "
+			"localhost:3001)",
+		metavar = "host:port"
+	)
+	source.add_argument(
+		"-i", "--input",
+		type    = FileType("rb"),
+		help    = "Read from a captured serial log file",
+		metavar = "path"
+	)
+	group.add_argument(
+		"output",
+		type    = FileType("wt"),
+		nargs   = "?",
+		default = sys.stdout,
+		help    = "Path to CSV/JSON file to generate (default stdout)"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	try:
+		names: dict[int, str] = parseHeader(args.header)
+	except OSError:
+		names: dict[int, str] = {}
+
+	streamParser: TraceStreamParser = \
+		TraceStreamParser(None if args.quiet else sys.stderr)
+	events:       list[dict]        = []
+
+	if args.connect:
+		chunks: Iterator[bytes] = readSocket(args.connect)
+	else:
+		chunks: Iterator[bytes] = readFile(args.input)
+
+	if args.format == "csv":
+		writeCSVHeader(args.output)
+
+	try:
+		for chunk in chunks:
+			for record in streamParser.feed(chunk):
+				if args.format == "csv":
+					writeCSVRecord(args.output, record, names)
+				else:
+					events.append(toChromeEvent(record, names))
+	except KeyboardInterrupt:
+		pass
+
+	if args.format == "json":
+		json.dump({ "traceEvents": events }, args.output, indent = "\t")
+
+	args.output.close()
+	sys.stderr.write(
+		f"\n{streamParser.numRecords} records decoded, "
+		f"{streamParser.numSkipped} bad sync bytes skipped\n"
+	)
+
+if __name__ == "__main__":
+	main()
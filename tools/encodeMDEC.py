@@ -0,0 +1,354 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""PlayStation 1 MDEC image encoder
+
+Compresses images into bitstreams the PS1's MDEC can decode directly, for use
+with lib/mdec.h. Images are converted to YCbCr with 4:2:0 chroma subsampling,
+split into 16x16 macroblocks (each made up of Cr, Cb and four Y 8x8 blocks),
+transformed with a DCT, quantized using the table in lib/mdec.c and run-length
+coded. Macroblocks are stored one 16 pixel wide column at a time, top to
+bottom, so the driver can upload each column to VRAM as soon as it has been
+decoded.
+
+A single input image produces a single MDECImage. Multiple input images (e.g.
+the frames of a cutscene) produce an MDECSequence, with each frame aligned to a
+2048 byte sector. The -p option decodes the result back the same way the MDEC
+does and saves it as a preview image, to check quality without a PS1 at hand.
+Requires PIL/Pillow and NumPy to be installed.
+"""
+
+__version__ = "0.1.0"
+
+import struct
+from argparse import ArgumentParser, FileType, Namespace
+from pathlib  import Path
+
+import numpy as np
+from numpy.typing import NDArray
+from PIL          import Image
+
+## Tables (keep in sync with lib/mdec.c)
+
+IMAGE_MAGIC:    int = 0x4344424d
+SEQUENCE_MAGIC: int = 0x5344424d
+MAX_HEIGHT:     int = 256
+MAX_LENGTH:     int = 0xffe0
+SECTOR_SIZE:    int = 2048
+
+IMAGE_HEADER_STRUCT:    struct.Struct = struct.Struct("< I 2H I")
+SEQUENCE_HEADER_STRUCT: struct.Struct = struct.Struct("< I 2H")
+
+QUANT_TABLE: NDArray[np.int32] = np.array([
+	 2, 16, 16, 19, 16, 19, 22, 22, 22, 22, 22, 22, 26, 24, 26, 27,
+	27, 27, 26, 26, 26, 26, 27, 27, 27, 29, 29, 29, 34, 34, 34, 29,
+	29, 29, 27, 27, 29, 29, 32, 32, 34, 34, 37, 38, 37, 35, 35, 34,
+	35, 38, 38, 40, 40, 40, 48, 48, 46, 46, 56, 56, 58, 69, 69, 83
+], "<i4")
+
+# Raster (row-major) position of each coefficient in zigzag order.
+ZIGZAG: NDArray[np.int32] = np.array([
+	 0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+], "<i4")
+
+END_OF_BLOCK: int = 0xfe00
+
+# Orthonormal 8-point DCT matrix, which is what the IDCT table in lib/mdec.c
+# inverts.
+DCT_MATRIX: NDArray[np.float64] = np.array([
+	[
+		np.sqrt((1 if k else 0.5) / 4) * np.cos((2 * n + 1) * k * np.pi / 16)
+		for n in range(8)
+	] for k in range(8)
+])
+
+## Color conversion
+
+def toYCbCr(image: NDArray[np.uint8]) -> tuple[NDArray, NDArray, NDArray]:
+	rgb: NDArray[np.float64] = image[..., :3].astype("f8")
+
+	y:  NDArray[np.float64] = rgb @ np.array([ 0.299, 0.587, 0.114 ])
+	cb: NDArray[np.float64] = (rgb[..., 2] - y) / 1.772
+	cr: NDArray[np.float64] = (rgb[..., 0] - y) / 1.402
+
+	# The MDEC works with signed samples centered around zero.
+	return y - 128, cb, cr
+
+def subsample(plane: NDArray[np.float64]) -> NDArray[np.float64]:
+	return (
+		plane[0::2, 0::2] + plane[1::2, 0::2] +
+		plane[0::2, 1::2] + plane[1::2, 1::2]
+	) / 4
+
+## Block encoding
+
+def encodeBlock(block: NDArray[np.float64], scale: int) -> list[int]:
+	coeffs: NDArray[np.float64] = \
+		(DCT_MATRIX @ block @ DCT_MATRIX.T).reshape(-1)[ZIGZAG]
+
+	# The MDEC multiplies the DC coefficient by the table's first entry only,
+	# and AC coefficients by (entry * scale) / 8.
+	levels: NDArray[np.int32] = np.empty(64, "<i4")
+	levels[0]  = np.round(coeffs[0] / QUANT_TABLE[0])
+	levels[1:] = np.round(coeffs[1:] * 8 / (QUANT_TABLE[1:] * scale))
+	levels     = np.clip(levels, -511, 511)
+
+	codes: list[int] = [ (scale << 10) | (int(levels[0]) & 0x3ff) ]
+	run:   int       = 0
+
+	for level in levels[1:].tolist():
+		if not level:
+			run += 1
+			continue
+
+		codes.append((run << 10) | (level & 0x3ff))
+		run = 0
+
+	codes.append(END_OF_BLOCK)
+	return codes
+
+def padImage(image: NDArray[np.uint8]) -> NDArray[np.uint8]:
+	height: int = (image.shape[0] + 15) // 16 * 16
+	width:  int = (image.shape[1] + 15) // 16 * 16
+
+	return np.pad(
+		image,
+		(
+			( 0, height - image.shape[0] ),
+			( 0, width  - image.shape[1] ),
+			( 0, 0 )
+		),
+		"edge"
+	)
+
+def encodeImage(image: NDArray[np.uint8], scale: int) -> bytes:
+	y, cb, cr = toYCbCr(image)
+	cb, cr    = subsample(cb), subsample(cr)
+	codes     = []
+
+	# Column by column, then top to bottom within each column.
+	for x in range(0, image.shape[1], 16):
+		for by in range(0, image.shape[0], 16):
+			cx, cy = x // 2, by // 2
+
+			codes += encodeBlock(cr[cy:cy + 8, cx:cx + 8], scale)
+			codes += encodeBlock(cb[cy:cy + 8, cx:cx + 8], scale)
+
+			for offsetY, offsetX in ( ( 0, 0 ), ( 0, 8 ), ( 8, 0 ), ( 8, 8 ) ):
+				codes += encodeBlock(
+					y[by + offsetY:by + offsetY + 8, x + offsetX:x + offsetX + 8],
+					scale
+				)
+
+	# The input DMA moves 32 words at a time, so pad the stream with end of
+	# block codes (which the MDEC skips between blocks) to a multiple of that.
+	codes += [ END_OF_BLOCK ] * (-len(codes) % 64)
+
+	return np.array(codes, "<H").tobytes()
+
+## Reference decoder
+
+def decodeImage(data: bytes, width: int, height: int) -> NDArray[np.uint8]:
+	codes:  NDArray[np.uint16] = np.frombuffer(data, "<H")
+	output: NDArray[np.uint8]  = np.zeros(( height, width, 3 ), "B")
+	offset: int                = 0
+
+	def signed(value: int) -> int:
+		return value - 0x400 if (value & 0x200) else value
+
+	def decodeBlock() -> NDArray[np.float64]:
+		nonlocal offset
+
+		while codes[offset] == END_OF_BLOCK:
+			offset += 1
+
+		code:   int               = int(codes[offset])
+		scale:  int               = code >> 10
+		coeffs: NDArray[np.int32] = np.zeros(64, "<i4")
+		index:  int               = 0
+
+		coeffs[0]  = signed(code & 0x3ff) * QUANT_TABLE[0]
+		offset    += 1
+
+		while codes[offset] != END_OF_BLOCK:
+			code    = int(codes[offset])
+			index  += (code >> 10) + 1
+			offset += 1
+
+			if index > 63:
+				raise RuntimeError("run length past end of block")
+
+			coeffs[index] = \
+				(signed(code & 0x3ff) * QUANT_TABLE[index] * scale + 4) // 8
+
+		offset += 1
+
+		block: NDArray[np.float64] = np.zeros(64)
+		block[ZIGZAG] = np.clip(coeffs, -0x400, 0x3ff)
+
+		block = block.reshape(( 8, 8 ))
+		return DCT_MATRIX.T @ block @ DCT_MATRIX
+
+	for x in range(0, width, 16):
+		for by in range(0, height, 16):
+			cr: NDArray[np.float64] = decodeBlock().repeat(2, 0).repeat(2, 1)
+			cb: NDArray[np.float64] = decodeBlock().repeat(2, 0).repeat(2, 1)
+			y:  NDArray[np.float64] = np.zeros(( 16, 16 ))
+
+			for offsetY, offsetX in ( ( 0, 0 ), ( 0, 8 ), ( 8, 0 ), ( 8, 8 ) ):
+				y[offsetY:offsetY + 8, offsetX:offsetX + 8] = decodeBlock()
+
+			rgb: NDArray[np.float64] = np.stack((
+				y + 1.402 * cr,
+				y - 0.3437 * cb - 0.7143 * cr,
+				y + 1.772 * cb
+			), 2)
+
+			output[by:by + 16, x:x + 16] = \
+				np.clip(np.round(rgb), -128, 127).astype("<i4") + 128
+
+	return output
+
+## Output files
+
+def buildImage(data: bytes, width: int, height: int) -> bytes:
+	length: int = len(data) // 4
+
+	if height > MAX_HEIGHT:
+		raise RuntimeError(f"image is {height} pixels tall (max {MAX_HEIGHT})")
+	if length > MAX_LENGTH:
+		raise RuntimeError(
+			f"bitstream is {length} words long (max {MAX_LENGTH}), use a "
+			f"higher scale"
+		)
+
+	return IMAGE_HEADER_STRUCT.pack(IMAGE_MAGIC, width, height, length) + data
+
+def buildSequence(frames: list[bytes], frameRate: int) -> bytes:
+	headerLength: int = \
+		SEQUENCE_HEADER_STRUCT.size + 4 * len(frames)
+	offsets:      list[int] = []
+	body:         bytearray = bytearray()
+	offset:       int       = -(-headerLength // SECTOR_SIZE) * SECTOR_SIZE
+
+	for frame in frames:
+		offsets.append(offset)
+
+		frame   = frame.ljust(-(-len(frame) // SECTOR_SIZE) * SECTOR_SIZE, b"\0")
+		body   += frame
+		offset += len(frame)
+
+	header: bytes = SEQUENCE_HEADER_STRUCT.pack(
+		SEQUENCE_MAGIC, len(frames), frameRate
+	) + struct.pack(f"< {len(frames)}I", *offsets)
+
+	return header.ljust(offsets[0], b"\0") + body
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Compresses images into MDEC bitstreams, either a single image or "
+			"a sequence of frames.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+	group.add_argument(
+		"-q", "--quiet",
+		action = "store_true",
+		help   = "Do not print compression statistics"
+	)
+
+	group = parser.add_argument_group("Compression options")
+	group.add_argument(
+		"-s", "--scale",
+		type    = int,
+		default = 4,
+		help    = \
+			"Quantization scale, from 1 (best quality, largest) to 63 "
+			"(default 4)",
+		metavar = "1-63"
+	)
+	group.add_argument(
+		"-r", "--frame-rate",
+		type    = int,
+		default = 15,
+		help    = \
+			"Frame rate to store in the sequence header when encoding more "
+			"than one image (default 15)",
+		metavar = "fps"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"-p", "--preview",
+		type    = Path,
+		help    = \
+			"Decode the (first) encoded image back and save it to the given "
+			"path",
+		metavar = "file"
+	)
+	group.add_argument(
+		"output",
+		type = FileType("wb"),
+		help = "Path to image or sequence file to generate"
+	)
+	group.add_argument(
+		"input",
+		type  = Path,
+		nargs = "+",
+		help  = "Paths to input images, in frame order"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	if not (1 <= args.scale <= 63):
+		parser.error("scale must be between 1 and 63")
+
+	frames: list[bytes] = []
+
+	try:
+		for path in args.input:
+			with Image.open(path) as image:
+				pixels: NDArray[np.uint8] = \
+					padImage(np.asarray(image.convert("RGB"), "B"))
+
+			height, width = pixels.shape[0:2]
+			data: bytes   = encodeImage(pixels, args.scale)
+
+			frames.append(buildImage(data, width, height))
+
+			if args.preview and (len(frames) == 1):
+				Image.fromarray(decodeImage(data, width, height), "RGB") \
+					.save(args.preview)
+
+			if not args.quiet:
+				print(
+					f"{path.name}: {width}x{height}, {len(data)} bytes "
+					f"({len(data) * 100 // (width * height * 2)}% of 16bpp)"
+				)
+	except (OSError, RuntimeError) as err:
+		parser.error(str(err))
+
+	with args.output as file:
+		if len(frames) == 1:
+			file.write(frames[0])
+		else:
+			file.write(buildSequence(frames, args.frame_rate))
+
+if __name__ == "__main__":
+	main()
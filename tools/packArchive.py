@@ -0,0 +1,312 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""PlayStation 1 asset archive packer
+
+Bundles any number of converted asset files into a single archive meant to be
+placed on the disc and loaded through lib/archive.c. Each entry is compressed
+individually as a raw LZ4 block (or stored as-is if that does not save at least
+one sector) and aligned to a 2048-byte sector boundary, so it can be read with
+a single CD-ROM request and decompressed in place, as sectors arrive, into a
+buffer only slightly larger than the uncompressed data.
+"""
+
+__version__ = "0.1.0"
+
+import struct
+from argparse import ArgumentParser, FileType, Namespace
+from pathlib  import Path
+
+## LZ4 block compression
+
+MIN_MATCH:     int = 4
+LAST_LITERALS: int = 5  # The last 5 bytes must always be literals
+MATCH_LIMIT:   int = 12 # Matches cannot start within the last 12 bytes
+MAX_OFFSET:    int = 0xffff
+
+def _encodeLength(output: bytearray, length: int):
+	while length >= 255:
+		output.append(255)
+		length -= 255
+
+	output.append(length)
+
+def compressLZ4(data: bytes) -> tuple[bytes, int]:
+	"""
+	Greedy LZ4 compressor, using a hash table of 4-byte sequences seen so far.
+	Returns the compressed block along with the largest amount the decoder's
+	output position ever gets ahead of its input position, which is used to
+	calculate how much margin in-place decompression needs.
+	"""
+
+	output: bytearray      = bytearray()
+	table:  dict[bytes, int] = {}
+	anchor: int            = 0
+	pos:    int            = 0
+	ahead:  int            = 0
+
+	while pos < (len(data) - MATCH_LIMIT):
+		key:       bytes      = data[pos:pos + MIN_MATCH]
+		candidate: int | None = table.get(key)
+		table[key]            = pos
+
+		if (candidate is None) or ((pos - candidate) > MAX_OFFSET):
+			pos += 1
+			continue
+
+		end: int = pos + MIN_MATCH
+
+		while (
+			(end < (len(data) - LAST_LITERALS)) and
+			(data[end] == data[candidate + end - pos])
+		):
+			end += 1
+
+		while (
+			(pos > anchor) and (candidate > 0) and
+			(data[pos - 1] == data[candidate - 1])
+		):
+			pos       -= 1
+			candidate -= 1
+
+		literals: int = pos - anchor
+		length:   int = end - pos - MIN_MATCH
+
+		output.append((min(literals, 15) << 4) | min(length, 15))
+		if literals >= 15:
+			_encodeLength(output, literals - 15)
+
+		output.extend(data[anchor:pos])
+		output.extend(struct.pack("< H", pos - candidate))
+		if length >= 15:
+			_encodeLength(output, length - 15)
+
+		ahead = max(ahead, end - len(output))
+
+		# Index the positions covered by the match as well, as they are likely
+		# to be useful for subsequent matches.
+		for index in range(pos + 1, min(end, len(data) - MATCH_LIMIT)):
+			table[data[index:index + MIN_MATCH]] = index
+
+		pos    = end
+		anchor = end
+
+	literals: int = len(data) - anchor
+
+	output.append(min(literals, 15) << 4)
+	if literals >= 15:
+		_encodeLength(output, literals - 15)
+
+	output.extend(data[anchor:])
+	ahead = max(ahead, len(data) - len(output))
+
+	return bytes(output), ahead
+
+## Archive generation
+
+SECTOR_SIZE: int = 2048
+
+ARCHIVE_MAGIC:       int = 0x314b4150 # "PAK1"
+ARCHIVE_MAX_ENTRIES: int = 100
+
+METHOD_STORE: int = 0
+METHOD_LZ4:   int = 1
+
+HEADER_STRUCT: struct.Struct = struct.Struct("< 4I")
+ENTRY_STRUCT:  struct.Struct = struct.Struct("< 4I 2H")
+
+def hashName(name: str) -> int:
+	# Must match hashISOPath() in lib/iso.c, which archive.c also uses.
+	value: int = 0x811c9dc5
+
+	for char in name.lstrip("/\\").split(";")[0].upper().replace("\\", "/"):
+		value = ((value ^ ord(char)) * 0x01000193) & 0xffffffff
+
+	return value or 1
+
+def alignTo(value: int, alignment: int) -> int:
+	return (value + alignment - 1) // alignment * alignment
+
+class Entry:
+	def __init__(self, name: str, data: bytes, compress: bool = True):
+		self.name:       str = name
+		self.hash:       int = hashName(name)
+		self.size:       int = len(data)
+		self.method:     int = METHOD_STORE
+		self.packedData: bytes = data
+
+		if compress and data:
+			packed, ahead = compressLZ4(data)
+
+			if (
+				alignTo(len(packed), SECTOR_SIZE) <
+				alignTo(len(data), SECTOR_SIZE)
+			):
+				self.method     = METHOD_LZ4
+				self.packedData = packed
+
+		# The loader reads whole sectors into the end of a buffer of size +
+		# margin bytes, then decompresses from there into the beginning of the
+		# same buffer. The margin must keep the buffer a multiple of 4 bytes
+		# (for DMA) and large enough for the output never to overtake the
+		# input.
+		sectors: int = alignTo(len(self.packedData), SECTOR_SIZE)
+
+		if self.method == METHOD_LZ4:
+			bufferSize: int = alignTo(max(self.size, sectors + ahead), 4)
+		else:
+			bufferSize: int = sectors
+
+		self.margin: int = bufferSize - self.size
+
+		if self.margin > 0xffff:
+			raise RuntimeError(f"{name}: in-place margin too large")
+
+def buildArchive(entries: list[Entry]) -> bytearray:
+	if len(entries) > ARCHIVE_MAX_ENTRIES:
+		raise RuntimeError(
+			f"too many entries ({len(entries)}), the table of contents only "
+			f"fits {ARCHIVE_MAX_ENTRIES}"
+		)
+
+	hashes: dict[int, str] = {}
+
+	for entry in entries:
+		if entry.hash in hashes:
+			raise RuntimeError(
+				f"hash collision between {hashes[entry.hash]} and "
+				f"{entry.name} ({entry.hash:#010x}), rename one of them"
+			)
+
+		hashes[entry.hash] = entry.name
+
+	# The table of contents is sorted by hash so the loader can binary search
+	# it, and always fits in the first sector. Entry data is laid out in the
+	# order the entries were given, so related assets can be kept adjacent.
+	data:  bytearray = bytearray(SECTOR_SIZE)
+	toc:   bytearray = bytearray()
+	table: list[tuple[int, bytes]] = []
+
+	for entry in entries:
+		table.append(( entry.hash, ENTRY_STRUCT.pack(
+			entry.hash,
+			len(data) // SECTOR_SIZE,
+			len(entry.packedData),
+			entry.size,
+			entry.method,
+			entry.margin
+		) ))
+
+		data.extend(entry.packedData)
+		data.extend(bytes(alignTo(len(data), SECTOR_SIZE) - len(data)))
+
+	toc.extend(HEADER_STRUCT.pack(
+		ARCHIVE_MAGIC, len(entries), len(data) // SECTOR_SIZE, 0
+	))
+	for _, entry in sorted(table):
+		toc.extend(entry)
+
+	data[0:len(toc)] = toc
+	return data
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Packs converted asset files into a sector aligned, LZ4 "
+			"compressed archive for lib/archive.c.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+
+	group = parser.add_argument_group("Packing options")
+	group.add_argument(
+		"-s", "--store",
+		action = "store_true",
+		help   = "Store all entries uncompressed"
+	)
+	group.add_argument(
+		"-l", "--list",
+		type    = FileType("rt"),
+		help    = \
+			"Read entries from a text file (one name=path or path per line, "
+			"# for comments) in addition to the command line",
+		metavar = "file"
+	)
+	group.add_argument(
+		"-q", "--quiet",
+		action = "store_true",
+		help   = "Do not print a summary of each entry"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"output",
+		type = FileType("wb"),
+		help = "Path to archive file to generate"
+	)
+	group.add_argument(
+		"entries",
+		nargs   = "*",
+		help    = \
+			"Files to add, as name=path or just path (in which case the name "
+			"is the file name without extension)",
+		metavar = "name=path"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	specs: list[str] = list(args.entries)
+
+	if args.list:
+		with args.list as file:
+			for line in file:
+				line = line.split("#")[0].strip()
+
+				if line:
+					specs.append(line)
+
+	if not specs:
+		parser.error("no entries given")
+
+	entries: list[Entry] = []
+
+	try:
+		for spec in specs:
+			name, _, path = spec.rpartition("=")
+			name          = name or Path(path).stem
+
+			with open(path, "rb") as file:
+				entries.append(Entry(name, file.read(), not args.store))
+
+		data: bytearray = buildArchive(entries)
+	except (OSError, RuntimeError) as err:
+		parser.error(str(err))
+
+	if not args.quiet:
+		for entry in entries:
+			method: str = "lz4" if (entry.method == METHOD_LZ4) else "store"
+
+			print(
+				f"{entry.hash:08x} {method:5s} {entry.size:8d} -> "
+				f"{len(entry.packedData):8d} (+{entry.margin}) {entry.name}"
+			)
+
+		print(f"total: {len(data)} bytes, {len(data) // SECTOR_SIZE} sectors")
+
+	with args.output as file:
+		file.write(data)
+
+if __name__ == "__main__":
+	main()
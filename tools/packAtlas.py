@@ -0,0 +1,336 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""PlayStation 1 texture atlas packer
+
+Packs multiple images into as few shared 4bpp or 8bpp 256x256 texture pages as
+possible, so objects using different textures can be drawn without switching
+texture pages in between. Images keep their own palettes, but palettes are
+merged whenever the combined colors of two or more images still fit in one.
+The texture coordinate files generated by convertObject.py for each image can
+be remapped to point into the atlas, and a C header describing where each
+image ended up is generated alongside the page and palette data.
+
+Pages are always a full 256x256 texels, so once uploaded they start on a
+texture page boundary and the remapped UVs can be used as-is (AddTri() does not
+add any offset to them). Requires PIL/Pillow and NumPy to be installed.
+"""
+
+__version__ = "0.1.0"
+
+import re
+from argparse import ArgumentParser, Namespace
+from pathlib  import Path
+
+import numpy as np
+from numpy.typing import NDArray
+from PIL          import Image
+from convertImage import to16bpp
+
+## Image loading and palette merging
+
+PAGE_SIZE: int = 256
+
+class AtlasImage:
+	def __init__(self, name: str, path: str, uvPath: str | None):
+		self.name:   str        = name
+		self.uvPath: str | None = uvPath
+
+		with Image.open(path) as image:
+			pixels: NDArray[np.uint8] = np.asarray(image.convert("RGBA"), "B")
+
+		# Colors are compared after conversion to 16bpp, so colors that only
+		# differ in the bits the GPU throws away count as the same one.
+		self.pixels: NDArray[np.uint16] = to16bpp(pixels)
+		self.colors: set[int]           = set(np.unique(self.pixels).tolist())
+		self.height: int                = self.pixels.shape[0]
+		self.width:  int                = self.pixels.shape[1]
+
+		self.page: int = -1
+		self.clut: int = -1
+		self.x:    int = 0
+		self.y:    int = 0
+
+def mergePalettes(images: list[AtlasImage], numColors: int) -> list[list[int]]:
+	for image in images:
+		if len(image.colors) > numColors:
+			raise RuntimeError(
+				f"{image.name} has {len(image.colors)} colors (must be "
+				f"{numColors} or less)"
+			)
+
+	# Greedy first fit, images with the most colors first. Each palette
+	# accumulates colors until adding an image's would overflow it.
+	palettes: list[set[int]] = []
+
+	for image in sorted(images, key = lambda image: -len(image.colors)):
+		for index, palette in enumerate(palettes):
+			if len(palette | image.colors) <= numColors:
+				palette    |= image.colors
+				image.clut  = index
+				break
+		else:
+			image.clut = len(palettes)
+			palettes.append(set(image.colors))
+
+	# Keep transparency (0x0000) at index 0 if present, as unused page areas
+	# are filled with index 0.
+	return [
+		sorted(palette, key = lambda color: (color != 0, color))
+		for palette in palettes
+	]
+
+## Packing
+
+def packImages(images: list[AtlasImage], padding: int) -> int:
+	"""
+	Shelf packing, tallest images first. Each page is filled with shelves as
+	tall as the first image placed on them; images go onto the first shelf (on
+	any page) with enough room left.
+	"""
+
+	# (page, y, height, next free x)
+	shelves:  list[list[int]] = []
+	pageTops: list[int]       = []
+
+	for image in sorted(images, key = lambda image: (-image.height, -image.width)):
+		width:  int = image.width  + padding
+		height: int = image.height + padding
+
+		if (image.width > PAGE_SIZE) or (image.height > PAGE_SIZE):
+			raise RuntimeError(
+				f"{image.name} is larger than a texture page ({PAGE_SIZE}x"
+				f"{PAGE_SIZE})"
+			)
+
+		for shelf in shelves:
+			page, y, shelfHeight, x = shelf
+
+			if (height <= shelfHeight) and ((x + image.width) <= PAGE_SIZE):
+				image.page, image.x, image.y = page, x, y
+				shelf[3]                    += width
+				break
+		else:
+			for page, top in enumerate(pageTops):
+				if (top + image.height) <= PAGE_SIZE:
+					break
+			else:
+				page = len(pageTops)
+				pageTops.append(0)
+
+			image.page, image.x, image.y = page, 0, pageTops[page]
+			shelves.append([ page, pageTops[page], height, width ])
+			pageTops[page] += height
+
+	return len(pageTops)
+
+def buildPages(
+	images:   list[AtlasImage],
+	palettes: list[list[int]],
+	numPages: int,
+	bpp:      int
+) -> list[bytes]:
+	pages: list[NDArray[np.uint8]] = [
+		np.zeros(( PAGE_SIZE, PAGE_SIZE ), "B") for _ in range(numPages)
+	]
+
+	for image in images:
+		lookup: dict[int, int] = {
+			color: index for index, color in enumerate(palettes[image.clut])
+		}
+		indices: NDArray[np.uint8] = np.vectorize(
+			lookup.__getitem__, otypes = ( "B", )
+		)(image.pixels)
+
+		pages[image.page][
+			image.y:image.y + image.height,
+			image.x:image.x + image.width
+		] = indices
+
+	# Same packing as convertImage.py's 4bpp output.
+	if bpp == 4:
+		pages = [ page[:, 0::2] | (page[:, 1::2] << 4) for page in pages ]
+
+	return [ page.tobytes() for page in pages ]
+
+def remapUVs(image: AtlasImage) -> bytes:
+	with open(image.uvPath, "rb") as file:
+		uvs: NDArray[np.uint8] = np.frombuffer(file.read(), "B").copy()
+
+	# Pairs of u, v bytes relative to the original image (see convertObject.py).
+	uvs         = uvs.reshape(( -1, 2 )).astype("<i4")
+	uvs[:, 0]  += image.x
+	uvs[:, 1]  += image.y
+
+	return np.clip(uvs, 0, PAGE_SIZE - 1).astype("B").tobytes()
+
+## Header generation
+
+def generateHeader(
+	images:   list[AtlasImage],
+	palettes: list[list[int]],
+	numPages: int,
+	bpp:      int,
+	prefix:   str
+) -> str:
+	lines: list[str] = [
+		f"// Generated by packAtlas.py, do not edit",
+		f"",
+		f"#pragma once",
+		f"",
+		f"#define {prefix}_BPP         {bpp}",
+		f"#define {prefix}_NUM_PAGES   {numPages}",
+		f"#define {prefix}_NUM_CLUTS   {len(palettes)}",
+		f"#define {prefix}_PAGE_WIDTH  {PAGE_SIZE}",
+		f"#define {prefix}_PAGE_HEIGHT {PAGE_SIZE}",
+		f"#define {prefix}_PAGE_LEN    {PAGE_SIZE * PAGE_SIZE * bpp // 8}",
+		f"#define {prefix}_CLUT_LEN    {(2 ** bpp) * 2}",
+		f""
+	]
+
+	for image in images:
+		name: str = re.sub(r"[^A-Z0-9]", "_", image.name.upper())
+
+		lines.append(
+			f"#define {prefix}_{name}_PAGE {image.page}\n"
+			f"#define {prefix}_{name}_CLUT {image.clut}\n"
+			f"#define {prefix}_{name}_X    {image.x}\n"
+			f"#define {prefix}_{name}_Y    {image.y}\n"
+			f"#define {prefix}_{name}_W    {image.width}\n"
+			f"#define {prefix}_{name}_H    {image.height}\n"
+		)
+
+	return "\n".join(lines)
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Packs images into shared 4bpp/8bpp texture pages with merged "
+			"palettes, and remaps convertObject.py texture coordinates to "
+			"match.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+	group.add_argument(
+		"-q", "--quiet",
+		action = "store_true",
+		help   = "Do not print where each image ended up"
+	)
+
+	group = parser.add_argument_group("Conversion options")
+	group.add_argument(
+		"-b", "--bpp",
+		type    = int,
+		choices = ( 4, 8 ),
+		default = 4,
+		help    = "Use specified color depth (default 4bpp)",
+		metavar = "4|8"
+	)
+	group.add_argument(
+		"-p", "--padding",
+		type    = int,
+		default = 0,
+		help    = \
+			"Leave the given number of texels between images, to avoid "
+			"bleeding when UVs are at the edge (default 0)",
+		metavar = "texels"
+	)
+	group.add_argument(
+		"-n", "--name",
+		type    = str,
+		default = "atlas",
+		help    = \
+			"Prefix for output files and header macros (default \"atlas\")",
+		metavar = "name"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"-H", "--header",
+		type    = Path,
+		help    = "Path to C header to generate",
+		metavar = "file"
+	)
+	group.add_argument(
+		"output",
+		type = Path,
+		help = \
+			"Directory to write pages (name_page0.dat...), palettes "
+			"(name_clut0.dat...) and remapped UVs (name_imagename_uv.dat) to"
+	)
+	group.add_argument(
+		"images",
+		nargs   = "+",
+		help    = \
+			"Images to pack, as name=image.png or name=image.png,uvs.dat to "
+			"also remap a convertObject.py _vert_text.dat file",
+		metavar = "name=path[,uvs]"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	images: list[AtlasImage] = []
+
+	try:
+		for spec in args.images:
+			name, _, paths = spec.rpartition("=")
+			path, _, uvs   = paths.partition(",")
+
+			images.append(AtlasImage(name or Path(path).stem, path, uvs or None))
+
+		palettes: list[list[int]] = mergePalettes(images, 2 ** args.bpp)
+		numPages: int             = packImages(images, args.padding)
+		pages:    list[bytes]     = \
+			buildPages(images, palettes, numPages, args.bpp)
+	except (OSError, RuntimeError) as err:
+		parser.error(str(err))
+
+	args.output.mkdir(parents = True, exist_ok = True)
+
+	for index, page in enumerate(pages):
+		with open(args.output / f"{args.name}_page{index}.dat", "wb") as file:
+			file.write(page)
+
+	for index, palette in enumerate(palettes):
+		data: NDArray[np.uint16] = np.zeros(2 ** args.bpp, "<H")
+		data[0:len(palette)]     = palette
+
+		with open(args.output / f"{args.name}_clut{index}.dat", "wb") as file:
+			file.write(data.tobytes())
+
+	for image in images:
+		if image.uvPath:
+			path: Path = args.output / f"{args.name}_{image.name}_uv.dat"
+
+			with open(path, "wb") as file:
+				file.write(remapUVs(image))
+
+	if args.header:
+		with open(args.header, "wt", newline = "\n") as file:
+			file.write(generateHeader(
+				images, palettes, numPages, args.bpp, args.name.upper()
+			))
+
+	if not args.quiet:
+		for image in images:
+			print(
+				f"{image.name}: page {image.page}, clut {image.clut}, "
+				f"{image.x},{image.y} {image.width}x{image.height}"
+			)
+
+		print(f"{numPages} pages, {len(palettes)} palettes")
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""PlayStation 1 shared palette generator
+
+Converts a set of images to 4bpp or 8bpp indexed color data like
+convertImage.py does, but instead of writing one palette per image it merges
+them across all images: identical palettes are only written once, and images
+whose combined colors still fit in a single palette share it. Each image's
+index data is remapped to its shared palette, and a C header mapping each image
+to a palette ID can be generated alongside. Fewer palettes means fewer CLUT
+rows taken up in VRAM and fewer CLUT changes between primitives.
+
+Images with too many colors can be reduced first (-q/-d, same as
+convertImage.py). Requires PIL/Pillow and NumPy to be installed.
+"""
+
+__version__ = "0.1.0"
+
+import re
+from argparse import ArgumentParser, Namespace
+from pathlib  import Path
+
+import numpy as np
+from numpy.typing import NDArray
+from PIL          import Image
+from convertImage import packIndexedData, quantizeImage, to16bpp
+from packAtlas    import mergePalettes
+
+## Image loading
+
+class SharedImage:
+	def __init__(
+		self,
+		name:      str,
+		path:      str,
+		numColors: int,
+		args:      Namespace
+	):
+		self.name: str = name
+
+		with Image.open(path) as image:
+			indexed: Image.Image = quantizeImage(
+				image,
+				numColors,
+				args.quantize or args.dither,
+				args.dither
+			)
+
+		# Colors are compared after conversion to 16bpp (see packAtlas.py), so
+		# palettes that only differ in the bits the GPU throws away are merged.
+		pixels: NDArray[np.uint8] = np.asarray(indexed.convert("RGBA"), "B")
+
+		self.pixels: NDArray[np.uint16] = \
+			to16bpp(pixels, args.force_stp, args.stp_black)
+		self.colors: set[int]           = set(np.unique(self.pixels).tolist())
+		self.height: int                = self.pixels.shape[0]
+		self.width:  int                = self.pixels.shape[1]
+
+		self.clut: int = -1
+
+	def getIndexedData(self, palette: list[int], bpp: int) -> bytes:
+		lookup: dict[int, int] = {
+			color: index for index, color in enumerate(palette)
+		}
+		indices: NDArray[np.uint8] = np.vectorize(
+			lookup.__getitem__, otypes = ( "B", )
+		)(self.pixels)
+
+		return packIndexedData(indices, bpp == 4).tobytes()
+
+## Header generation
+
+def generateHeader(
+	images:   list[SharedImage],
+	palettes: list[list[int]],
+	bpp:      int,
+	prefix:   str
+) -> str:
+	lines: list[str] = [
+		f"// Generated by shareCluts.py, do not edit",
+		f"",
+		f"#pragma once",
+		f"",
+		f"#define {prefix}_BPP       {bpp}",
+		f"#define {prefix}_NUM_CLUTS {len(palettes)}",
+		f"#define {prefix}_CLUT_LEN  {(2 ** bpp) * 2}",
+		f""
+	]
+
+	for image in images:
+		name: str = re.sub(r"[^A-Z0-9]", "_", image.name.upper())
+
+		lines.append(
+			f"#define {prefix}_{name}_CLUT {image.clut}\n"
+			f"#define {prefix}_{name}_W    {image.width}\n"
+			f"#define {prefix}_{name}_H    {image.height}\n"
+		)
+
+	return "\n".join(lines)
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Converts images into 4bpp/8bpp indexed color data using as few "
+			"shared 16bpp palettes as possible.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+	group.add_argument(
+		"-Q", "--quiet",
+		action = "store_true",
+		help   = "Do not print which palette each image ended up with"
+	)
+
+	group = parser.add_argument_group("Conversion options")
+	group.add_argument(
+		"-b", "--bpp",
+		type    = int,
+		choices = ( 4, 8 ),
+		default = 4,
+		help    = "Use specified color depth (default 4bpp)",
+		metavar = "4|8"
+	)
+	group.add_argument(
+		"-s", "--force-stp",
+		action = "store_true",
+		help   = \
+			"Set the semitransparency/blending flag on all pixels (see "
+			"convertImage.py)"
+	)
+	group.add_argument(
+		"-S", "--stp-black",
+		action = "store_true",
+		help   = \
+			"Use semitransparent black instead of solid dark gray for black "
+			"pixels (see convertImage.py)"
+	)
+	group.add_argument(
+		"-q", "--quantize",
+		action = "store_true",
+		help   = \
+			"Reduce the colors of images that have more than the chosen depth "
+			"allows, instead of rejecting them"
+	)
+	group.add_argument(
+		"-d", "--dither",
+		action = "store_true",
+		help   = "Use ordered dithering when reducing colors, implies -q"
+	)
+	group.add_argument(
+		"-n", "--name",
+		type    = str,
+		default = "shared",
+		help    = \
+			"Prefix for palette files and header macros (default \"shared\")",
+		metavar = "name"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"-H", "--header",
+		type    = Path,
+		help    = "Path to C header to generate",
+		metavar = "file"
+	)
+	group.add_argument(
+		"output",
+		type = Path,
+		help = \
+			"Directory to write image data (imagename_t.dat) and palettes "
+			"(name_clut0.dat...) to"
+	)
+	group.add_argument(
+		"images",
+		nargs   = "+",
+		help    = "Images to convert, as name=image.png or just image.png",
+		metavar = "[name=]path"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	images:    list[SharedImage] = []
+	numColors: int               = 2 ** args.bpp
+
+	try:
+		for spec in args.images:
+			name, _, path = spec.rpartition("=")
+			name          = name or Path(path).stem
+
+			if any(image.name == name for image in images):
+				raise RuntimeError(f"more than one image named {name}")
+
+			images.append(SharedImage(name, path, numColors, args))
+
+		palettes: list[list[int]] = mergePalettes(images, numColors)
+	except (OSError, RuntimeError) as err:
+		parser.error(str(err))
+
+	args.output.mkdir(parents = True, exist_ok = True)
+
+	for index, palette in enumerate(palettes):
+		data: NDArray[np.uint16] = np.zeros(numColors, "<H")
+		data[0:len(palette)]     = palette
+
+		with open(args.output / f"{args.name}_clut{index}.dat", "wb") as file:
+			file.write(data.tobytes())
+
+	for image in images:
+		with open(args.output / f"{image.name}_t.dat", "wb") as file:
+			file.write(image.getIndexedData(palettes[image.clut], args.bpp))
+
+	if args.header:
+		with open(args.header, "wt", newline = "\n") as file:
+			file.write(
+				generateHeader(images, palettes, args.bpp, args.name.upper())
+			)
+
+	if not args.quiet:
+		for image in images:
+			print(
+				f"{image.name}: clut {image.clut}, {len(image.colors)} colors, "
+				f"{image.width}x{image.height}"
+			)
+
+		print(f"{len(images)} images, {len(palettes)} palettes")
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,284 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""LZ4 decoder round-trip test
+
+Compiles lib/lz4.c for the host along with a small harness, then compresses a
+set of generated test blocks using the same code as packArchive.py and checks
+that both decompressLZ4() and feedLZ4Stream() give back the original data. The
+streaming decoder is run in place, with the compressed block placed at the end
+of a buffer sized the same way the archive loader sizes it and fed in chunks
+of various sizes (including whole sectors), so the in-place margin computed by
+the packer gets checked as well.
+
+The blocks include repeating patterns of every period from 1 to 16 bytes, as
+short match offsets take different paths in the decoder's copy loops. The
+harness is built once per optimization level given, since bugs in those loops
+may only show up once the compiler starts reordering loads and stores. Only a
+C compiler for the host is required.
+"""
+
+__version__ = "0.1.0"
+
+import random, struct, subprocess
+from argparse import ArgumentParser, Namespace
+from pathlib  import Path
+from tempfile import TemporaryDirectory
+
+from packArchive import SECTOR_SIZE, alignTo, compressLZ4
+
+## Test harness
+
+# Kept here rather than as a .c file, as build.bat and build.sh pick up every
+# .c file in the tree.
+HARNESS_SOURCE: str = r"""
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lz4.h"
+
+static int check(const char *what, const uint8_t *output, const uint8_t *data, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		if (output[i] != data[i]) {
+			printf("%s: mismatch at offset %zu\n", what, i);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	FILE *file = fopen(argv[1], "rb");
+	uint32_t header[3];
+
+	if (!file || (fread(header, 4, 3, file) != 3))
+		return 2;
+
+	size_t size = header[0], packedSize = header[1], bufferSize = header[2];
+	uint8_t *packed = malloc(packedSize + 1), *data = malloc(size + 1);
+
+	if (
+		(fread(packed, 1, packedSize, file) != packedSize) ||
+		(fread(data, 1, size, file) != size)
+	)
+		return 2;
+
+	fclose(file);
+
+	int failed = 0;
+
+	// Block decoder, into a buffer with no room to spare.
+	uint8_t *output = malloc(size + 1);
+
+	if (decompressLZ4(output, size, packed, packedSize) != size) {
+		puts("decompressLZ4: wrong length");
+		failed = 1;
+	} else {
+		failed |= check("decompressLZ4", output, data, size);
+	}
+
+	// Streaming decoder, in place, as done by lib/archive.c.
+	static const size_t chunkSizes[] = { 1, 7, 2048, 0 };
+	size_t sectors = (packedSize + 2047) / 2048 * 2048;
+	uint8_t *buffer = malloc(bufferSize);
+
+	for (const size_t *chunkSize = chunkSizes; *chunkSize; chunkSize++) {
+		uint8_t *input = buffer + bufferSize - sectors;
+		LZ4Stream stream;
+		LZ4StreamStatus status = LZ4_STREAM_MORE;
+
+		memset(buffer, 0, bufferSize);
+		memcpy(input, packed, packedSize);
+		initLZ4Stream(&stream, buffer, size, packedSize);
+
+		for (size_t offset = 0; status == LZ4_STREAM_MORE; offset += *chunkSize)
+			status = feedLZ4Stream(&stream, input + offset, *chunkSize);
+
+		if (status != LZ4_STREAM_DONE) {
+			printf("feedLZ4Stream (%zu-byte chunks): failed\n", *chunkSize);
+			failed = 1;
+		} else {
+			char what[64];
+
+			snprintf(what, sizeof(what), "feedLZ4Stream (%zu-byte chunks)", *chunkSize);
+			failed |= check(what, buffer, data, size);
+		}
+	}
+
+	return failed;
+}
+"""
+
+def buildHarness(
+	compiler: str,
+	options:  list[str],
+	libPath:  Path,
+	outPath:  Path
+):
+	sourcePath: Path = outPath.with_suffix(".c")
+	sourcePath.write_text(HARNESS_SOURCE)
+
+	subprocess.run(
+		[
+			compiler,
+			*options,
+			"-std=gnu17",
+			"-Wall",
+			"-I", str(libPath),
+			"-o", str(outPath),
+			str(sourcePath),
+			str(libPath / "lz4.c")
+		],
+		check = True
+	)
+
+## Test data
+
+def generateBlocks(seed: int) -> list[tuple[str, bytes]]:
+	rng:    random.Random           = random.Random(seed)
+	blocks: list[tuple[str, bytes]] = []
+
+	blocks.append(( "random", rng.randbytes(20000) ))
+	blocks.append(( "zeros", bytes(20000) ))
+
+	for size in ( 1, 12, 13, 100, 5000 ):
+		blocks.append((
+			f"two symbols, {size} bytes",
+			bytes(rng.choice(b"ab") for _ in range(size))
+		))
+
+	for period in range(1, 17):
+		pattern: bytes = rng.randbytes(period)
+
+		for length in ( 16, 31, 200, 4099 ):
+			# Surround the run with random bytes, so matches start and end at
+			# unaligned positions.
+			blocks.append((
+				f"period {period}, {length} bytes",
+				rng.randbytes(rng.randrange(8)) +
+				(pattern * (length // period + 1))[:length] +
+				rng.randbytes(rng.randrange(8))
+			))
+
+	# Something resembling actual assets, i.e. mostly short repeats with the
+	# occasional run and random noise in between.
+	mixed: bytearray = bytearray()
+
+	while len(mixed) < 50000:
+		choice: int = rng.randrange(3)
+
+		if choice == 0:
+			mixed += rng.randbytes(rng.randrange(1, 40))
+		elif choice == 1:
+			mixed += bytes([ rng.randrange(256) ]) * rng.randrange(1, 300)
+		elif len(mixed) > 16:
+			start: int = rng.randrange(len(mixed) - 8)
+			mixed += mixed[start:start + rng.randrange(4, 80)]
+
+	blocks.append(( "mixed", bytes(mixed) ))
+
+	return blocks
+
+def writeBlock(data: bytes, path: Path):
+	packed, ahead = compressLZ4(data)
+
+	# Same buffer size as packArchive.Entry computes for compressed entries.
+	bufferSize: int = \
+		alignTo(max(len(data), alignTo(len(packed), SECTOR_SIZE) + ahead), 4)
+
+	with path.open("wb") as file:
+		file.write(struct.pack("< 3I", len(data), len(packed), bufferSize))
+		file.write(packed)
+		file.write(data)
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Checks lib/lz4.c against packArchive.py's compressor by building "
+			"it for the host and decompressing a set of test blocks.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+
+	group = parser.add_argument_group("Test options")
+	group.add_argument(
+		"-c", "--cc",
+		type    = str,
+		default = "cc",
+		help    = "Host C compiler to use (default cc)",
+		metavar = "path"
+	)
+	group.add_argument(
+		"-O", "--optimize",
+		type    = str,
+		action  = "append",
+		help    = \
+			"Optimization level to build the harness with, can be given more "
+			"than once (default 0, 2 and s)",
+		metavar = "level"
+	)
+	group.add_argument(
+		"-s", "--seed",
+		type    = int,
+		default = 0,
+		help    = "Seed for generating test data (default 0)",
+		metavar = "value"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	libPath: Path         = Path(__file__).parent.parent / "lib"
+	levels:  list[str]    = args.optimize or [ "0", "2", "s" ]
+	blocks:  list[tuple[str, bytes]] = generateBlocks(args.seed)
+	failed:  int          = 0
+
+	with TemporaryDirectory() as tempDir:
+		blockPaths: list[Path] = []
+
+		for index, ( _, data ) in enumerate(blocks):
+			path: Path = Path(tempDir) / f"block{index}.bin"
+
+			writeBlock(data, path)
+			blockPaths.append(path)
+
+		for level in levels:
+			harnessPath: Path = Path(tempDir) / f"harness_O{level}"
+
+			try:
+				buildHarness(args.cc, [ f"-O{level}" ], libPath, harnessPath)
+			except (OSError, subprocess.CalledProcessError) as err:
+				parser.error(f"failed to build harness: {err}")
+
+			for ( name, _ ), path in zip(blocks, blockPaths):
+				result = subprocess.run(
+					[ str(harnessPath), str(path) ],
+					capture_output = True,
+					text           = True
+				)
+
+				if result.returncode:
+					print(f"FAIL -O{level} {name}: {result.stdout.strip()}")
+					failed += 1
+
+			print(f"-O{level}: {len(blocks)} blocks checked")
+
+	if failed:
+		parser.exit(1, f"{failed} checks failed\n")
+
+	print("all checks passed")
+
+if __name__ == "__main__":
+	main()